@@ -0,0 +1,28 @@
+TEMPLATE = app
+
+CONFIG += console c++1z
+CONFIG -= app_bundle qt
+
+SOURCES += \
+    main.cpp \
+    trace.cpp \
+    ../GapBuffer-template/texteditor.cpp \
+    ../GapBuffer-template/journal.cpp \
+    ../GapBuffer-template/piecetable.cpp
+
+HEADERS += \
+    trace.h \
+    ../GapBuffer-template/GapBuffer.h \
+    ../GapBuffer-template/latencyhistogram.h \
+    ../GapBuffer-template/texteditor.h \
+    ../GapBuffer-template/journal.h \
+    ../GapBuffer-template/piecetable.h
+
+INCLUDEPATH += ../GapBuffer-template
+
+unix:!macx: LIBS += -lrt -lpthread
+
+QMAKE_CXXFLAGS += -std=c++1z \
+    -Wall \
+    -Wextra \
+    -O2
@@ -0,0 +1,96 @@
+/*
+ * Keystroke trace tool for benchmarking TextEditor under realistic use.
+ *
+ *   EditorTrace synth <typing|navigation|paste> <events> <trace file> [seed]
+ *   EditorTrace replay <trace file> <document>
+ *               [--backend locked|lockfree|mapped|gapbuffer] [--readers N] [--realtime]
+ *
+ * synth writes a synthetic trace; replay runs a trace (synthesized or
+ * recorded with TraceRecorder) against a copy of document and reports
+ * throughput and latency percentiles. Replaying the same trace with
+ * different backends and reader counts compares storage and locking
+ * strategies on identical input.
+ */
+#include "trace.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+using namespace std;
+
+const char* const kUsage =
+    "usage: EditorTrace synth <typing|navigation|paste> <events> <trace file> [seed]\n"
+    "       EditorTrace replay <trace file> <document>\n"
+    "                   [--backend locked|lockfree|mapped|gapbuffer] [--readers N] [--realtime]\n";
+
+TraceProfile parse_profile(const string& name) {
+    if (name == "typing") return TraceProfile::Typing;
+    if (name == "navigation") return TraceProfile::Navigation;
+    if (name == "paste") return TraceProfile::Paste;
+    throw string("unknown profile ") + name;
+}
+
+ReplayBackend parse_backend(const string& name) {
+    if (name == "locked") return ReplayBackend::Locked;
+    if (name == "lockfree") return ReplayBackend::LockFree;
+    if (name == "mapped") return ReplayBackend::Mapped;
+    if (name == "gapbuffer") return ReplayBackend::GapBuffer;
+    throw string("unknown backend ") + name;
+}
+
+int synth(int argc, char* argv[]) {
+    if (argc < 5 || argc > 6) {
+        cerr << kUsage;
+        return 1;
+    }
+    TraceProfile profile = parse_profile(argv[2]);
+    size_t events = strtoull(argv[3], nullptr, 10);
+    unsigned seed = argc == 6 ? static_cast<unsigned>(strtoul(argv[5], nullptr, 10)) : 106;
+    ofstream out(argv[4], ios::binary);
+    if (!out) {
+        throw string("cannot write ") + argv[4];
+    }
+    write_trace(out, synthesize_trace(profile, events, seed));
+    return 0;
+}
+
+int replay(int argc, char* argv[]) {
+    if (argc < 4) {
+        cerr << kUsage;
+        return 1;
+    }
+    ReplayOptions options;
+    for (int i = 4; i < argc; ++i) {
+        string flag = argv[i];
+        if (flag == "--realtime") {
+            options.real_time = true;
+        } else if (flag == "--backend" && i + 1 < argc) {
+            options.backend = parse_backend(argv[++i]);
+        } else if (flag == "--readers" && i + 1 < argc) {
+            options.readers = atoi(argv[++i]);
+        } else {
+            cerr << kUsage;
+            return 1;
+        }
+    }
+    ifstream in(argv[2], ios::binary);
+    if (!in) {
+        throw string("cannot read ") + argv[2];
+    }
+    Trace trace = read_trace(in);
+    print_result(cout, replay_trace(trace, argv[3], options));
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    string command = argc > 1 ? argv[1] : "";
+    try {
+        if (command == "synth") return synth(argc, argv);
+        if (command == "replay") return replay(argc, argv);
+    } catch (const string& message) {
+        cerr << message << endl;
+        return 1;
+    }
+    cerr << kUsage;
+    return 1;
+}
@@ -0,0 +1,458 @@
+#include "trace.h"
+#include "GapBuffer.h"
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <utility> // for std::as_const
+
+const char* const kTraceHeader = "editortrace 1";
+
+namespace {
+
+const char kHexDigits[] = "0123456789abcdef";
+
+std::string to_hex(const std::string& text) {
+    std::string hex;
+    hex.reserve(2 * text.size());
+    for (unsigned char ch : text) {
+        hex.push_back(kHexDigits[ch >> 4]);
+        hex.push_back(kHexDigits[ch & 15]);
+    }
+    return hex;
+}
+
+int hex_value(char digit) {
+    if (digit >= '0' && digit <= '9') return digit - '0';
+    if (digit >= 'a' && digit <= 'f') return digit - 'a' + 10;
+    return -1;
+}
+
+std::string from_hex(const std::string& hex, size_t line) {
+    std::string text;
+    text.reserve(hex.size() / 2);
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        int high = hex_value(hex[i]);
+        int low = hex_value(hex[i + 1]);
+        if (high < 0 || low < 0) {
+            throw std::string("read_trace: bad paste text on line ") + std::to_string(line);
+        }
+        text.push_back(static_cast<char>(high * 16 + low));
+    }
+    return text;
+}
+
+/*
+ * Replay targets. Both take the same commands; reads return a character
+ * so the caller can fold it into a sink the optimizer cannot drop. Read
+ * positions are wrapped to the document, which need not be the one the
+ * trace was recorded on.
+ */
+struct EditorTarget {
+    TextEditor& editor;
+
+    void key(char ch) { editor.press_key(ch); }
+    void left() { editor.press_left(); }
+    void right() { editor.press_right(); }
+    void backspace() { editor.press_backspace(); }
+    void paste(const std::string& text) { editor.press_keys(text); }
+    char next_character() {
+        return editor.cursor_index() < editor.size() ? editor.retrieve_next_character() : '\0';
+    }
+    char character(size_t position) {
+        size_t size = editor.size();
+        return size == 0 ? '\0' : editor.retrieve_character(position % size);
+    }
+    char range(size_t position, size_t count) {
+        size_t size = editor.size();
+        std::string text = editor.retrieve_range(size == 0 ? 0 : position % size, count);
+        return text.empty() ? '\0' : text.back();
+    }
+};
+
+struct BufferTarget {
+    GapBuffer<char>& buffer;
+
+    void key(char ch) { buffer.insert_at_cursor(ch); }
+    void left() {
+        if (buffer.cursor_index() > 0) buffer.move_cursor(-1);
+    }
+    void right() {
+        if (buffer.cursor_index() < buffer.size()) buffer.move_cursor(1);
+    }
+    void backspace() {
+        if (buffer.cursor_index() > 0) buffer.delete_at_cursor();
+    }
+    void paste(const std::string& text) { buffer.insert_at_cursor(std::string_view(text)); }
+    char next_character() {
+        return buffer.cursor_index() < buffer.size() ? std::as_const(buffer).get_at_cursor() : '\0';
+    }
+    char character(size_t position) {
+        return buffer.empty() ? '\0' : std::as_const(buffer).at(position % buffer.size());
+    }
+    char range(size_t position, size_t count) {
+        if (buffer.empty()) return '\0';
+        position %= buffer.size();
+        count = std::min(count, buffer.size() - position);
+        char last = '\0';
+        for (size_t i = position; i < position + count; ++i) {
+            last = std::as_const(buffer).at(i);
+        }
+        return last;
+    }
+};
+
+struct ReplayHistograms {
+    LatencyHistogram edits;
+    LatencyHistogram moves;
+    LatencyHistogram reads;
+    LatencyHistogram reader_reads;
+};
+
+template <typename Target>
+void run_events(const Trace& trace, Target& target, bool real_time, ReplayHistograms& histograms) {
+    auto start = std::chrono::steady_clock::now();
+    unsigned sink = 0;
+    for (const TraceEvent& event : trace) {
+        if (real_time) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(event.time_us));
+        }
+        switch (event.op) {
+        case TraceEvent::Op::Key: {
+            LatencyTimer timer(&histograms.edits);
+            target.key(event.ch);
+            break;
+        }
+        case TraceEvent::Op::Backspace: {
+            LatencyTimer timer(&histograms.edits);
+            target.backspace();
+            break;
+        }
+        case TraceEvent::Op::Paste: {
+            LatencyTimer timer(&histograms.edits);
+            target.paste(event.text);
+            break;
+        }
+        case TraceEvent::Op::Left: {
+            LatencyTimer timer(&histograms.moves);
+            target.left();
+            break;
+        }
+        case TraceEvent::Op::Right: {
+            LatencyTimer timer(&histograms.moves);
+            target.right();
+            break;
+        }
+        case TraceEvent::Op::NextCharacter: {
+            LatencyTimer timer(&histograms.reads);
+            sink += target.next_character();
+            break;
+        }
+        case TraceEvent::Op::Character: {
+            LatencyTimer timer(&histograms.reads);
+            sink += target.character(event.position);
+            break;
+        }
+        case TraceEvent::Op::Range: {
+            LatencyTimer timer(&histograms.reads);
+            sink += target.range(event.position, event.count);
+            break;
+        }
+        }
+    }
+    static std::atomic<unsigned> keep;
+    keep.store(sink, std::memory_order_relaxed);
+}
+
+std::string read_document(const std::string& document) {
+    std::ifstream file(document, std::ios::binary);
+    if (!file) {
+        throw std::string("replay_trace: cannot open ") + document;
+    }
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+TraceEvent make_event(TraceEvent::Op op, uint64_t time_us, char ch = '\0', size_t position = 0,
+                      size_t count = 0, std::string text = std::string()) {
+    return {op, time_us, ch, position, count, std::move(text)};
+}
+
+}
+
+void write_trace(std::ostream& out, const Trace& trace) {
+    out << kTraceHeader << '\n';
+    for (const TraceEvent& event : trace) {
+        out << event.time_us << ' ';
+        switch (event.op) {
+        case TraceEvent::Op::Key:
+            out << "K " << static_cast<int>(static_cast<unsigned char>(event.ch));
+            break;
+        case TraceEvent::Op::Left: out << 'L'; break;
+        case TraceEvent::Op::Right: out << 'R'; break;
+        case TraceEvent::Op::Backspace: out << 'B'; break;
+        case TraceEvent::Op::NextCharacter: out << 'N'; break;
+        case TraceEvent::Op::Paste:
+            out << "P " << event.text.size() << ' ' << to_hex(event.text);
+            break;
+        case TraceEvent::Op::Character:
+            out << "C " << event.position;
+            break;
+        case TraceEvent::Op::Range:
+            out << "S " << event.position << ' ' << event.count;
+            break;
+        }
+        out << '\n';
+    }
+}
+
+Trace read_trace(std::istream& in) {
+    std::string line;
+    if (!std::getline(in, line) || line != kTraceHeader) {
+        throw std::string("read_trace: not an editor trace");
+    }
+    Trace trace;
+    size_t line_number = 1;
+    while (std::getline(in, line)) {
+        line_number++;
+        if (line.empty()) continue;
+        std::istringstream fields(line);
+        uint64_t time_us;
+        char op;
+        if (!(fields >> time_us >> op)) {
+            throw std::string("read_trace: bad event on line ") + std::to_string(line_number);
+        }
+        bool ok = true;
+        switch (op) {
+        case 'K': {
+            int code = 0;
+            ok = static_cast<bool>(fields >> code);
+            trace.push_back(make_event(TraceEvent::Op::Key, time_us, static_cast<char>(code)));
+            break;
+        }
+        case 'L': trace.push_back(make_event(TraceEvent::Op::Left, time_us)); break;
+        case 'R': trace.push_back(make_event(TraceEvent::Op::Right, time_us)); break;
+        case 'B': trace.push_back(make_event(TraceEvent::Op::Backspace, time_us)); break;
+        case 'N': trace.push_back(make_event(TraceEvent::Op::NextCharacter, time_us)); break;
+        case 'P': {
+            size_t length = 0;
+            std::string hex;
+            ok = static_cast<bool>(fields >> length);
+            if (length > 0) {
+                ok = ok && static_cast<bool>(fields >> hex);
+            }
+            std::string text = from_hex(hex, line_number);
+            ok = ok && text.size() == length;
+            trace.push_back(make_event(TraceEvent::Op::Paste, time_us, '\0', 0, 0, std::move(text)));
+            break;
+        }
+        case 'C': {
+            size_t position = 0;
+            ok = static_cast<bool>(fields >> position);
+            trace.push_back(make_event(TraceEvent::Op::Character, time_us, '\0', position));
+            break;
+        }
+        case 'S': {
+            size_t position = 0, count = 0;
+            ok = static_cast<bool>(fields >> position >> count);
+            trace.push_back(make_event(TraceEvent::Op::Range, time_us, '\0', position, count));
+            break;
+        }
+        default:
+            ok = false;
+        }
+        if (!ok) {
+            throw std::string("read_trace: bad event on line ") + std::to_string(line_number);
+        }
+    }
+    return trace;
+}
+
+TraceRecorder::TraceRecorder(TextEditor& editor) :
+    _editor(editor),
+    _start(std::chrono::steady_clock::now()) {}
+
+void TraceRecorder::record(TraceEvent::Op op, char ch, size_t position, size_t count, std::string text) {
+    auto elapsed = std::chrono::steady_clock::now() - _start;
+    uint64_t time_us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    _trace.push_back(make_event(op, time_us, ch, position, count, std::move(text)));
+}
+
+void TraceRecorder::press_key(char ch) {
+    record(TraceEvent::Op::Key, ch);
+    _editor.press_key(ch);
+}
+
+void TraceRecorder::press_left() {
+    record(TraceEvent::Op::Left);
+    _editor.press_left();
+}
+
+void TraceRecorder::press_right() {
+    record(TraceEvent::Op::Right);
+    _editor.press_right();
+}
+
+void TraceRecorder::press_backspace() {
+    record(TraceEvent::Op::Backspace);
+    _editor.press_backspace();
+}
+
+void TraceRecorder::press_keys(const std::string& text) {
+    record(TraceEvent::Op::Paste, '\0', 0, 0, text);
+    _editor.press_keys(text);
+}
+
+char TraceRecorder::retrieve_next_character() {
+    record(TraceEvent::Op::NextCharacter);
+    return _editor.retrieve_next_character();
+}
+
+char TraceRecorder::retrieve_character(size_t position) {
+    record(TraceEvent::Op::Character, '\0', position);
+    return _editor.retrieve_character(position);
+}
+
+std::string TraceRecorder::retrieve_range(size_t position, size_t count) {
+    record(TraceEvent::Op::Range, '\0', position, count);
+    return _editor.retrieve_range(position, count);
+}
+
+const Trace& TraceRecorder::trace() const {
+    return _trace;
+}
+
+/*
+ * Builds a trace of that many events with human-like timing: keys about
+ * 120ms apart while typing (bursts of cursor keys faster), with the same
+ * seed always giving the same trace. Read positions are spread over the
+ * first megabyte and wrapped to the document on replay.
+ */
+Trace synthesize_trace(TraceProfile profile, size_t events, unsigned seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::uniform_int_distribution<int> letter('a', 'z');
+    std::uniform_int_distribution<size_t> position(0, 1 << 20);
+    std::uniform_int_distribution<size_t> paste_size(1 << 10, 64 << 10);
+    std::exponential_distribution<double> typing_gap(1.0 / 120000);
+    std::exponential_distribution<double> cursor_gap(1.0 / 30000);
+
+    Trace trace;
+    trace.reserve(events);
+    double time_us = 0;
+    while (trace.size() < events) {
+        int roll = percent(random);
+        uint64_t now = static_cast<uint64_t>(time_us);
+        bool navigating = profile == TraceProfile::Navigation;
+        if (profile == TraceProfile::Paste && roll < 2) {
+            std::string text(paste_size(random), ' ');
+            for (char& ch : text) {
+                ch = static_cast<char>(letter(random));
+            }
+            trace.push_back(make_event(TraceEvent::Op::Paste, now, '\0', 0, 0, std::move(text)));
+            time_us += typing_gap(random);
+        } else if ((navigating && roll < 60) || (!navigating && roll < 5)) {
+            // a burst of cursor keys in one direction
+            TraceEvent::Op op = percent(random) < 50 ? TraceEvent::Op::Left : TraceEvent::Op::Right;
+            int burst = 1 + percent(random) % 8;
+            for (int i = 0; i < burst && trace.size() < events; ++i) {
+                trace.push_back(make_event(op, static_cast<uint64_t>(time_us)));
+                time_us += cursor_gap(random);
+            }
+        } else if ((navigating && roll < 80) || (!navigating && roll < 7)) {
+            trace.push_back(make_event(TraceEvent::Op::Character, now, '\0', position(random)));
+            time_us += cursor_gap(random);
+        } else if ((navigating && roll < 90) || (!navigating && roll < 8)) {
+            trace.push_back(make_event(TraceEvent::Op::Range, now, '\0', position(random), 80));
+            time_us += cursor_gap(random);
+        } else if (!navigating && roll < 16) {
+            trace.push_back(make_event(TraceEvent::Op::Backspace, now));
+            time_us += typing_gap(random);
+        } else {
+            int kind = percent(random);
+            char ch = kind < 15 ? ' ' : kind < 17 ? '\n' : static_cast<char>(letter(random));
+            trace.push_back(make_event(TraceEvent::Op::Key, now, ch));
+            time_us += typing_gap(random);
+        }
+    }
+    return trace;
+}
+
+/*
+ * Replays trace against a fresh copy of document. Loading is not timed.
+ * With readers, that many threads keep reading random characters for the
+ * whole replay; their reads are timed separately.
+ */
+ReplayResult replay_trace(const Trace& trace, const std::string& document, const ReplayOptions& options) {
+    ReplayHistograms histograms;
+    std::chrono::steady_clock::time_point start, end;
+    if (options.backend == ReplayBackend::GapBuffer) {
+        if (options.readers > 0) {
+            throw std::string("replay_trace: a bare GapBuffer cannot have concurrent readers");
+        }
+        std::string text = read_document(document);
+        GapBuffer<char> buffer;
+        buffer.insert_at_cursor(std::string_view(text));
+        buffer.move_cursor(-static_cast<long long>(buffer.size()));
+        BufferTarget target{buffer};
+        start = std::chrono::steady_clock::now();
+        run_events(trace, target, options.real_time, histograms);
+        end = std::chrono::steady_clock::now();
+    } else {
+        ReadMode mode = options.backend == ReplayBackend::LockFree ? ReadMode::LockFree : ReadMode::Locked;
+        Storage storage = options.backend == ReplayBackend::Mapped ? Storage::Mapped : Storage::InMemory;
+        TextEditor editor(document, mode, storage);
+        editor.wait_until_loaded();
+        std::atomic<bool> stop(false);
+        std::vector<std::thread> readers;
+        for (int i = 0; i < options.readers; ++i) {
+            readers.emplace_back([&, i] {
+                uint64_t state = 0x9e3779b97f4a7c15ULL * (i + 1);
+                unsigned sink = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    state ^= state << 13;
+                    state ^= state >> 7;
+                    state ^= state << 17;
+                    size_t size = editor.size();
+                    if (size == 0) continue;
+                    LatencyTimer timer(&histograms.reader_reads);
+                    sink += editor.retrieve_character(state % size);
+                }
+                static std::atomic<unsigned> keep;
+                keep.store(sink, std::memory_order_relaxed);
+            });
+        }
+        EditorTarget target{editor};
+        start = std::chrono::steady_clock::now();
+        run_events(trace, target, options.real_time, histograms);
+        end = std::chrono::steady_clock::now();
+        stop = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+    }
+    return {trace.size(), std::chrono::duration<double>(end - start).count(),
+            histograms.edits.snapshot(), histograms.moves.snapshot(),
+            histograms.reads.snapshot(), histograms.reader_reads.snapshot()};
+}
+
+void print_result(std::ostream& out, const ReplayResult& result) {
+    out << "events  " << result.events << " in " << std::fixed << std::setprecision(3)
+        << result.seconds << " s";
+    if (result.seconds > 0) {
+        out << " (" << static_cast<uint64_t>(result.events / result.seconds) << " events/s)";
+    }
+    out << '\n';
+    auto row = [&out](const char* name, const LatencySnapshot& s) {
+        if (s.count == 0) return;
+        out << std::left << std::setw(8) << name << std::right
+            << "count " << s.count << "  p50 " << s.p50 << "ns  p99 " << s.p99
+            << "ns  p999 " << s.p999 << "ns  max " << s.max << "ns\n";
+    };
+    row("edits", result.edits);
+    row("moves", result.moves);
+    row("reads", result.reads);
+    row("readers", result.reader_reads);
+}
@@ -0,0 +1,101 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "texteditor.h"
+#include "latencyhistogram.h"
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * One timestamped editor command. time_us is microseconds since the start
+ * of the trace; position and count only mean something for the reads
+ * that take them, ch for Key and text for Paste.
+ */
+struct TraceEvent {
+    enum class Op { Key, Left, Right, Backspace, Paste, NextCharacter, Character, Range };
+    Op op;
+    uint64_t time_us;
+    char ch;
+    size_t position;
+    size_t count;
+    std::string text;
+};
+
+using Trace = std::vector<TraceEvent>;
+
+/*
+ * Trace files are text, one event per line after a version header:
+ *
+ *   editortrace 1
+ *   <time_us> K <character code>
+ *   <time_us> L | R | B | N
+ *   <time_us> P <length> <text as hex>
+ *   <time_us> C <position>
+ *   <time_us> S <position> <count>
+ *
+ * for key, left, right, backspace, retrieve_next_character, paste
+ * (press_keys), retrieve_character and retrieve_range.
+ */
+void write_trace(std::ostream& out, const Trace& trace);
+Trace read_trace(std::istream& in);
+
+/*
+ * Drop-in front for a TextEditor that forwards every command and records
+ * it, with the time since the recorder was created.
+ */
+class TraceRecorder {
+public:
+    explicit TraceRecorder(TextEditor& editor);
+    void press_key(char ch);
+    void press_left();
+    void press_right();
+    void press_backspace();
+    void press_keys(const std::string& text);
+    char retrieve_next_character();
+    char retrieve_character(size_t position);
+    std::string retrieve_range(size_t position, size_t count);
+    const Trace& trace() const;
+
+private:
+    TextEditor& _editor;
+    std::chrono::steady_clock::time_point _start;
+    Trace _trace;
+
+    void record(TraceEvent::Op op, char ch = '\0', size_t position = 0, size_t count = 0,
+                std::string text = std::string());
+};
+
+// Synthetic usage patterns. Typing is mostly keys with corrections,
+// Navigation mostly cursor movement and reads, Paste typing with
+// occasional large pastes.
+enum class TraceProfile { Typing, Navigation, Paste };
+
+Trace synthesize_trace(TraceProfile profile, size_t events, unsigned seed);
+
+// What a trace is replayed against: the editor with either read mode, the
+// editor on a mapped piece table (Storage::Mapped, locked reads), or a bare
+// GapBuffer<char> (no locks, no concurrent readers).
+enum class ReplayBackend { Locked, LockFree, Mapped, GapBuffer };
+
+struct ReplayOptions {
+    ReplayBackend backend = ReplayBackend::Locked;
+    bool real_time = false; // keep the trace's timing instead of full speed
+    int readers = 0;        // threads reading the document meanwhile
+};
+
+struct ReplayResult {
+    size_t events;
+    double seconds;
+    LatencySnapshot edits; // keys, backspaces and pastes
+    LatencySnapshot moves;
+    LatencySnapshot reads;
+    LatencySnapshot reader_reads; // from the reader threads
+};
+
+ReplayResult replay_trace(const Trace& trace, const std::string& document, const ReplayOptions& options);
+void print_result(std::ostream& out, const ReplayResult& result);
+
+#endif // TRACE_H
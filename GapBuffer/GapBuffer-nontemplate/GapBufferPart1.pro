@@ -1,6 +1,7 @@
 QT += testlib
 QT += gui
 CONFIG += qt warn_on depend_includepath testcase
+CONFIG += c++1z
 
 TEMPLATE = app
 
@@ -8,4 +9,5 @@ SOURCES +=  tst_testharness.cpp
 
 HEADERS += \
     GapBuffer.h \
-    IntVector.h
+    ../GapBuffer-template/GapBuffer.h \
+    ../GapBuffer-template/MarkerTree.h
@@ -32,6 +32,9 @@ private slots:
     void insert_operator_test_basic();
     // will add tests for << and comparison operators soon.
 
+    // char fast paths
+    void string_insert_find();
+
 };
 
 TestHarness::TestHarness() {
@@ -49,7 +52,7 @@ TestHarness::~TestHarness() { /* No global data used needed */}
  * Buffer: [ a b c d e f g ]
  */
 void TestHarness::insert_at_test_basic() {
-    GapBuffer buf;
+    GapBuffer<char> buf;
     for (char ch = 'a'; ch < 'g'; ch++) {
         buf.insert_at_cursor(ch);
     }
@@ -65,7 +68,7 @@ void TestHarness::insert_at_test_basic() {
  * Buffer: [ a b c d e f g ] -> [ a b c d e ] -> [ a b c d e x y z]
  */
 void TestHarness::insert_then_delete() {
-    GapBuffer buf;
+    GapBuffer<char> buf;
     for (char ch = 'a'; ch <= 'g'; ch++) {
         buf.insert_at_cursor(ch);
     }
@@ -92,7 +95,7 @@ void TestHarness::insert_then_delete() {
  * Buffer: [ a b c ] -> [ a b e ]
  */
 void TestHarness::edit_at() {
-    GapBuffer buf;
+    GapBuffer<char> buf;
     buf.insert_at_cursor('a');
     buf.insert_at_cursor('b');
     buf.insert_at_cursor('c');
@@ -111,7 +114,7 @@ void TestHarness::edit_at() {
  * Uses move and at to verify all elements are correct.
  */
 void TestHarness::reserve_test_basic() {
-    GapBuffer buf;
+    GapBuffer<char> buf;
     vector<char> vec;
     for (char ch = 'a'; ch <= 'o'; ++ch) {
         buf.insert_at_cursor(ch);
@@ -131,7 +134,7 @@ void TestHarness::reserve_test_basic() {
  * Buffer: [ a b c d e f g ]
  */
 void TestHarness::insert_move_cursor_at_basic() {
-    GapBuffer buf;
+    GapBuffer<char> buf;
     for (char ch = 'a'; ch < 'g'; ch++) {
         buf.insert_at_cursor(ch);
     }
@@ -149,7 +152,7 @@ void TestHarness::insert_move_cursor_at_basic() {
  * End result: [ a b c d e f g h i j ]
  */
 void TestHarness::insert_delete_mixed_hard() {
-    GapBuffer buf;
+    GapBuffer<char> buf;
     for (int i = 0; i < 10; ++i) {
         buf.insert_at_cursor('a' + i);
         buf.insert_at_cursor('a' + i);
@@ -165,7 +168,7 @@ void TestHarness::insert_delete_mixed_hard() {
  * Checks if move_cursor by large amounts work correctly.
  */
 void TestHarness::move_cursor_jump() {
-    GapBuffer buf;
+    GapBuffer<char> buf;
     for (char ch = 'a'; ch <= 'g'; ch++) {
         buf.insert_at_cursor(ch);
     }
@@ -182,7 +185,7 @@ void TestHarness::move_cursor_jump() {
  * QSKIP prevents compiler errors even if you haven't implemented it.
  */
 void TestHarness::insert_operator_test_basic() {
-    GapBuffer buf;
+    GapBuffer<char> buf;
     for (char ch = 'a'; ch < 'g'; ch++) {
         buf.insert_at_cursor(ch);
     }
@@ -197,7 +200,7 @@ void TestHarness::insert_operator_test_basic() {
  */
 void TestHarness::insert_move_mixed() {
 
-    GapBuffer buf;
+    GapBuffer<char> buf;
     for (char ch = 'a'; ch <= 'g'; ch++) {
         buf.insert_at_cursor(ch);
     }
@@ -212,7 +215,7 @@ void TestHarness::insert_move_mixed() {
  * Tests the fill constructor by creating GapBuffer of 200 elements
 */
 void TestHarness::fill_constructor_test_basic() {
-    GapBuffer buf(200, 'c');
+    GapBuffer<char> buf(200, 'c');
     for (int i = 0; i < 200; ++i) {
         QVERIFY(buf.at(i) == 'c');
     }
@@ -224,7 +227,7 @@ void TestHarness::fill_constructor_test_basic() {
  * Tests insertion to ensure that is still possible.
  */
 void TestHarness::fill_constructor_edge() {
-    GapBuffer buf_zero(0, '%');
+    GapBuffer<char> buf_zero(0, '%');
     QVERIFY(buf_zero.size() == 0);
     QVERIFY(buf_zero.cursor_index() == 0);
     for (int i = 0; i < 20; ++i) {
@@ -234,7 +237,7 @@ void TestHarness::fill_constructor_edge() {
         QVERIFY(buf_zero.at(i) == ('a' + i));
     }
 
-    GapBuffer buf_one(1, '%');
+    GapBuffer<char> buf_one(1, '%');
     QVERIFY(buf_one.size() == 1);
     QVERIFY(buf_one.cursor_index() == 1);
     for (int i = 0; i < 20; ++i) {
@@ -247,13 +250,35 @@ void TestHarness::fill_constructor_edge() {
 }
 
 void TestHarness::const_test() {
-    const GapBuffer buf(15, 'c');
+    const GapBuffer<char> buf(15, 'c');
     QVERIFY(buf.at(10) == 'c');
     QVERIFY(buf.size() == 15);
     QVERIFY(buf.cursor_index() == 15);
 
 }
 
+/*
+ * Inserts whole strings at once, then searches across the gap.
+ *
+ * Buffer: [ h e l l o   w o r l d ] -> [ h e l l o ,   w o r l d ! ]
+ */
+void TestHarness::string_insert_find() {
+    GapBuffer<char> buf;
+    buf.insert_at_cursor(std::string_view("hello world"));
+    QVERIFY(buf.size() == 11);
+    QVERIFY(buf.cursor_index() == 11);
+    buf.insert_at_cursor(std::string_view("!"));
+    buf.move_cursor(-7);
+    buf.insert_at_cursor(',');
+    for (size_t i = 0; i < buf.size(); ++i) {
+        QVERIFY(buf.at(i) == "hello, world!"[i]);
+    }
+    QVERIFY(buf.find('h') == 0);
+    QVERIFY(buf.find('w') == 7);
+    QVERIFY(buf.find('o', 5) == 8);
+    QVERIFY(buf.find('z') == GapBuffer<char>::npos);
+}
+
 // We'll add more test cases as we move to later parts.
 
 // insert your own test cases here
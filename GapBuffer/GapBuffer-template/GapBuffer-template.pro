@@ -5,10 +5,32 @@ CONFIG += c++1z
 
 TEMPLATE = app
 
-SOURCES +=  tst_testcases.cpp
+SOURCES +=  tst_testcases.cpp \
+    texteditor.cpp \
+    journal.cpp \
+    threadpool.cpp \
+    documentmanager.cpp \
+    viewport.cpp \
+    search.cpp \
+    piecetable.cpp \
+    collab.cpp
 
 HEADERS += \
-    GapBuffer.h
+    GapBuffer.h \
+    GapBufferSoA.h \
+    MarkerTree.h \
+    SharedGapBuffer.h \
+    texteditor.h \
+    latencyhistogram.h \
+    journal.h \
+    threadpool.h \
+    documentmanager.h \
+    viewport.h \
+    search.h \
+    piecetable.h \
+    collab.h
+
+unix:!macx: LIBS += -lrt
 
 QMAKE_CXXFLAGS += -std=c++1z \
     -Wall \
@@ -6,10 +6,154 @@
 #include <algorithm>
 #include <sstream> // for stringstreams
 #include <memory> // for unique_ptr
+#include <type_traits> // for is_trivially_copyable
+#include <string_view> // for as_string_view
+#include <cstdint> // for uint64_t
+#include <functional> // for std::hash
+#include <utility> // for std::exchange
+#include <cstring> // for memmove, memchr, memcmp
+#include <cstddef> // for std::byte
+#include <iterator> // for std::distance
+#include "MarkerTree.h"
 
 using std::max;
 const size_t kDefaultSize = 10;
 
+// Polynomial hashing mod the Mersenne prime 2^61 - 1, used for
+// GapBuffer's incremental content hash.
+namespace gap_buffer_hash {
+const uint64_t kModulus = (uint64_t(1) << 61) - 1;
+const uint64_t kBase = 1000003;
+
+inline uint64_t reduce(uint64_t value) {
+    value = (value & kModulus) + (value >> 61);
+    return value >= kModulus ? value - kModulus : value;
+}
+
+inline uint64_t add(uint64_t a, uint64_t b) {
+    return reduce(a + b);
+}
+
+inline uint64_t subtract(uint64_t a, uint64_t b) {
+    return a >= b ? a - b : a + kModulus - b;
+}
+
+// a * b mod 2^61 - 1 using 32-bit halves, since 2^61 = 1 and 2^64 = 8 (mod p)
+inline uint64_t multiply(uint64_t a, uint64_t b) {
+    uint64_t a_low = a & 0xffffffff, a_high = a >> 32;
+    uint64_t b_low = b & 0xffffffff, b_high = b >> 32;
+    uint64_t low = a_low * b_low;
+    uint64_t mid = a_low * b_high + a_high * b_low;
+    uint64_t high = a_high * b_high;
+    uint64_t result = (high << 3) + (mid >> 29) + ((mid & ((uint64_t(1) << 29) - 1)) << 32)
+                      + (low >> 61) + (low & kModulus);
+    return reduce(reduce(result));
+}
+
+inline uint64_t inverse_base() {
+    static const uint64_t inverse = [] {
+        uint64_t result = 1, power = kBase;
+        for (uint64_t exponent = kModulus - 2; exponent > 0; exponent >>= 1) {
+            if (exponent & 1) result = multiply(result, power);
+            power = multiply(power, power);
+        }
+        return result;
+    }();
+    return inverse;
+}
+
+template <typename T, typename = void>
+struct is_hashable : std::false_type {};
+
+template <typename T>
+struct is_hashable<T, std::void_t<decltype(std::hash<T>{}(std::declval<const T&>()))>>
+    : std::true_type {};
+
+template <typename T>
+uint64_t element_hash(const T& element) {
+    return reduce(static_cast<uint64_t>(std::hash<T>{}(element)));
+}
+} // namespace gap_buffer_hash
+
+// Element-range primitives. Trivially copyable elements are shifted with
+// memmove, byte-sized ones are searched with memchr, and integral and
+// std::byte ones are compared with memcmp, which is what makes
+// GapBuffer<char> a fast text buffer.
+namespace gap_buffer_bytes {
+template <typename T>
+constexpr bool is_byte = sizeof(T) == 1 && std::is_integral<T>::value;
+
+// std::basic_string_view only takes character types, so other element
+// types get a parameter type nothing converts to.
+class not_a_view {
+    not_a_view() = default;
+};
+
+template <typename T>
+using view_of = std::conditional_t<is_byte<T>, std::basic_string_view<T>, not_a_view>;
+
+// [first, last) to dest, where dest <= first
+template <typename T>
+void move_down(T* first, T* last, T* dest) {
+    if (first == last) return;
+    if constexpr (std::is_trivially_copyable<T>::value) {
+        std::memmove(static_cast<void*>(dest), first, (last - first) * sizeof(T));
+    } else {
+        std::move(first, last, dest);
+    }
+}
+
+// [first, last) so that it ends at dest_last, where dest_last >= last
+template <typename T>
+void move_up(T* first, T* last, T* dest_last) {
+    if (first == last) return;
+    if constexpr (std::is_trivially_copyable<T>::value) {
+        std::memmove(static_cast<void*>(dest_last - (last - first)), first, (last - first) * sizeof(T));
+    } else {
+        std::move_backward(first, last, dest_last);
+    }
+}
+
+template <typename T>
+const T* find(const T* first, const T* last, const T& value) {
+    if constexpr (is_byte<T>) {
+        auto found = std::memchr(first, static_cast<unsigned char>(value), last - first);
+        return found == nullptr ? last : static_cast<const T*>(found);
+    } else {
+        return std::find(first, last, value);
+    }
+}
+
+// Only types whose == is known to be bytewise use memcmp; a trivially
+// copyable struct may define an operator== of its own.
+template <typename T>
+bool equal(const T* lhs, const T* rhs, size_t count) {
+    if constexpr (std::is_integral<T>::value || std::is_same<T, std::byte>::value) {
+        return count == 0 || std::memcmp(lhs, rhs, count * sizeof(T)) == 0;
+    } else {
+        return std::equal(lhs, lhs + count, rhs);
+    }
+}
+
+// The contiguous run of a GapBuffer's segments starting at external
+// index pos, with its length.
+template <typename Segments>
+auto segment_run(const Segments& segments, size_t pos, size_t& length) {
+    if (pos < segments.first_size) {
+        length = segments.first_size - pos;
+        return segments.first + pos;
+    }
+    length = segments.first_size + segments.second_size - pos;
+    return segments.second + (pos - segments.first_size);
+}
+} // namespace gap_buffer_bytes
+
+// How GapBuffer sizes the gap when it runs out of room.
+// Doubling is the classic 2x reserve. Adaptive sizes the gap from the
+// observed insertion bursts and edit locality (see GapBuffer::next_gap_size),
+// and the fill and initializer-list constructors leave only a small gap.
+enum class GapPolicy { Doubling, Adaptive };
+
 // forward declaration for the GapBufferIterator class
 template <typename T>
 class GapBufferIterator;
@@ -26,18 +170,55 @@ public:
     using reference = value_type&;
     using const_reference = const value_type&;
     using iterator = GapBufferIterator<T>;    
+    using marker = MarkerTree::marker_id;
+
+    static constexpr size_type npos = static_cast<size_type>(-1);
+
+    // The contents split around the gap: [first, first + first_size)
+    // followed by [second, second + second_size).
+    struct Segments {
+        const value_type* first;
+        size_type first_size;
+        const value_type* second;
+        size_type second_size;
+    };
+
+    // Snapshot of how the gap has been used, see gap_stats().
+    struct GapStats {
+        size_type capacity;
+        size_type gap_size;
+        size_type reallocations;      // times the storage was reallocated
+        size_type elements_relocated; // elements moved by those reallocations
+        size_type current_burst;      // length of the insertion run in progress
+        size_type average_burst;      // moving average of finished runs
+        size_type average_gap_move;   // moving average of elements moved per gap move
+    };
+
+    // One positioned edit for apply_edits: erase erase_count elements
+    // starting at pos, then insert the elements of insert at pos.
+    // pos is an external index into the buffer as it was before the batch.
+    struct Edit {
+        size_type pos;
+        size_type erase_count;
+        std::vector<value_type> insert;
+    };
 
     explicit GapBuffer();
-    explicit GapBuffer(size_type count, const value_type& val = value_type());
+    explicit GapBuffer(size_type count, const value_type& val = value_type(),
+                       GapPolicy policy = GapPolicy::Adaptive);
     ~GapBuffer();
-    GapBuffer(std::initializer_list<T> init);
+    GapBuffer(std::initializer_list<T> init, GapPolicy policy = GapPolicy::Adaptive);
     GapBuffer(const GapBuffer& other);
-    GapBuffer(GapBuffer&& other);
+    GapBuffer(GapBuffer&& other) noexcept;
     GapBuffer& operator=(const GapBuffer& rhs);
-    GapBuffer& operator=(GapBuffer&& rhs);
+    GapBuffer& operator=(GapBuffer&& rhs) noexcept;
+    void swap(GapBuffer& other) noexcept;
 
     void insert_at_cursor(const_reference element);
     void insert_at_cursor(value_type&& element);
+    void insert_at_cursor(gap_buffer_bytes::view_of<value_type> elements);
+    template <typename ForwardIt>
+    void insert_at_cursor(ForwardIt first, ForwardIt last);
     template <typename... Args>
     void emplace_at_cursor(Args&&... args); // optional
     void delete_at_cursor();
@@ -47,8 +228,24 @@ public:
     const_reference operator[](size_type pos) const;
     reference at(size_type pos);
     const_reference at(size_type pos) const;
-    void move_cursor(int num);
+    void move_cursor(long long num);
     void reserve(size_type new_size);
+    void apply_edits(std::vector<Edit> edits);
+    value_type* data();
+    const value_type* c_str();
+    std::basic_string_view<value_type> as_string_view();
+    Segments segments() const;
+    size_type find(const value_type& element, size_type from = 0) const;
+    uint64_t content_hash();
+    uint64_t content_hash() const;
+    bool content_hash_cached() const;
+    marker add_marker(size_type pos, MarkerGravity gravity = MarkerGravity::Right);
+    void remove_marker(marker id);
+    size_type marker_position(marker id) const;
+    size_type marker_count() const;
+    void set_gap_policy(GapPolicy policy);
+    GapStats gap_stats() const;
+    size_type capacity() const;
     size_type size() const;
     size_type cursor_index() const;
     bool empty() const;
@@ -61,13 +258,49 @@ public:
 private:
     size_type _logical_size; // uses external_index
     size_type _buffer_size;  // uses array_index
-    size_type _cursor_index; // uses array_index
+    size_type _cursor_index; // uses external_index
+    size_type _gap_index;    // uses array_index, first slot of the gap
     size_type _gap_size;
     std::unique_ptr<value_type[]> _elems; // uses array_index
 
+    // Incremental content hash, sum of hash(elem[i]) * kBase^i, kept split
+    // at the gap so edits there are O(1). Computed on the first non-const
+    // request, then maintained by every edit until a mutable reference is
+    // handed out. Const methods only read it.
+    bool _hash_valid = false;
+    uint64_t _hash_before_gap = 0; // elements [0, _gap_index)
+    uint64_t _hash_after_gap = 0;  // elements after the gap, powers restart at 0
+    uint64_t _gap_power = 1;       // kBase^_gap_index
+
+    MarkerTree _markers; // uses external_index
+
+    // Edit pattern tracking for GapPolicy::Adaptive.
+    struct GapTracker {
+        GapPolicy policy = GapPolicy::Adaptive;
+        size_type burst_end = 0;       // cursor position right after the last insert
+        size_type current_burst = 0;
+        size_type average_burst = 0;
+        size_type average_gap_move = 0;
+        size_type inserts_since_reserve = 0;
+        size_type reallocations = 0;
+        size_type elements_relocated = 0;
+    };
+    GapTracker _gap_tracker;
+
     size_type to_external_index(size_type array_index) const;
     size_type to_array_index(size_type external_index) const;
     void move_to_left_of_buffer(size_type num);
+    void move_gap_to(size_type external_index);
+    void hash_insert_before_gap(const_reference element);
+    void hash_erase_before_gap(const_reference element);
+    static constexpr size_type kFastGrowthLimit = 64 * 1024;
+
+    static size_type initial_size(size_type count, GapPolicy policy);
+    void compute_hash(uint64_t& before_gap, uint64_t& gap_power, uint64_t& after_gap) const;
+    void invalidate_hash();
+    void grow();
+    size_type next_gap_size() const;
+    void track_insert(size_type count = 1);
 };
 
 // Class declaration of the GapBufferIterator class
@@ -115,25 +348,33 @@ GapBuffer<T>::GapBuffer():
     _buffer_size(kDefaultSize),
     _logical_size(0),
     _cursor_index(0),
+    _gap_index(0),
     _gap_size(_buffer_size - _logical_size),
     _elems(std::make_unique<value_type[]>(_buffer_size)){}
 
 template <typename T>
-GapBuffer<T>::GapBuffer(size_type count, const value_type& val):
-    _buffer_size(max(kDefaultSize, 2*_logical_size)),
+GapBuffer<T>::GapBuffer(size_type count, const value_type& val, GapPolicy policy):
     _logical_size(count),
+    _buffer_size(initial_size(count, policy)),
     _cursor_index(count),
+    _gap_index(count),
     _gap_size(_buffer_size - _logical_size),
     _elems(std::make_unique<value_type[]>(_buffer_size)){
+    _gap_tracker.policy = policy;
     std::fill(_elems.get(), _elems.get() + count, val);
 }
 
 template <typename T>
 void GapBuffer<T>::insert_at_cursor(const_reference element) {
     if(_logical_size == _buffer_size) {
-        reserve(2 * _buffer_size);
+        grow();
     }
-    _elems[_cursor_index++] = element;
+    move_gap_to(_cursor_index);
+    _elems[_gap_index] = element;
+    hash_insert_before_gap(_elems[_gap_index++]);
+    _markers.on_insert(_cursor_index, 1);
+    _cursor_index++;
+    track_insert();
     _logical_size++;
     _gap_size--;
 }
@@ -141,7 +382,12 @@ void GapBuffer<T>::insert_at_cursor(const_reference element) {
 template <typename T>
 void GapBuffer<T>::delete_at_cursor() {
     if(_cursor_index != 0) {
+        move_gap_to(_cursor_index);
+        _gap_index--;
+        hash_erase_before_gap(_elems[_gap_index]);
         _cursor_index--;
+        _markers.on_erase(_cursor_index, 1);
+        _gap_tracker.burst_end = _cursor_index; // backspacing continues the burst
         _logical_size--;
         _gap_size++;
     }
@@ -149,11 +395,13 @@ void GapBuffer<T>::delete_at_cursor() {
 
 template <typename T>
 typename GapBuffer<T>::reference GapBuffer<T>::get_at_cursor() {
+    invalidate_hash();
     return const_cast<reference>(static_cast<const GapBuffer<T>*>(this)->get_at_cursor());
 }
 
 template <typename T>
 typename GapBuffer<T>::reference GapBuffer<T>::at(size_type pos) {
+    invalidate_hash();
     return const_cast<reference>(static_cast<const GapBuffer<T>*>(this)->at(pos));
 }
 
@@ -190,6 +438,7 @@ typename GapBuffer<T> ::const_reference GapBuffer<T>::at(size_type pos) const {
 
 template <typename T>
 typename GapBuffer<T>::reference GapBuffer<T>::operator[](size_type pos) {
+    invalidate_hash();
     return const_cast<reference>(static_cast<const GapBuffer<T>*>(this)->operator[](pos));
 }
 
@@ -220,11 +469,36 @@ std::ostream& operator<<(std::ostream& os, const GapBuffer<T>& buf) {
     return os;
 }
 
+// Buffers of different sizes, or with different cached content hashes,
+// are unequal without looking at a single element.
 template <typename T>
 bool operator==(const GapBuffer<T>& lhs, const GapBuffer<T>& rhs) {
-    auto& lhs_nonconst = const_cast<GapBuffer<T>&>(lhs);
-    auto& rhs_nonconst = const_cast<GapBuffer<T>&>(rhs);
-    return std::equal(lhs_nonconst.begin(),lhs_nonconst.end(),rhs_nonconst.begin(),rhs_nonconst.end());
+    if (&lhs == &rhs) {
+        return true;
+    }
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    if constexpr (gap_buffer_hash::is_hashable<T>::value) {
+        if (lhs.content_hash_cached() && rhs.content_hash_cached()
+                && lhs.content_hash() != rhs.content_hash()) {
+            return false;
+        }
+    }
+    auto lhs_segments = lhs.segments();
+    auto rhs_segments = rhs.segments();
+    size_t pos = 0;
+    while (pos < lhs.size()) {
+        size_t lhs_run, rhs_run;
+        auto lhs_elems = gap_buffer_bytes::segment_run(lhs_segments, pos, lhs_run);
+        auto rhs_elems = gap_buffer_bytes::segment_run(rhs_segments, pos, rhs_run);
+        size_t length = std::min(lhs_run, rhs_run);
+        if (!gap_buffer_bytes::equal(lhs_elems, rhs_elems, length)) {
+            return false;
+        }
+        pos += length;
+    }
+    return true;
 }
 
 template <typename T>
@@ -232,18 +506,37 @@ bool operator!=(const GapBuffer<T>& lhs, const GapBuffer<T>& rhs) {
     return !(lhs == rhs);
 }
 
+// Skips equal runs with memcmp where possible, then orders by the first
+// mismatch with T's own operator<, so char keeps its signed ordering.
 template <typename T>
 bool operator<(const GapBuffer<T>& lhs, const GapBuffer<T>& rhs) {
-    auto& lhs_nonconst = const_cast<GapBuffer<T>&>(lhs);
-    auto& rhs_nonconst = const_cast<GapBuffer<T>&>(rhs);
-    return std::lexicographical_compare(lhs_nonconst.begin(),lhs_nonconst.end(),rhs_nonconst.begin(),rhs_nonconst.end());
+    size_t common = std::min(lhs.size(), rhs.size());
+    auto lhs_segments = lhs.segments();
+    auto rhs_segments = rhs.segments();
+    size_t pos = 0;
+    while (pos < common) {
+        size_t lhs_run, rhs_run;
+        auto lhs_elems = gap_buffer_bytes::segment_run(lhs_segments, pos, lhs_run);
+        auto rhs_elems = gap_buffer_bytes::segment_run(rhs_segments, pos, rhs_run);
+        size_t length = std::min({lhs_run, rhs_run, common - pos});
+        if (!gap_buffer_bytes::equal(lhs_elems, rhs_elems, length)) {
+            for (size_t index = 0; index < length; ++index) {
+                if (lhs_elems[index] < rhs_elems[index]) {
+                    return true;
+                }
+                if (rhs_elems[index] < lhs_elems[index]) {
+                    return false;
+                }
+            }
+        }
+        pos += length;
+    }
+    return lhs.size() < rhs.size();
 }
 
 template <typename T>
 bool operator>(const GapBuffer<T>& lhs, const GapBuffer<T>& rhs) {
-    auto& lhs_nonconst = const_cast<GapBuffer<T>&>(lhs);
-    auto& rhs_nonconst = const_cast<GapBuffer<T>&>(rhs);
-    return std::lexicographical_compare(rhs_nonconst.begin(),rhs_nonconst.end(),lhs_nonconst.begin(),lhs_nonconst.end());
+    return rhs < lhs;
 }
 
 template <typename T>
@@ -326,24 +619,42 @@ template <typename T>
 GapBuffer<T>::~GapBuffer() {
 }
 template <typename T>
-GapBuffer<T>::GapBuffer(std::initializer_list<T> init):
-    _buffer_size(max(kDefaultSize,2*_logical_size)),
+GapBuffer<T>::GapBuffer(std::initializer_list<T> init, GapPolicy policy):
     _logical_size(init.size()),
+    _buffer_size(initial_size(init.size(), policy)),
     _cursor_index(init.size()),
+    _gap_index(init.size()),
     _gap_size(_buffer_size - _logical_size),
     _elems(std::make_unique<value_type[]>(_buffer_size)){
+    _gap_tracker.policy = policy;
     std::copy(init.begin(),init.end(),_elems.get());
 }
 
+// Storage for count initial elements: Doubling reserves 2x as it always
+// has, Adaptive has seen no edits yet and leaves a small gap.
+template <typename T>
+typename GapBuffer<T>::size_type GapBuffer<T>::initial_size(size_type count, GapPolicy policy) {
+    if (policy == GapPolicy::Doubling) {
+        return max(kDefaultSize, 2 * count);
+    }
+    return count + kDefaultSize;
+}
+
 template <typename T>
 GapBuffer<T>::GapBuffer(const GapBuffer<T>& other) :
     _buffer_size(other._buffer_size),
     _logical_size(other._logical_size),
     _cursor_index(other._cursor_index),
+    _gap_index(other._gap_index),
     _gap_size(_buffer_size - _logical_size),
-    _elems(std::make_unique<value_type[]>(_buffer_size)){
-    auto& another = const_cast<GapBuffer<T>&>(other);
-    std::copy(another.begin(),another.end(),begin());
+    _elems(std::make_unique<value_type[]>(_buffer_size)),
+    _hash_valid(other._hash_valid),
+    _hash_before_gap(other._hash_before_gap),
+    _hash_after_gap(other._hash_after_gap),
+    _gap_power(other._gap_power),
+    _markers(other._markers),
+    _gap_tracker(other._gap_tracker) {
+    std::copy(other._elems.get(), other._elems.get() + _buffer_size, _elems.get());
 }
 
 template <typename T>
@@ -352,49 +663,139 @@ GapBuffer<T>& GapBuffer<T>::operator=(const GapBuffer& rhs) {
         _buffer_size = rhs._buffer_size;
         _logical_size = rhs._logical_size;
         _cursor_index = rhs._cursor_index;
+        _gap_index = rhs._gap_index;
         _gap_size = _buffer_size - _logical_size;
 
         _elems = std::make_unique<value_type[]>(_buffer_size);
-        auto& rhs_nonconst = const_cast<GapBuffer<T>&>(rhs);
-        std::copy(rhs_nonconst.begin(),rhs_nonconst.end(),begin());
+        std::copy(rhs._elems.get(), rhs._elems.get() + _buffer_size, _elems.get());
+        _hash_valid = rhs._hash_valid;
+        _hash_before_gap = rhs._hash_before_gap;
+        _hash_after_gap = rhs._hash_after_gap;
+        _gap_power = rhs._gap_power;
+        _markers = rhs._markers;
+        _gap_tracker = rhs._gap_tracker;
     }
     return *this;
 }
 
 // Part 7: Move semantics
+// Moves never allocate or touch the elements, so they are noexcept and
+// std::vector<GapBuffer<T>> relocates buffers by moving instead of copying.
+// The moved-from buffer is left empty with no storage; the next insert
+// allocates a fresh array.
 template <typename T>
-GapBuffer<T>::GapBuffer(GapBuffer&& other):
-    _buffer_size(std::move(other._buffer_size)),
-    _logical_size(std::move(other._logical_size)),
-    _cursor_index(std::move(other._cursor_index)),
-    _gap_size(_buffer_size - _logical_size),
-    _elems(std::move(other._elems)) {
-    other._elems = nullptr;
+GapBuffer<T>::GapBuffer(GapBuffer&& other) noexcept:
+    _logical_size(std::exchange(other._logical_size, 0)),
+    _buffer_size(std::exchange(other._buffer_size, 0)),
+    _cursor_index(std::exchange(other._cursor_index, 0)),
+    _gap_index(std::exchange(other._gap_index, 0)),
+    _gap_size(std::exchange(other._gap_size, 0)),
+    _elems(std::move(other._elems)),
+    _hash_valid(other._hash_valid),
+    _hash_before_gap(other._hash_before_gap),
+    _hash_after_gap(other._hash_after_gap),
+    _gap_power(other._gap_power),
+    _markers(std::move(other._markers)),
+    _gap_tracker(std::exchange(other._gap_tracker, GapTracker())) {
+    other._hash_valid = false;
+    other._markers.clear();
 }
 
 template <typename T>
-GapBuffer<T>& GapBuffer<T>::operator=(GapBuffer&& rhs) {
+GapBuffer<T>& GapBuffer<T>::operator=(GapBuffer&& rhs) noexcept {
     if(this != &rhs) {
-        _buffer_size = std::move(rhs._buffer_size);
-        _logical_size = std::move(rhs._logical_size);
-        _cursor_index = std::move(rhs._cursor_index);
-        _gap_size = _buffer_size - _logical_size;
-        _elems = std::move(rhs._elems);
-        rhs._elems = nullptr;
+        GapBuffer<T> stolen(std::move(rhs));
+        swap(stolen);
     }
     return *this;
 }
 
+template <typename T>
+void GapBuffer<T>::swap(GapBuffer& other) noexcept {
+    using std::swap;
+    swap(_logical_size, other._logical_size);
+    swap(_buffer_size, other._buffer_size);
+    swap(_cursor_index, other._cursor_index);
+    swap(_gap_index, other._gap_index);
+    swap(_gap_size, other._gap_size);
+    swap(_elems, other._elems);
+    swap(_hash_valid, other._hash_valid);
+    swap(_hash_before_gap, other._hash_before_gap);
+    swap(_hash_after_gap, other._hash_after_gap);
+    swap(_gap_power, other._gap_power);
+    swap(_markers, other._markers);
+    swap(_gap_tracker, other._gap_tracker);
+}
+
+template <typename T>
+void swap(GapBuffer<T>& lhs, GapBuffer<T>& rhs) noexcept {
+    lhs.swap(rhs);
+}
+
+/*
+ * Trait for containers that relocate elements with a plain memcpy
+ * (moving the bytes and never running the source's destructor).
+ * Trivially copyable types qualify automatically. GapBuffer qualifies too:
+ * besides sizes, counters and the owning pointer to its elements, it holds
+ * a MarkerTree, which is two vectors and node indices (never pointers), and
+ * the plain counters of its GapTracker. Nothing points back into the object
+ * itself, and std::vector is relocatable this way in the standard
+ * libraries we build with.
+ */
+template <typename T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+template <typename T>
+struct is_trivially_relocatable<GapBuffer<T>> : std::true_type {};
+
 template <typename T>
 void GapBuffer<T>::insert_at_cursor(value_type&& element) {
     if(_logical_size == _buffer_size) {
-        reserve(2 * _buffer_size);
+        grow();
     }
-    _elems[_cursor_index++] = std::move(element);
+    move_gap_to(_cursor_index);
+    _elems[_gap_index] = std::move(element);
+    hash_insert_before_gap(_elems[_gap_index++]);
+    _markers.on_insert(_cursor_index, 1);
+    _cursor_index++;
+    track_insert();
     _logical_size++;
     _gap_size--;
 }
 
+/*
+ * Bulk insert: one capacity check, one gap move and one copy for the
+ * whole range, instead of per-element bookkeeping.
+ */
+template <typename T>
+void GapBuffer<T>::insert_at_cursor(gap_buffer_bytes::view_of<value_type> elements) {
+    insert_at_cursor(elements.data(), elements.data() + elements.size());
+}
+
+template <typename T>
+template <typename ForwardIt>
+void GapBuffer<T>::insert_at_cursor(ForwardIt first, ForwardIt last) {
+    size_type count = std::distance(first, last);
+    if (count == 0) return;
+    if (_logical_size + count > _buffer_size) {
+        reserve(_logical_size + count + next_gap_size());
+    }
+    move_gap_to(_cursor_index);
+    std::copy(first, last, _elems.get() + _gap_index);
+    if (_hash_valid) {
+        for (size_type index = 0; index < count; ++index) {
+            hash_insert_before_gap(_elems[_gap_index++]);
+        }
+    } else {
+        _gap_index += count;
+    }
+    _markers.on_insert(_cursor_index, count);
+    _cursor_index += count;
+    track_insert(count);
+    _logical_size += count;
+    _gap_size -= count;
+}
+
 // Part 8: Make your code RAII-compliant - change the code throughout
 
 // optional:
@@ -402,9 +803,14 @@ template <typename T>
 template <typename... Args>
 void GapBuffer<T>::emplace_at_cursor(Args&&... args) {
     if(_logical_size == _buffer_size) {
-        reserve(2 * _buffer_size);
+        grow();
     }
-    _elems[_cursor_index++] = std::move(T(std::forward<Args>(args)...));
+    move_gap_to(_cursor_index);
+    _elems[_gap_index] = std::move(T(std::forward<Args>(args)...));
+    hash_insert_before_gap(_elems[_gap_index++]);
+    _markers.on_insert(_cursor_index, 1);
+    _cursor_index++;
+    track_insert();
     _logical_size++;
     _gap_size--;
 }
@@ -412,65 +818,448 @@ void GapBuffer<T>::emplace_at_cursor(Args&&... args) {
 
 // We've implemented the following functions for you.
 // However...they do use raw pointers, so you might want to turn them into smart pointers!
+//
+// The cursor and the gap are tracked separately: moving the cursor is O(1),
+// and the gap only follows it when the next insert or delete happens there.
+// That lets data() park the gap at the end without losing the cursor.
 template <typename T>
-void GapBuffer<T>::move_cursor(int delta) {
-    int new_index = _cursor_index + delta;
-    if (new_index < 0 || new_index > static_cast<int>(_buffer_size)) {
+void GapBuffer<T>::move_cursor(long long delta) {
+    long long new_index = static_cast<long long>(_cursor_index) + delta;
+    if (new_index < 0 || new_index > static_cast<long long>(_logical_size)) {
         throw std::string("move_cursor: delta moves cursor out of bounds");
     }
-    if (delta > 0) {
-        auto begin_move = _elems.get() + _cursor_index + _gap_size;
-        auto end_move = begin_move + delta;
-        auto destination = _elems.get() + _cursor_index;
-        std::move(begin_move, end_move, destination);
-    } else {
-        auto end_move = _elems.get() + _cursor_index;
-        auto begin_move = end_move + delta;
-        auto* destination = _elems.get() + _cursor_index + _gap_size + delta;
-        std::move(begin_move, end_move, destination);
+    _cursor_index = static_cast<size_type>(new_index);
+}
+
+template <typename T>
+void GapBuffer<T>::move_gap_to(size_type external_index) {
+    if constexpr (gap_buffer_hash::is_hashable<T>::value) {
+        if (_hash_valid) {
+            using namespace gap_buffer_hash;
+            for (size_type index = _gap_index; index < external_index; ++index) {
+                uint64_t element = element_hash(_elems[index + _gap_size]);
+                _hash_before_gap = add(_hash_before_gap, multiply(element, _gap_power));
+                _gap_power = multiply(_gap_power, kBase);
+                _hash_after_gap = multiply(subtract(_hash_after_gap, element), inverse_base());
+            }
+            for (size_type index = _gap_index; index > external_index; --index) {
+                uint64_t element = element_hash(_elems[index - 1]);
+                _gap_power = multiply(_gap_power, inverse_base());
+                _hash_before_gap = subtract(_hash_before_gap, multiply(element, _gap_power));
+                _hash_after_gap = add(multiply(_hash_after_gap, kBase), element);
+            }
+        }
     }
-    _cursor_index += delta;
+    if (external_index != _gap_index) {
+        size_type distance = external_index > _gap_index ? external_index - _gap_index
+                                                         : _gap_index - external_index;
+        _gap_tracker.average_gap_move = (3 * _gap_tracker.average_gap_move + distance) / 4;
+    }
+    if (external_index > _gap_index) {
+        auto begin_move = _elems.get() + _gap_index + _gap_size;
+        auto end_move = begin_move + (external_index - _gap_index);
+        auto destination = _elems.get() + _gap_index;
+        gap_buffer_bytes::move_down(begin_move, end_move, destination);
+    } else if (external_index < _gap_index) {
+        auto end_move = _elems.get() + _gap_index;
+        auto begin_move = _elems.get() + external_index;
+        auto destination = end_move + _gap_size;
+        gap_buffer_bytes::move_up(begin_move, end_move, destination);
+    }
+    _gap_index = external_index;
 }
 
 template <typename T>
 void GapBuffer<T>::reserve(size_type new_size) {
     if (_logical_size >= new_size) return;
     auto new_elems = std::make_unique<T[]>(new_size);
-    std::move(_elems.get(), _elems.get() + _cursor_index, new_elems.get());
+    gap_buffer_bytes::move_down(_elems.get(), _elems.get() + _gap_index, new_elems.get());
     size_t new_gap_size = new_size - _logical_size;
-    std::move(_elems.get() + _buffer_size - _logical_size + _cursor_index,
-              _elems.get() + _buffer_size,
-              new_elems.get() + _cursor_index + new_gap_size);
+    gap_buffer_bytes::move_down(_elems.get() + _gap_index + _gap_size,
+                                _elems.get() + _buffer_size,
+                                new_elems.get() + _gap_index + new_gap_size);
     _buffer_size = new_size;
     _elems = std::move(new_elems);
     _gap_size = new_gap_size;
+    _gap_tracker.reallocations++;
+    _gap_tracker.elements_relocated += _logical_size;
+    _gap_tracker.inserts_since_reserve = 0;
+}
+
+/*
+ * Applies a whole batch of edits in one sweep over the buffer instead of a
+ * move_cursor + insert/delete round trip per edit, which costs O(k*n) when
+ * the edits are spread out. The edits are sorted by position and must not
+ * overlap. At one position, pure inserts go first, in their given order,
+ * followed by at most one edit that erases from there, whichever order
+ * they were passed in.
+ *
+ * The cursor stays next to the same element: edits before it shift it,
+ * and if it sits at an edit's position or inside its erased range it ends
+ * up after the replacement, as after insert_at_cursor.
+ * The result is built directly into a new array with the gap already at
+ * the cursor, so the cost is O(n + total edit size).
+ */
+template <typename T>
+void GapBuffer<T>::apply_edits(std::vector<Edit> edits) {
+    // sort pointers rather than the edits themselves, so large inserts never move
+    std::vector<Edit*> order;
+    order.reserve(edits.size());
+    for (auto& edit : edits) {
+        order.push_back(&edit);
+    }
+    std::stable_sort(order.begin(), order.end(), [](const Edit* a, const Edit* b) {
+        if (a->pos != b->pos) return a->pos < b->pos;
+        return a->erase_count == 0 && b->erase_count > 0;
+    });
+
+    size_type new_logical_size = _logical_size;
+    size_type new_cursor_index = _cursor_index;
+    size_type prev_end = 0;
+    for (const Edit* edit_ptr : order) {
+        const Edit& edit = *edit_ptr;
+        if (edit.pos < prev_end) {
+            throw std::string("apply_edits: edits overlap");
+        }
+        if (edit.pos > _logical_size || edit.erase_count > _logical_size - edit.pos) {
+            throw std::string("apply_edits: edit is out of bounds");
+        }
+        prev_end = edit.pos + edit.erase_count;
+        new_logical_size = new_logical_size - edit.erase_count + edit.insert.size();
+        if (prev_end <= _cursor_index) {
+            new_cursor_index = new_cursor_index - edit.erase_count + edit.insert.size();
+        } else if (edit.pos <= _cursor_index) {
+            new_cursor_index = new_cursor_index - (_cursor_index - edit.pos) + edit.insert.size();
+        }
+    }
+
+    size_type new_buffer_size = new_logical_size + next_gap_size();
+    size_type new_gap_size = new_buffer_size - new_logical_size;
+    auto new_elems = std::make_unique<value_type[]>(new_buffer_size);
+
+    // appends count contiguous elements to the result, split around the new gap
+    size_type written = 0;
+    auto emit = [&](value_type* first, size_type count) {
+        if (written < new_cursor_index) {
+            size_type before_gap = std::min(count, new_cursor_index - written);
+            std::move(first, first + before_gap, new_elems.get() + written);
+            first += before_gap;
+            count -= before_gap;
+            written += before_gap;
+        }
+        std::move(first, first + count, new_elems.get() + written + new_gap_size);
+        written += count;
+    };
+    // appends the old elements [begin, end), split around the old gap
+    auto emit_old = [&](size_type begin, size_type end) {
+        if (begin < _gap_index) {
+            size_type split = std::min(end, _gap_index);
+            emit(_elems.get() + begin, split - begin);
+            begin = split;
+        }
+        if (begin < end) {
+            emit(_elems.get() + begin + _gap_size, end - begin);
+        }
+    };
+
+    size_type read = 0;
+    for (Edit* edit : order) {
+        emit_old(read, edit->pos);
+        read = edit->pos + edit->erase_count;
+        emit(edit->insert.data(), edit->insert.size());
+    }
+    emit_old(read, _logical_size);
+
+    // back to front, so each edit's position is still in pre-batch coordinates
+    for (auto iter = order.rbegin(); iter != order.rend(); ++iter) {
+        _markers.on_erase((*iter)->pos, (*iter)->erase_count);
+        _markers.on_insert((*iter)->pos, (*iter)->insert.size());
+    }
+
+    _logical_size = new_logical_size;
+    _buffer_size = new_buffer_size;
+    _cursor_index = new_cursor_index;
+    _gap_index = new_cursor_index;
+    _gap_size = new_gap_size;
+    _elems = std::move(new_elems);
+    _gap_tracker.reallocations++;
+    _gap_tracker.elements_relocated += new_logical_size;
+    invalidate_hash();
+}
+
+/*
+ * Contiguous access for code that wants a pointer plus a length (regex
+ * engines, parsers, hashers). The gap is moved to the end once; since it
+ * only moves back when the next insert or delete happens, repeated calls
+ * between edits are O(1). The cursor is unaffected.
+ * These are not const: relocating the gap writes to the buffer.
+ */
+template <typename T>
+typename GapBuffer<T>::value_type* GapBuffer<T>::data() {
+    invalidate_hash(); // the caller may write through the pointer
+    move_gap_to(_logical_size);
+    return _elems.get();
+}
+
+template <typename T>
+const typename GapBuffer<T>::value_type* GapBuffer<T>::c_str() {
+    if (_gap_size == 0) {
+        grow();
+    }
+    move_gap_to(_logical_size);
+    _elems[_logical_size] = value_type(); // terminator lives in the gap
+    return _elems.get();
+}
+
+template <typename T>
+std::basic_string_view<typename GapBuffer<T>::value_type> GapBuffer<T>::as_string_view() {
+    move_gap_to(_logical_size);
+    return std::basic_string_view<value_type>(_elems.get(), _logical_size);
+}
+
+/*
+ * Both halves of the contents without moving anything, for read-only scans.
+ */
+template <typename T>
+typename GapBuffer<T>::Segments GapBuffer<T>::segments() const {
+    const value_type* elems = _elems.get();
+    return {elems, _gap_index, elems + _gap_index + _gap_size, _logical_size - _gap_index};
+}
+
+// Position of the first element equal to element at or after from, or npos.
+template <typename T>
+typename GapBuffer<T>::size_type GapBuffer<T>::find(const value_type& element, size_type from) const {
+    Segments halves = segments();
+    if (from < halves.first_size) {
+        auto last = halves.first + halves.first_size;
+        auto found = gap_buffer_bytes::find(halves.first + from, last, element);
+        if (found != last) {
+            return found - halves.first;
+        }
+        from = halves.first_size;
+    }
+    if (from < _logical_size) {
+        auto first = halves.second + (from - halves.first_size);
+        auto last = halves.second + halves.second_size;
+        auto found = gap_buffer_bytes::find(first, last, element);
+        if (found != last) {
+            return halves.first_size + (found - halves.second);
+        }
+    }
+    return npos;
+}
+
+/*
+ * Polynomial hash of the contents. The first call is O(n); after that,
+ * inserts, deletes and gap moves keep it up to date at O(1) per element
+ * touched, so it is free to query again. Handing out a mutable reference
+ * (non-const at, operator[], get_at_cursor, iterators, data) drops the
+ * cached value, since the caller may change an element behind our back.
+ */
+template <typename T>
+uint64_t GapBuffer<T>::content_hash() {
+    if (!_hash_valid) {
+        compute_hash(_hash_before_gap, _gap_power, _hash_after_gap);
+        _hash_valid = true;
+    }
+    return gap_buffer_hash::add(_hash_before_gap, gap_buffer_hash::multiply(_gap_power, _hash_after_gap));
+}
+
+/*
+ * The same hash, without starting to maintain it: if it is not cached, it
+ * is computed in O(n) and thrown away. This never writes to the buffer, so
+ * any number of readers may call it, and operator== and std::hash, concurrently.
+ */
+template <typename T>
+uint64_t GapBuffer<T>::content_hash() const {
+    uint64_t before_gap = _hash_before_gap, gap_power = _gap_power, after_gap = _hash_after_gap;
+    if (!_hash_valid) {
+        compute_hash(before_gap, gap_power, after_gap);
+    }
+    return gap_buffer_hash::add(before_gap, gap_buffer_hash::multiply(gap_power, after_gap));
+}
+
+template <typename T>
+void GapBuffer<T>::compute_hash(uint64_t& before_gap, uint64_t& gap_power, uint64_t& after_gap) const {
+    static_assert(gap_buffer_hash::is_hashable<T>::value,
+                  "content_hash requires std::hash<T>");
+    using namespace gap_buffer_hash;
+    before_gap = 0;
+    gap_power = 1;
+    for (size_type index = 0; index < _gap_index; ++index) {
+        before_gap = add(before_gap, multiply(element_hash(_elems[index]), gap_power));
+        gap_power = multiply(gap_power, kBase);
+    }
+    after_gap = 0;
+    for (size_type index = _buffer_size; index > _gap_index + _gap_size; --index) {
+        after_gap = add(multiply(after_gap, kBase), element_hash(_elems[index - 1]));
+    }
+}
+
+template <typename T>
+bool GapBuffer<T>::content_hash_cached() const {
+    return _hash_valid;
+}
+
+template <typename T>
+void GapBuffer<T>::hash_insert_before_gap(const_reference element) {
+    if constexpr (gap_buffer_hash::is_hashable<T>::value) {
+        if (_hash_valid) {
+            using namespace gap_buffer_hash;
+            _hash_before_gap = add(_hash_before_gap, multiply(element_hash(element), _gap_power));
+            _gap_power = multiply(_gap_power, kBase);
+        }
+    } else {
+        (void) element;
+    }
+}
+
+template <typename T>
+void GapBuffer<T>::hash_erase_before_gap(const_reference element) {
+    if constexpr (gap_buffer_hash::is_hashable<T>::value) {
+        if (_hash_valid) {
+            using namespace gap_buffer_hash;
+            _gap_power = multiply(_gap_power, inverse_base());
+            _hash_before_gap = subtract(_hash_before_gap, multiply(element_hash(element), _gap_power));
+        }
+    } else {
+        (void) element;
+    }
+}
+
+template <typename T>
+void GapBuffer<T>::invalidate_hash() {
+    _hash_valid = false;
+}
+
+/*
+ * Markers are positions (0..size) that follow edits: text inserted or
+ * deleted before a marker shifts it, and a deleted range collapses the
+ * markers inside it to its start. Gravity decides what happens to a
+ * marker exactly at an insertion point. Each edit costs O(log m) in the
+ * number of markers, so hundreds of thousands of them are cheap to keep.
+ */
+template <typename T>
+typename GapBuffer<T>::marker GapBuffer<T>::add_marker(size_type pos, MarkerGravity gravity) {
+    if (pos > _logical_size) {
+        throw std::string("add_marker: pos is out of bounds");
+    }
+    return _markers.add(pos, gravity);
+}
+
+template <typename T>
+void GapBuffer<T>::remove_marker(marker id) {
+    _markers.remove(id);
+}
+
+template <typename T>
+typename GapBuffer<T>::size_type GapBuffer<T>::marker_position(marker id) const {
+    return _markers.position(id);
+}
+
+template <typename T>
+typename GapBuffer<T>::size_type GapBuffer<T>::marker_count() const {
+    return _markers.size();
+}
+
+/*
+ * Gap sizing. Doubling reproduces the classic 2x reserve. Adaptive sizes
+ * the gap for the edits we expect next:
+ *  - twice the longest recent insertion burst, and twice the number of
+ *    inserts that filled the previous gap, so a buffer that keeps being
+ *    edited grows its gap geometrically;
+ *  - but never more than the buffer size, the gap doubling would leave,
+ *    so Adaptive never carries more slack than Doubling;
+ *  - except that while a buffer is below kFastGrowthLimit and a steady
+ *    stream of edits stays in one place (typing, streaming appends), the
+ *    gap may reach twice the buffer size. That skips the cheap early
+ *    reallocations for a bounded amount of slack;
+ *  - and as little as kDefaultSize for buffers that are rarely edited, or
+ *    only touched in scattered spots.
+ */
+template <typename T>
+typename GapBuffer<T>::size_type GapBuffer<T>::next_gap_size() const {
+    if (_gap_tracker.policy == GapPolicy::Doubling) {
+        return max(kDefaultSize, _logical_size);
+    }
+    size_type expected_burst = max(_gap_tracker.current_burst, _gap_tracker.average_burst);
+    size_type target = 2 * max(expected_burst, _gap_tracker.inserts_since_reserve);
+    bool steady = _gap_tracker.inserts_since_reserve >= kDefaultSize;
+    bool local = _gap_tracker.average_gap_move <= expected_burst;
+    size_type limit = _logical_size;
+    if (steady && local && _logical_size < kFastGrowthLimit) {
+        limit = 2 * _logical_size;
+    }
+    return max(kDefaultSize, std::min(target, limit));
+}
+
+template <typename T>
+void GapBuffer<T>::grow() {
+    reserve(_logical_size + next_gap_size());
+}
+
+template <typename T>
+void GapBuffer<T>::track_insert(size_type count) {
+    // called after the cursor has moved past the new elements
+    if (_cursor_index - count != _gap_tracker.burst_end) {
+        if (_gap_tracker.current_burst > 0) {
+            _gap_tracker.average_burst = (3 * _gap_tracker.average_burst + _gap_tracker.current_burst) / 4;
+        }
+        _gap_tracker.current_burst = 0;
+    } else {
+        // an insert where the last one ended moved the gap by 0
+        _gap_tracker.average_gap_move = 3 * _gap_tracker.average_gap_move / 4;
+    }
+    _gap_tracker.current_burst += count;
+    _gap_tracker.burst_end = _cursor_index;
+    _gap_tracker.inserts_since_reserve += count;
+}
+
+template <typename T>
+void GapBuffer<T>::set_gap_policy(GapPolicy policy) {
+    _gap_tracker.policy = policy;
+}
+
+template <typename T>
+typename GapBuffer<T>::GapStats GapBuffer<T>::gap_stats() const {
+    return {_buffer_size, _gap_size, _gap_tracker.reallocations, _gap_tracker.elements_relocated,
+            _gap_tracker.current_burst, _gap_tracker.average_burst, _gap_tracker.average_gap_move};
+}
+
+template <typename T>
+typename GapBuffer<T>::size_type GapBuffer<T>::capacity() const {
+    return _buffer_size;
 }
 
 template <typename T>
 void GapBuffer<T>::debug() const {
     std::cout << "[";
+    size_t cursor_array_index = to_array_index(_cursor_index);
+    if (_cursor_index == _gap_index) {
+        cursor_array_index = _gap_index;
+    }
     for (size_t i = 0; i < _buffer_size; ++i) {
-        if (i == _cursor_index) {
+        if (i == cursor_array_index) {
             std::cout << "|";
         } else {
             std::cout << " ";
         }
-        if (i >= _cursor_index && i < _cursor_index + _gap_size) {
+        if (i >= _gap_index && i < _gap_index + _gap_size) {
             std::cout << "*";
         } else {
             std::cout << _elems[i];
         }
     }
-    std::cout << (_cursor_index == _buffer_size ? "|" : " ");
+    std::cout << (cursor_array_index == _buffer_size ? "|" : " ");
     std::cout << "]" << std::endl;
 }
 
 template <typename T>
 typename GapBuffer<T>::size_type GapBuffer<T>::to_external_index(size_type array_index) const {
-    if (array_index < _cursor_index) {
+    if (array_index < _gap_index) {
         return array_index;
-    } else if (array_index >= _cursor_index + _gap_size){
-        return array_index - _cursor_index;
+    } else if (array_index >= _gap_index + _gap_size){
+        return array_index - _gap_size;
     } else {
         throw ("to_external_index: array_index is out of bounds!");
     }
@@ -478,12 +1267,20 @@ typename GapBuffer<T>::size_type GapBuffer<T>::to_external_index(size_type array
 
 template <typename T>
 typename GapBuffer<T>::size_type GapBuffer<T>::to_array_index(size_type external_index) const {
-    if (external_index < _cursor_index) {
+    if (external_index < _gap_index) {
         return external_index;
     } else {
         return external_index + _gap_size;
     }
 }
 
+namespace std {
+template <typename T>
+struct hash<GapBuffer<T>> {
+    size_t operator()(const GapBuffer<T>& buf) const {
+        return static_cast<size_t>(buf.content_hash() ^ (buf.size() * 0x9e3779b97f4a7c15ull));
+    }
+};
+} // namespace std
 
 #endif // GAPBUFFER_H
@@ -0,0 +1,298 @@
+#ifndef GAPBUFFERSOA_H
+#define GAPBUFFERSOA_H
+#include <algorithm>
+#include <memory> // for unique_ptr
+#include <string> // for exceptions
+#include <tuple>
+#include <utility>
+#include "GapBuffer.h" // for kDefaultSize
+
+/*
+ * Structure-of-arrays gap buffer: one gap-managed array per field, all
+ * sharing a single cursor and gap. GapBufferSoA<char, uint16_t, uint8_t>
+ * stores a character, a style run id and a flags byte per position, but a
+ * scan over the characters only touches the char array, which stays dense
+ * (and vectorizable) instead of striding over the attribute bytes.
+ *
+ * Like GapBuffer, the cursor moves in O(1) and the gap only follows it on
+ * the next insert or delete.
+ */
+template <typename... Ts>
+class GapBufferSoA {
+public:
+    static_assert(sizeof...(Ts) > 0, "GapBufferSoA needs at least one column");
+
+    using size_type = size_t;
+    using row_type = std::tuple<Ts...>;
+    template <size_t I>
+    using column_type = std::tuple_element_t<I, row_type>;
+
+    // One column split around the gap: [first, first + first_size) followed
+    // by [second, second + second_size). Both halves are contiguous.
+    template <size_t I>
+    struct ColumnView {
+        const column_type<I>* first;
+        size_type first_size;
+        const column_type<I>* second;
+        size_type second_size;
+    };
+
+    explicit GapBufferSoA();
+    GapBufferSoA(const GapBufferSoA& other);
+    GapBufferSoA(GapBufferSoA&& other) noexcept;
+    GapBufferSoA& operator=(const GapBufferSoA& rhs);
+    GapBufferSoA& operator=(GapBufferSoA&& rhs) noexcept;
+    void swap(GapBufferSoA& other) noexcept;
+
+    void insert_at_cursor(const Ts&... fields);
+    void delete_at_cursor();
+    void move_cursor(int delta);
+    void reserve(size_type new_size);
+    size_type size() const;
+    size_type cursor_index() const;
+    bool empty() const;
+
+    template <size_t I>
+    column_type<I>& at(size_type pos);
+    template <size_t I>
+    const column_type<I>& at(size_type pos) const;
+    row_type row(size_type pos) const;
+
+    template <size_t I>
+    ColumnView<I> column() const;
+    template <size_t I>
+    const column_type<I>* column_data();
+
+private:
+    size_type _logical_size; // uses external_index
+    size_type _buffer_size;  // uses array_index
+    size_type _cursor_index; // uses external_index
+    size_type _gap_index;    // uses array_index, first slot of the gap
+    size_type _gap_size;
+    std::tuple<std::unique_ptr<Ts[]>...> _columns; // uses array_index
+
+    size_type to_array_index(size_type external_index) const;
+    void move_gap_to(size_type external_index);
+    template <typename F>
+    void for_each_column(F f);
+    template <size_t... Is>
+    void store_at_gap(std::index_sequence<Is...>, const Ts&... fields);
+};
+
+template <typename... Ts>
+GapBufferSoA<Ts...>::GapBufferSoA():
+    _logical_size(0),
+    _buffer_size(kDefaultSize),
+    _cursor_index(0),
+    _gap_index(0),
+    _gap_size(kDefaultSize),
+    _columns(std::make_unique<Ts[]>(kDefaultSize)...) {}
+
+template <typename... Ts>
+GapBufferSoA<Ts...>::GapBufferSoA(const GapBufferSoA& other):
+    _logical_size(other._logical_size),
+    _buffer_size(other._buffer_size),
+    _cursor_index(other._cursor_index),
+    _gap_index(other._gap_index),
+    _gap_size(other._gap_size),
+    _columns(std::make_unique<Ts[]>(other._buffer_size)...) {
+    std::apply([&](auto&... columns) {
+        std::apply([&](const auto&... other_columns) {
+            (std::copy(other_columns.get(), other_columns.get() + _buffer_size, columns.get()), ...);
+        }, other._columns);
+    }, _columns);
+}
+
+template <typename... Ts>
+GapBufferSoA<Ts...>::GapBufferSoA(GapBufferSoA&& other) noexcept:
+    _logical_size(std::exchange(other._logical_size, 0)),
+    _buffer_size(std::exchange(other._buffer_size, 0)),
+    _cursor_index(std::exchange(other._cursor_index, 0)),
+    _gap_index(std::exchange(other._gap_index, 0)),
+    _gap_size(std::exchange(other._gap_size, 0)),
+    _columns(std::move(other._columns)) {}
+
+template <typename... Ts>
+GapBufferSoA<Ts...>& GapBufferSoA<Ts...>::operator=(const GapBufferSoA& rhs) {
+    if (this != &rhs) {
+        GapBufferSoA copy(rhs);
+        swap(copy);
+    }
+    return *this;
+}
+
+template <typename... Ts>
+GapBufferSoA<Ts...>& GapBufferSoA<Ts...>::operator=(GapBufferSoA&& rhs) noexcept {
+    if (this != &rhs) {
+        GapBufferSoA stolen(std::move(rhs));
+        swap(stolen);
+    }
+    return *this;
+}
+
+template <typename... Ts>
+void GapBufferSoA<Ts...>::swap(GapBufferSoA& other) noexcept {
+    using std::swap;
+    swap(_logical_size, other._logical_size);
+    swap(_buffer_size, other._buffer_size);
+    swap(_cursor_index, other._cursor_index);
+    swap(_gap_index, other._gap_index);
+    swap(_gap_size, other._gap_size);
+    swap(_columns, other._columns);
+}
+
+template <typename... Ts>
+void GapBufferSoA<Ts...>::insert_at_cursor(const Ts&... fields) {
+    if (_logical_size == _buffer_size) {
+        reserve(std::max(kDefaultSize, 2 * _buffer_size));
+    }
+    move_gap_to(_cursor_index);
+    store_at_gap(std::index_sequence_for<Ts...>{}, fields...);
+    _gap_index++;
+    _cursor_index++;
+    _logical_size++;
+    _gap_size--;
+}
+
+template <typename... Ts>
+void GapBufferSoA<Ts...>::delete_at_cursor() {
+    if (_cursor_index != 0) {
+        move_gap_to(_cursor_index);
+        _gap_index--;
+        _cursor_index--;
+        _logical_size--;
+        _gap_size++;
+    }
+}
+
+template <typename... Ts>
+void GapBufferSoA<Ts...>::move_cursor(int delta) {
+    int new_index = _cursor_index + delta;
+    if (new_index < 0 || new_index > static_cast<int>(_logical_size)) {
+        throw std::string("move_cursor: delta moves cursor out of bounds");
+    }
+    _cursor_index = new_index;
+}
+
+template <typename... Ts>
+void GapBufferSoA<Ts...>::reserve(size_type new_size) {
+    if (_logical_size >= new_size) return;
+    size_type new_gap_size = new_size - _logical_size;
+    for_each_column([&](auto& column) {
+        using element_type = std::remove_reference_t<decltype(column[0])>;
+        auto new_column = std::make_unique<element_type[]>(new_size);
+        std::move(column.get(), column.get() + _gap_index, new_column.get());
+        std::move(column.get() + _gap_index + _gap_size, column.get() + _buffer_size,
+                  new_column.get() + _gap_index + new_gap_size);
+        column = std::move(new_column);
+    });
+    _buffer_size = new_size;
+    _gap_size = new_gap_size;
+}
+
+template <typename... Ts>
+typename GapBufferSoA<Ts...>::size_type GapBufferSoA<Ts...>::size() const {
+    return _logical_size;
+}
+
+template <typename... Ts>
+typename GapBufferSoA<Ts...>::size_type GapBufferSoA<Ts...>::cursor_index() const {
+    return _cursor_index;
+}
+
+template <typename... Ts>
+bool GapBufferSoA<Ts...>::empty() const {
+    return _logical_size == 0;
+}
+
+template <typename... Ts>
+template <size_t I>
+typename GapBufferSoA<Ts...>::template column_type<I>& GapBufferSoA<Ts...>::at(size_type pos) {
+    return const_cast<column_type<I>&>(static_cast<const GapBufferSoA*>(this)->template at<I>(pos));
+}
+
+template <typename... Ts>
+template <size_t I>
+const typename GapBufferSoA<Ts...>::template column_type<I>& GapBufferSoA<Ts...>::at(size_type pos) const {
+    if (pos >= _logical_size) {
+        throw ("at: pos is out of bounds!");
+    }
+    return std::get<I>(_columns)[to_array_index(pos)];
+}
+
+template <typename... Ts>
+typename GapBufferSoA<Ts...>::row_type GapBufferSoA<Ts...>::row(size_type pos) const {
+    if (pos >= _logical_size) {
+        throw ("row: pos is out of bounds!");
+    }
+    size_type array_index = to_array_index(pos);
+    return std::apply([&](const auto&... columns) {
+        return row_type(columns[array_index]...);
+    }, _columns);
+}
+
+/*
+ * Both halves of column I without moving anything, for read-only scans.
+ */
+template <typename... Ts>
+template <size_t I>
+typename GapBufferSoA<Ts...>::template ColumnView<I> GapBufferSoA<Ts...>::column() const {
+    const column_type<I>* elems = std::get<I>(_columns).get();
+    return {elems, _gap_index,
+            elems + _gap_index + _gap_size, _logical_size - _gap_index};
+}
+
+/*
+ * Column I as one contiguous array of size() elements. Moves the gap to
+ * the end of every column, where it stays until the next edit.
+ */
+template <typename... Ts>
+template <size_t I>
+const typename GapBufferSoA<Ts...>::template column_type<I>* GapBufferSoA<Ts...>::column_data() {
+    move_gap_to(_logical_size);
+    return std::get<I>(_columns).get();
+}
+
+template <typename... Ts>
+typename GapBufferSoA<Ts...>::size_type GapBufferSoA<Ts...>::to_array_index(size_type external_index) const {
+    if (external_index < _gap_index) {
+        return external_index;
+    } else {
+        return external_index + _gap_size;
+    }
+}
+
+template <typename... Ts>
+void GapBufferSoA<Ts...>::move_gap_to(size_type external_index) {
+    if (external_index == _gap_index) return;
+    for_each_column([&](auto& column) {
+        auto elems = column.get();
+        if (external_index > _gap_index) {
+            std::move(elems + _gap_index + _gap_size, elems + external_index + _gap_size,
+                      elems + _gap_index);
+        } else {
+            std::move_backward(elems + external_index, elems + _gap_index,
+                               elems + _gap_index + _gap_size);
+        }
+    });
+    _gap_index = external_index;
+}
+
+template <typename... Ts>
+template <typename F>
+void GapBufferSoA<Ts...>::for_each_column(F f) {
+    std::apply([&](auto&... columns) { (f(columns), ...); }, _columns);
+}
+
+template <typename... Ts>
+template <size_t... Is>
+void GapBufferSoA<Ts...>::store_at_gap(std::index_sequence<Is...>, const Ts&... fields) {
+    ((std::get<Is>(_columns)[_gap_index] = fields), ...);
+}
+
+template <typename... Ts>
+void swap(GapBufferSoA<Ts...>& lhs, GapBufferSoA<Ts...>& rhs) noexcept {
+    lhs.swap(rhs);
+}
+
+#endif // GAPBUFFERSOA_H
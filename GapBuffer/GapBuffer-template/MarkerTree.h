@@ -0,0 +1,270 @@
+#ifndef MARKERTREE_H
+#define MARKERTREE_H
+#include <cstdint> // for uint32_t
+#include <string> // for exceptions
+#include <utility> // for pair
+#include <vector>
+
+// Which way a marker moves when text is inserted exactly at its position.
+// Left stays before the new text (a bookmark), Right moves after it
+// (a cursor).
+enum class MarkerGravity { Left, Right };
+
+/*
+ * Positions that follow edits, for bookmarks, diagnostic ranges, search
+ * hits and secondary cursors. Markers sit between elements, so valid
+ * positions are 0..size.
+ *
+ * Each gravity has its own treap ordered by position. An edit only
+ * shifts or collapses a contiguous key range. That range is split off
+ * and tagged lazily, so every edit is O(log n) no matter how many
+ * markers move. Nodes keep parent pointers, so a marker's position can be
+ * read by walking up and applying the pending tags of its ancestors.
+ */
+class MarkerTree {
+public:
+    using size_type = size_t;
+    using marker_id = size_t;
+
+    MarkerTree();
+
+    marker_id add(size_type pos, MarkerGravity gravity);
+    void remove(marker_id id);
+    size_type position(marker_id id) const;
+    size_type size() const;
+    bool empty() const;
+    void clear();
+
+    // count elements were inserted before position pos
+    void on_insert(size_type pos, size_type count);
+    // elements [pos, pos + count) were erased
+    void on_erase(size_type pos, size_type count);
+
+private:
+    static constexpr size_t kNil = static_cast<size_t>(-1);
+
+    // Pending update for a subtree: first (optionally) set every position
+    // to assign_value, then add delta. The node's own pos is already updated.
+    struct Node {
+        size_type pos;
+        uint32_t priority;
+        MarkerGravity gravity;
+        bool in_use;
+        size_t left;
+        size_t right;
+        size_t parent;
+        bool assign;
+        size_type assign_value;
+        ptrdiff_t delta;
+    };
+
+    std::vector<Node> _nodes;
+    std::vector<size_t> _free;
+    size_t _roots[2];
+    size_type _count;
+    uint32_t _seed;
+
+    size_t& root(MarkerGravity gravity);
+    uint32_t next_priority();
+    void apply_assign(size_t node, size_type value);
+    void apply_delta(size_t node, ptrdiff_t delta);
+    void push_down(size_t node);
+    void set_left(size_t node, size_t child);
+    void set_right(size_t node, size_t child);
+    std::pair<size_t, size_t> split(size_t node, size_type key);
+    size_t merge(size_t lhs, size_t rhs);
+    void shift_from(MarkerGravity gravity, size_type key, ptrdiff_t delta);
+    void check_id(marker_id id) const;
+};
+
+inline MarkerTree::MarkerTree():
+    _roots{kNil, kNil},
+    _count(0),
+    _seed(2463534242u) {}
+
+inline size_t& MarkerTree::root(MarkerGravity gravity) {
+    return _roots[gravity == MarkerGravity::Left ? 0 : 1];
+}
+
+inline uint32_t MarkerTree::next_priority() {
+    // xorshift32
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return _seed;
+}
+
+inline typename MarkerTree::marker_id MarkerTree::add(size_type pos, MarkerGravity gravity) {
+    size_t node;
+    if (_free.empty()) {
+        node = _nodes.size();
+        _nodes.push_back(Node());
+    } else {
+        node = _free.back();
+        _free.pop_back();
+    }
+    _nodes[node] = Node{pos, next_priority(), gravity, true, kNil, kNil, kNil, false, 0, 0};
+    size_t& tree = root(gravity);
+    auto parts = split(tree, pos);
+    tree = merge(merge(parts.first, node), parts.second);
+    _nodes[tree].parent = kNil;
+    ++_count;
+    return node;
+}
+
+inline void MarkerTree::remove(marker_id id) {
+    check_id(id);
+    // push pending tags down the path so the children hold real positions
+    std::vector<size_t> path;
+    for (size_t node = id; node != kNil; node = _nodes[node].parent) {
+        path.push_back(node);
+    }
+    for (auto iter = path.rbegin(); iter != path.rend(); ++iter) {
+        push_down(*iter);
+    }
+
+    Node& removed = _nodes[id];
+    size_t replacement = merge(removed.left, removed.right);
+    size_t parent = removed.parent;
+    if (parent == kNil) {
+        root(removed.gravity) = replacement;
+        if (replacement != kNil) _nodes[replacement].parent = kNil;
+    } else if (_nodes[parent].left == id) {
+        set_left(parent, replacement);
+    } else {
+        set_right(parent, replacement);
+    }
+    removed.in_use = false;
+    _free.push_back(id);
+    --_count;
+}
+
+inline typename MarkerTree::size_type MarkerTree::position(marker_id id) const {
+    check_id(id);
+    size_type pos = _nodes[id].pos;
+    // the nearest ancestor's tag was pushed onto us most recently, so apply upward
+    for (size_t node = _nodes[id].parent; node != kNil; node = _nodes[node].parent) {
+        const Node& ancestor = _nodes[node];
+        if (ancestor.assign) pos = ancestor.assign_value;
+        pos += ancestor.delta;
+    }
+    return pos;
+}
+
+inline typename MarkerTree::size_type MarkerTree::size() const {
+    return _count;
+}
+
+inline bool MarkerTree::empty() const {
+    return _count == 0;
+}
+
+inline void MarkerTree::clear() {
+    _nodes.clear();
+    _free.clear();
+    _roots[0] = _roots[1] = kNil;
+    _count = 0;
+}
+
+inline void MarkerTree::on_insert(size_type pos, size_type count) {
+    if (empty() || count == 0) return;
+    shift_from(MarkerGravity::Left, pos + 1, static_cast<ptrdiff_t>(count));
+    shift_from(MarkerGravity::Right, pos, static_cast<ptrdiff_t>(count));
+}
+
+inline void MarkerTree::on_erase(size_type pos, size_type count) {
+    if (empty() || count == 0) return;
+    for (size_t& tree : _roots) {
+        auto before = split(tree, pos);
+        auto inside = split(before.second, pos + count + 1);
+        if (inside.first != kNil) apply_assign(inside.first, pos);
+        if (inside.second != kNil) apply_delta(inside.second, -static_cast<ptrdiff_t>(count));
+        tree = merge(before.first, merge(inside.first, inside.second));
+        if (tree != kNil) _nodes[tree].parent = kNil;
+    }
+}
+
+inline void MarkerTree::apply_assign(size_t node, size_type value) {
+    Node& target = _nodes[node];
+    target.pos = value;
+    target.assign = true;
+    target.assign_value = value;
+    target.delta = 0;
+}
+
+inline void MarkerTree::apply_delta(size_t node, ptrdiff_t delta) {
+    Node& target = _nodes[node];
+    target.pos += delta;
+    target.delta += delta;
+}
+
+inline void MarkerTree::push_down(size_t node) {
+    Node& target = _nodes[node];
+    for (size_t child : {target.left, target.right}) {
+        if (child == kNil) continue;
+        if (target.assign) apply_assign(child, target.assign_value);
+        if (target.delta != 0) apply_delta(child, target.delta);
+    }
+    target.assign = false;
+    target.delta = 0;
+}
+
+inline void MarkerTree::set_left(size_t node, size_t child) {
+    _nodes[node].left = child;
+    if (child != kNil) _nodes[child].parent = node;
+}
+
+inline void MarkerTree::set_right(size_t node, size_t child) {
+    _nodes[node].right = child;
+    if (child != kNil) _nodes[child].parent = node;
+}
+
+// Splits into (positions < key, positions >= key).
+inline std::pair<size_t, size_t> MarkerTree::split(size_t node, size_type key) {
+    if (node == kNil) return {kNil, kNil};
+    push_down(node);
+    if (_nodes[node].pos < key) {
+        auto parts = split(_nodes[node].right, key);
+        set_right(node, parts.first);
+        if (parts.second != kNil) _nodes[parts.second].parent = kNil;
+        _nodes[node].parent = kNil;
+        return {node, parts.second};
+    } else {
+        auto parts = split(_nodes[node].left, key);
+        set_left(node, parts.second);
+        if (parts.first != kNil) _nodes[parts.first].parent = kNil;
+        _nodes[node].parent = kNil;
+        return {parts.first, node};
+    }
+}
+
+// Every position in lhs must be <= every position in rhs.
+inline size_t MarkerTree::merge(size_t lhs, size_t rhs) {
+    if (lhs == kNil) return rhs;
+    if (rhs == kNil) return lhs;
+    if (_nodes[lhs].priority > _nodes[rhs].priority) {
+        push_down(lhs);
+        set_right(lhs, merge(_nodes[lhs].right, rhs));
+        return lhs;
+    } else {
+        push_down(rhs);
+        set_left(rhs, merge(lhs, _nodes[rhs].left));
+        return rhs;
+    }
+}
+
+inline void MarkerTree::shift_from(MarkerGravity gravity, size_type key, ptrdiff_t delta) {
+    size_t& tree = root(gravity);
+    auto parts = split(tree, key);
+    if (parts.second != kNil) apply_delta(parts.second, delta);
+    tree = merge(parts.first, parts.second);
+    if (tree != kNil) _nodes[tree].parent = kNil;
+}
+
+inline void MarkerTree::check_id(marker_id id) const {
+    if (id >= _nodes.size() || !_nodes[id].in_use) {
+        throw std::string("marker: id does not name a live marker");
+    }
+}
+
+#endif // MARKERTREE_H
@@ -0,0 +1,433 @@
+#ifndef SHAREDGAPBUFFER_H
+#define SHAREDGAPBUFFER_H
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string> // for names and exceptions
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>    // for O_* constants
+#include <sys/mman.h> // for shm_open, mmap
+#include <unistd.h>   // for ftruncate, close
+#include "GapBuffer.h" // for kDefaultSize
+
+/*
+ * A gap buffer whose storage lives in a POSIX shared-memory segment, so a
+ * renderer or tooling process can map it and read the text in place
+ * instead of having it serialized over a pipe.
+ *
+ * Segment layout (all positions are element offsets, never pointers, so
+ * every process can map the segment at a different address):
+ *
+ *   [ SharedGapHeader | elements[0, capacity) ]
+ *
+ * The elements are laid out like GapBuffer's: [0, gap_index) is the text
+ * before the gap and [gap_index + gap_size, capacity) the text after it.
+ *
+ * One process owns the segment and is the only writer (SharedGapBuffer).
+ * Any number of processes attach with SharedGapReader. Readers take no
+ * locks: the header holds a sequence counter that the writer makes odd
+ * while it edits and even again afterwards. A reader reads the two
+ * segments in place and retries if the counter moved (a seqlock).
+ *
+ * The segment only ever grows. A reader that sees a larger capacity than
+ * it mapped simply maps the segment again; its old mapping stays valid
+ * until then.
+ */
+
+// Layout of the first bytes of the segment. Bump kSharedGapVersion
+// whenever this changes.
+struct SharedGapHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t element_size;
+    std::atomic<uint64_t> sequence;  // odd while the writer is editing
+    std::atomic<uint64_t> capacity;  // in elements
+    std::atomic<uint64_t> logical_size;
+    std::atomic<uint64_t> gap_index; // element offset of the first gap slot
+    std::atomic<uint64_t> gap_size;
+};
+
+const uint32_t kSharedGapMagic = 0x42504147; // "GAPB"
+const uint32_t kSharedGapVersion = 1;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the shared header needs address-free atomics");
+
+// Elements start at the first multiple of alignof(T) past the header.
+template <typename T>
+constexpr size_t shared_gap_data_offset() {
+    return (sizeof(SharedGapHeader) + alignof(T) - 1) / alignof(T) * alignof(T);
+}
+
+template <typename T>
+class SharedGapBuffer {
+public:
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "shared elements are copied bytewise between processes");
+
+    using value_type = T;
+    using size_type = size_t;
+
+    // Creates the segment /name (replacing a stale one) and owns it.
+    explicit SharedGapBuffer(const std::string& name, size_type capacity = kDefaultSize);
+    ~SharedGapBuffer();
+    SharedGapBuffer(const SharedGapBuffer&) = delete;
+    SharedGapBuffer& operator=(const SharedGapBuffer&) = delete;
+
+    void insert_at_cursor(const value_type& element);
+    void delete_at_cursor();
+    void move_cursor(int delta);
+    void reserve(size_type new_size);
+    const value_type& at(size_type pos) const;
+    size_type size() const;
+    size_type cursor_index() const;
+    bool empty() const;
+    const std::string& name() const;
+
+private:
+    std::string _name;
+    int _fd;
+    SharedGapHeader* _header;
+    value_type* _elems;      // uses array_index
+    size_type _cursor_index; // uses external_index, private to the writer
+
+    void map(size_type capacity);
+    void begin_write();
+    void end_write();
+    void move_gap_to(size_type external_index);
+};
+
+/*
+ * Read-only view of a segment owned by another process (or thread).
+ * Reads never block the writer and never copy unless asked to.
+ */
+template <typename T>
+class SharedGapReader {
+public:
+    using value_type = T;
+    using size_type = size_t;
+
+    explicit SharedGapReader(const std::string& name);
+    ~SharedGapReader();
+    SharedGapReader(const SharedGapReader&) = delete;
+    SharedGapReader& operator=(const SharedGapReader&) = delete;
+
+    /*
+     * Calls visit(first, first_size, second, second_size) on the two
+     * segments in place and returns its result. If the writer changed the
+     * buffer meanwhile, the result is discarded and visit runs again, so
+     * visit must tolerate torn data and have no side effects it cannot
+     * repeat (count, hash, search, or copy into a local).
+     */
+    template <typename Visitor>
+    auto read(Visitor visit);
+
+    // Even numbers only; changes whenever the contents change.
+    uint64_t generation() const;
+    size_type size();
+    value_type at(size_type pos);
+    std::vector<value_type> copy();
+
+private:
+    std::string _name;
+    int _fd;
+    SharedGapHeader* _header;
+    size_type _mapped_capacity;
+
+    void map(size_type capacity);
+};
+
+template <typename T>
+SharedGapBuffer<T>::SharedGapBuffer(const std::string& name, size_type capacity):
+    _name(name),
+    _fd(-1),
+    _header(nullptr),
+    _elems(nullptr),
+    _cursor_index(0) {
+    shm_unlink(_name.c_str());
+    _fd = shm_open(_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (_fd < 0) {
+        throw std::string("SharedGapBuffer: cannot create segment ") + _name;
+    }
+    capacity = std::max(capacity, kDefaultSize);
+    map(capacity);
+    _header->magic = kSharedGapMagic;
+    _header->version = kSharedGapVersion;
+    _header->header_size = shared_gap_data_offset<T>();
+    _header->element_size = sizeof(T);
+    _header->sequence.store(0, std::memory_order_relaxed);
+    _header->capacity.store(capacity, std::memory_order_relaxed);
+    _header->logical_size.store(0, std::memory_order_relaxed);
+    _header->gap_index.store(0, std::memory_order_relaxed);
+    _header->gap_size.store(capacity, std::memory_order_release);
+}
+
+template <typename T>
+SharedGapBuffer<T>::~SharedGapBuffer() {
+    if (_header != nullptr) {
+        munmap(_header, shared_gap_data_offset<T>() + _header->capacity.load() * sizeof(T));
+    }
+    if (_fd >= 0) {
+        close(_fd);
+    }
+    shm_unlink(_name.c_str());
+}
+
+template <typename T>
+void SharedGapBuffer<T>::map(size_type capacity) {
+    size_type bytes = shared_gap_data_offset<T>() + capacity * sizeof(T);
+    if (ftruncate(_fd, bytes) != 0) {
+        throw std::string("SharedGapBuffer: cannot size segment ") + _name;
+    }
+    void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::string("SharedGapBuffer: cannot map segment ") + _name;
+    }
+    if (_header != nullptr) {
+        munmap(_header, shared_gap_data_offset<T>() + _header->capacity.load() * sizeof(T));
+    }
+    _header = static_cast<SharedGapHeader*>(mapping);
+    _elems = reinterpret_cast<value_type*>(static_cast<char*>(mapping) + shared_gap_data_offset<T>());
+}
+
+template <typename T>
+void SharedGapBuffer<T>::begin_write() {
+    _header->sequence.store(_header->sequence.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+template <typename T>
+void SharedGapBuffer<T>::end_write() {
+    _header->sequence.store(_header->sequence.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_release);
+}
+
+template <typename T>
+void SharedGapBuffer<T>::insert_at_cursor(const value_type& element) {
+    if (size() == _header->capacity.load(std::memory_order_relaxed)) {
+        reserve(std::max(kDefaultSize, 2 * size()));
+    }
+    begin_write();
+    move_gap_to(_cursor_index);
+    size_type gap_index = _header->gap_index.load(std::memory_order_relaxed);
+    _elems[gap_index] = element;
+    _header->gap_index.store(gap_index + 1, std::memory_order_relaxed);
+    _header->gap_size.fetch_sub(1, std::memory_order_relaxed);
+    _header->logical_size.fetch_add(1, std::memory_order_relaxed);
+    end_write();
+    _cursor_index++;
+}
+
+template <typename T>
+void SharedGapBuffer<T>::delete_at_cursor() {
+    if (_cursor_index == 0) return;
+    begin_write();
+    move_gap_to(_cursor_index);
+    _header->gap_index.fetch_sub(1, std::memory_order_relaxed);
+    _header->gap_size.fetch_add(1, std::memory_order_relaxed);
+    _header->logical_size.fetch_sub(1, std::memory_order_relaxed);
+    end_write();
+    _cursor_index--;
+}
+
+// The cursor is the writer's own state; readers only see the gap, which
+// follows the cursor lazily on the next edit.
+template <typename T>
+void SharedGapBuffer<T>::move_cursor(int delta) {
+    int new_index = _cursor_index + delta;
+    if (new_index < 0 || new_index > static_cast<int>(size())) {
+        throw std::string("move_cursor: delta moves cursor out of bounds");
+    }
+    _cursor_index = new_index;
+}
+
+/*
+ * Grows the segment in place. Readers keep their old, smaller mapping
+ * until they notice the new capacity, and the file never shrinks, so that
+ * mapping stays valid while the writer moves the text after the gap.
+ */
+template <typename T>
+void SharedGapBuffer<T>::reserve(size_type new_size) {
+    size_type old_capacity = _header->capacity.load(std::memory_order_relaxed);
+    if (new_size <= old_capacity) return;
+    map(new_size);
+    begin_write();
+    size_type gap_index = _header->gap_index.load(std::memory_order_relaxed);
+    size_type gap_size = _header->gap_size.load(std::memory_order_relaxed);
+    size_type new_gap_size = gap_size + (new_size - old_capacity);
+    std::move_backward(_elems + gap_index + gap_size, _elems + old_capacity,
+                       _elems + new_size);
+    _header->gap_size.store(new_gap_size, std::memory_order_relaxed);
+    _header->capacity.store(new_size, std::memory_order_relaxed);
+    end_write();
+}
+
+template <typename T>
+const typename SharedGapBuffer<T>::value_type& SharedGapBuffer<T>::at(size_type pos) const {
+    if (pos >= size()) {
+        throw ("at: pos is out of bounds!");
+    }
+    size_type gap_index = _header->gap_index.load(std::memory_order_relaxed);
+    if (pos < gap_index) {
+        return _elems[pos];
+    }
+    return _elems[pos + _header->gap_size.load(std::memory_order_relaxed)];
+}
+
+template <typename T>
+typename SharedGapBuffer<T>::size_type SharedGapBuffer<T>::size() const {
+    return _header->logical_size.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+typename SharedGapBuffer<T>::size_type SharedGapBuffer<T>::cursor_index() const {
+    return _cursor_index;
+}
+
+template <typename T>
+bool SharedGapBuffer<T>::empty() const {
+    return size() == 0;
+}
+
+template <typename T>
+const std::string& SharedGapBuffer<T>::name() const {
+    return _name;
+}
+
+template <typename T>
+void SharedGapBuffer<T>::move_gap_to(size_type external_index) {
+    size_type gap_index = _header->gap_index.load(std::memory_order_relaxed);
+    size_type gap_size = _header->gap_size.load(std::memory_order_relaxed);
+    if (external_index > gap_index) {
+        std::move(_elems + gap_index + gap_size, _elems + external_index + gap_size,
+                  _elems + gap_index);
+    } else if (external_index < gap_index) {
+        std::move_backward(_elems + external_index, _elems + gap_index,
+                           _elems + gap_index + gap_size);
+    }
+    _header->gap_index.store(external_index, std::memory_order_relaxed);
+}
+
+template <typename T>
+SharedGapReader<T>::SharedGapReader(const std::string& name):
+    _name(name),
+    _fd(-1),
+    _header(nullptr),
+    _mapped_capacity(0) {
+    _fd = shm_open(_name.c_str(), O_RDONLY, 0);
+    if (_fd < 0) {
+        throw std::string("SharedGapReader: cannot open segment ") + _name;
+    }
+    void* mapping = mmap(nullptr, sizeof(SharedGapHeader), PROT_READ, MAP_SHARED, _fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(_fd);
+        throw std::string("SharedGapReader: cannot map segment ") + _name;
+    }
+    const SharedGapHeader* header = static_cast<const SharedGapHeader*>(mapping);
+    bool compatible = header->magic == kSharedGapMagic
+            && header->version == kSharedGapVersion
+            && header->header_size == shared_gap_data_offset<T>()
+            && header->element_size == sizeof(T);
+    size_type capacity = header->capacity.load(std::memory_order_acquire);
+    munmap(mapping, sizeof(SharedGapHeader));
+    if (!compatible) {
+        close(_fd);
+        throw std::string("SharedGapReader: incompatible segment layout in ") + _name;
+    }
+    map(capacity);
+}
+
+template <typename T>
+SharedGapReader<T>::~SharedGapReader() {
+    if (_header != nullptr) {
+        munmap(_header, shared_gap_data_offset<T>() + _mapped_capacity * sizeof(T));
+    }
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+template <typename T>
+void SharedGapReader<T>::map(size_type capacity) {
+    size_type bytes = shared_gap_data_offset<T>() + capacity * sizeof(T);
+    void* mapping = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, _fd, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::string("SharedGapReader: cannot map segment ") + _name;
+    }
+    if (_header != nullptr) {
+        munmap(_header, shared_gap_data_offset<T>() + _mapped_capacity * sizeof(T));
+    }
+    _header = static_cast<SharedGapHeader*>(mapping);
+    _mapped_capacity = capacity;
+}
+
+template <typename T>
+template <typename Visitor>
+auto SharedGapReader<T>::read(Visitor visit) {
+    const value_type* elems = reinterpret_cast<const value_type*>(
+                reinterpret_cast<const char*>(_header) + shared_gap_data_offset<T>());
+    while (true) {
+        uint64_t before = _header->sequence.load(std::memory_order_acquire);
+        if (before % 2 == 1) continue; // writer is mid-edit
+        size_type capacity = _header->capacity.load(std::memory_order_relaxed);
+        if (capacity > _mapped_capacity) {
+            map(capacity);
+            elems = reinterpret_cast<const value_type*>(
+                        reinterpret_cast<const char*>(_header) + shared_gap_data_offset<T>());
+            continue;
+        }
+        size_type logical_size = _header->logical_size.load(std::memory_order_relaxed);
+        size_type gap_index = _header->gap_index.load(std::memory_order_relaxed);
+        size_type gap_size = _header->gap_size.load(std::memory_order_relaxed);
+        if (gap_index > logical_size || logical_size + gap_size > capacity) continue; // torn header
+        auto result = visit(elems, gap_index, elems + gap_index + gap_size, logical_size - gap_index);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_header->sequence.load(std::memory_order_relaxed) == before) {
+            return result;
+        }
+    }
+}
+
+template <typename T>
+uint64_t SharedGapReader<T>::generation() const {
+    uint64_t sequence = _header->sequence.load(std::memory_order_acquire);
+    return sequence - sequence % 2;
+}
+
+template <typename T>
+typename SharedGapReader<T>::size_type SharedGapReader<T>::size() {
+    return read([](const value_type*, size_type first_size, const value_type*, size_type second_size) {
+        return first_size + second_size;
+    });
+}
+
+template <typename T>
+typename SharedGapReader<T>::value_type SharedGapReader<T>::at(size_type pos) {
+    bool in_bounds = true;
+    value_type element = read([&](const value_type* first, size_type first_size,
+                                  const value_type* second, size_type second_size) {
+        in_bounds = pos < first_size + second_size;
+        if (!in_bounds) return value_type();
+        return pos < first_size ? first[pos] : second[pos - first_size];
+    });
+    if (!in_bounds) {
+        throw ("at: pos is out of bounds!");
+    }
+    return element;
+}
+
+template <typename T>
+std::vector<typename SharedGapReader<T>::value_type> SharedGapReader<T>::copy() {
+    return read([](const value_type* first, size_type first_size,
+                   const value_type* second, size_type second_size) {
+        std::vector<value_type> elements(first, first + first_size);
+        elements.insert(elements.end(), second, second + second_size);
+        return elements;
+    });
+}
+
+#endif // SHAREDGAPBUFFER_H
@@ -0,0 +1,217 @@
+#include "collab.h"
+#include <algorithm>
+
+CollabSession::CollabSession(TextEditor& editor, bool first) :
+    _editor(editor),
+    _first(first),
+    _edits_seen(editor.edit_count()),
+    _sent(0),
+    _received(0),
+    _stats{0, 0, 0, 0} {
+    if (!_editor.hold_edits(_edits_seen)) {
+        throw std::string("CollabSession: cannot hold the editor's edit history");
+    }
+}
+
+CollabSession::~CollabSession() {
+    _editor.release_edits();
+}
+
+/*
+ * Everything typed since the last call, as one batch for the peer, along
+ * with how many of the peer's batches have been applied here. Send it
+ * even when it has no edits: it still acknowledges.
+ */
+CollabMessage CollabSession::outgoing() {
+    CollabMessage message{_received, {}};
+    while (true) {
+        catch_up();
+        message.edits.clear();
+        long long delta = 0; // current position minus position in the batch
+        for (const Op& op : _local) {
+            message.edits.push_back({op.position, op.erase,
+                                     _editor.retrieve_range(op.position + delta, op.insert)});
+            delta += static_cast<long long>(op.insert) - static_cast<long long>(op.erase);
+        }
+        if (_editor.edit_count() == _edits_seen) break;
+        _stats.retries++; // typed while the text was being read
+    }
+    if (!message.edits.empty()) {
+        Batch batch{_sent++, {}};
+        for (const RemoteEdit& edit : message.edits) {
+            batch.ops.push_back({edit.position, edit.erase, edit.insert.size(), edit.insert});
+        }
+        _unacknowledged.push_back(std::move(batch));
+        _local.clear();
+        _stats.batches_sent++;
+    }
+    return message;
+}
+
+/*
+ * Applies a message from the peer. Its batch is transformed past the
+ * local batches it has not seen and past what was typed since, then
+ * applied; those are transformed past it in turn, so they stay valid
+ * against the new text.
+ */
+void CollabSession::receive(const CollabMessage& message) {
+    while (!_unacknowledged.empty() && _unacknowledged.front().number < message.seen) {
+        _unacknowledged.pop_front();
+    }
+    std::vector<Op> incoming;
+    for (const RemoteEdit& edit : message.edits) {
+        incoming.push_back({edit.position, edit.erase, edit.insert.size(), edit.insert});
+    }
+    for (Batch& batch : _unacknowledged) {
+        std::vector<Op> transformed = transform(incoming, batch.ops, !_first);
+        batch.ops = transform(batch.ops, incoming, _first);
+        incoming = std::move(transformed);
+    }
+    while (true) {
+        catch_up();
+        std::vector<RemoteEdit> edits;
+        for (Op& op : transform(incoming, _local, !_first)) {
+            edits.push_back({op.position, op.erase, std::move(op.text)});
+        }
+        uint64_t edit_count = _edits_seen;
+        if (_editor.apply_remote(edits, edit_count)) {
+            _local = transform(_local, incoming, _first);
+            _edits_seen = edit_count;
+            _editor.hold_edits(_edits_seen);
+            _stats.edits_applied += edits.size();
+            break;
+        }
+        _stats.retries++; // typed while the batch was being transformed
+    }
+    if (!message.edits.empty()) {
+        _received++;
+        _stats.batches_received++;
+    }
+}
+
+CollabStats CollabSession::stats() const {
+    return _stats;
+}
+
+// Folds the editor's new edits into _local.
+void CollabSession::catch_up() {
+    std::vector<TextEdit> edits;
+    if (!_editor.edits_since(_edits_seen, edits)) {
+        throw std::string("CollabSession: the editor forgot edits not yet caught up with");
+    }
+    _edits_seen += edits.size();
+    for (const TextEdit& edit : edits) {
+        fold(edit);
+    }
+    _editor.hold_edits(_edits_seen);
+}
+
+/*
+ * Adds one edit, at a position in the current text, to _local. The local
+ * changes it touches or overlaps merge with it into one, so _local stays
+ * sorted and non-overlapping against the text it started from.
+ */
+void CollabSession::fold(const TextEdit& edit) {
+    // delta is how far the current text is shifted from the batch's text
+    // at the start of _local[first]
+    size_t first = 0;
+    long long delta = 0;
+    while (first < _local.size()) {
+        const Op& op = _local[first];
+        if (op.position + delta + op.insert >= edit.position) break;
+        delta += static_cast<long long>(op.insert) - static_cast<long long>(op.erase);
+        first++;
+    }
+    size_t start = edit.position;
+    size_t end = edit.position + edit.removed;
+    size_t last = first;
+    long long end_delta = delta;
+    while (last < _local.size()) {
+        const Op& op = _local[last];
+        size_t current = op.position + end_delta;
+        if (current > end) break;
+        start = std::min(start, current);
+        end = std::max(end, current + op.insert);
+        end_delta += static_cast<long long>(op.insert) - static_cast<long long>(op.erase);
+        last++;
+    }
+    size_t base_start = start - delta;
+    size_t base_end = end - end_delta;
+    Op merged{base_start, base_end - base_start, end - start - edit.removed + edit.inserted, ""};
+    _local.erase(_local.begin() + first, _local.begin() + last);
+    if (merged.erase > 0 || merged.insert > 0) {
+        _local.insert(_local.begin() + first, merged);
+    }
+}
+
+/*
+ * Rewrites ops so they apply after applied, where both were made against
+ * the same text. Both orders then give the same result: every character
+ * either side erased is gone, and each insert lands where it was made;
+ * inserts at the same place go ops first if ops_first, else applied first.
+ *
+ * Walks the boundaries of both batches once. Between two boundaries the
+ * original text is uniformly kept or erased by each side, so each stretch
+ * is handled whole.
+ */
+std::vector<CollabSession::Op> CollabSession::transform(const std::vector<Op>& ops,
+                                                        const std::vector<Op>& applied,
+                                                        bool ops_first) {
+    std::vector<size_t> points;
+    for (const std::vector<Op>* list : {&ops, &applied}) {
+        for (const Op& op : *list) {
+            points.push_back(op.position);
+            points.push_back(op.position + op.erase);
+        }
+    }
+    std::sort(points.begin(), points.end());
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+
+    std::vector<Op> result;
+    auto emit = [&result](size_t position, size_t erase, size_t insert, const std::string& text) {
+        if (!result.empty() && result.back().position + result.back().erase == position) {
+            result.back().erase += erase;
+            result.back().insert += insert;
+            result.back().text += text;
+        } else {
+            result.push_back({position, erase, insert, text});
+        }
+    };
+    // whether list erases the original character at position; index only
+    // moves forward, as positions do
+    auto erases = [](const std::vector<Op>& list, size_t& index, size_t position) {
+        while (index < list.size() && list[index].position + list[index].erase <= position) {
+            index++;
+        }
+        return index < list.size() && list[index].position <= position;
+    };
+
+    size_t position = 0; // in the text after applied
+    size_t last = 0;     // in the original text
+    size_t next_op = 0, next_applied = 0, erasing_op = 0, erasing_applied = 0;
+    for (size_t point : points) {
+        if (point > last && !erases(applied, erasing_applied, last)) {
+            if (erases(ops, erasing_op, last)) {
+                emit(position, point - last, 0, "");
+            }
+            position += point - last;
+        }
+        size_t inserted = 0;
+        std::string text;
+        for (; next_op < ops.size() && ops[next_op].position == point; ++next_op) {
+            inserted += ops[next_op].insert;
+            text += ops[next_op].text;
+        }
+        size_t theirs = 0;
+        for (; next_applied < applied.size() && applied[next_applied].position == point; ++next_applied) {
+            theirs += applied[next_applied].insert;
+        }
+        if (!ops_first) position += theirs;
+        if (inserted > 0) {
+            emit(position, 0, inserted, text);
+        }
+        if (ops_first) position += theirs;
+        last = point;
+    }
+    return result;
+}
@@ -0,0 +1,89 @@
+#ifndef COLLAB_H
+#define COLLAB_H
+
+#include "texteditor.h"
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// What one side of a collaboration sends the other: a batch of edits
+// (possibly empty, as a bare acknowledgement) against the text the sender
+// had after applying the first seen batches it received.
+struct CollabMessage {
+    uint64_t seen;
+    std::vector<RemoteEdit> edits;
+};
+
+struct CollabStats {
+    uint64_t batches_sent;
+    uint64_t batches_received;
+    uint64_t edits_applied; // remote edits, after transformation
+    uint64_t retries;       // batches transformed again because of local typing
+};
+
+/*
+ * Keeps a TextEditor in step with one peer (another editor, or a server
+ * holding the shared copy) by operational transformation, two-party
+ * Jupiter style. Local typing goes to the editor as usual; outgoing()
+ * turns everything typed since the last call into one batch for the peer,
+ * and receive() applies the peer's batches.
+ *
+ * A received batch was made without the local batches the peer had not
+ * seen yet, nor what was typed since the last outgoing(). It is
+ * transformed past all of them, then applied in one
+ * TextEditor::apply_remote call, and they are transformed past it in
+ * turn. Both sides then reach the same text. Where both insert at the
+ * same place, the side constructed with first = true goes first.
+ *
+ * Batches are sets of non-overlapping edits against one state rather than
+ * sequences, so transforming costs O(edits in both), not O(their product),
+ * and typing never waits on it: if a key lands while a batch is being
+ * transformed, the batch is transformed again. Messages must arrive in
+ * the order they were sent. The session holds the editor's edit history
+ * from the first edit it has not folded in yet, so any amount of typing
+ * between exchanges is caught up with.
+ */
+class CollabSession {
+public:
+    CollabSession(TextEditor& editor, bool first);
+    ~CollabSession();
+    CollabSession(const CollabSession& other) = delete;
+    CollabSession& operator=(const CollabSession& rhs) = delete;
+
+    CollabMessage outgoing();
+    void receive(const CollabMessage& message);
+    CollabStats stats() const;
+
+private:
+    // An edit against some earlier text. text holds what is inserted, or
+    // is empty for local changes, whose inserted text is in the editor.
+    struct Op {
+        size_t position;
+        size_t erase;
+        size_t insert;
+        std::string text;
+    };
+
+    struct Batch {
+        uint64_t number;
+        std::vector<Op> ops;
+    };
+
+    TextEditor& _editor;
+    const bool _first;
+    uint64_t _edits_seen;   // the editor's edits already folded into _local
+    std::vector<Op> _local; // typed since the last outgoing(), against the
+                            // text after the batches in _unacknowledged
+    std::deque<Batch> _unacknowledged; // sent, not yet seen by the peer
+    uint64_t _sent;
+    uint64_t _received;
+    CollabStats _stats;
+
+    void catch_up();
+    void fold(const TextEdit& edit);
+    static std::vector<Op> transform(const std::vector<Op>& ops, const std::vector<Op>& applied,
+                                     bool ops_first);
+};
+
+#endif // COLLAB_H
@@ -0,0 +1,205 @@
+#include "documentmanager.h"
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+DocumentManager::DocumentManager(size_t threads, size_t memory_budget) :
+    _memory_budget(memory_budget),
+    _resident_bytes(0),
+    _clock(0),
+    _loads(0),
+    _evictions(0),
+    _tasks(0),
+    _outstanding(0),
+    _pool(threads) {}
+
+// Finishes all submitted work, then saves every document still in memory.
+DocumentManager::~DocumentManager() {
+    wait_idle();
+    _pool.shutdown();
+    for (auto& entry : _documents) {
+        if (entry.second->editor) {
+            entry.second->editor->save();
+        }
+    }
+}
+
+/*
+ * Queues task to run on the document at path, after everything submitted
+ * for it before. The future becomes ready when the task has run, and
+ * carries anything it (or loading the document) threw.
+ */
+std::future<void> DocumentManager::submit(const std::string& path, Task task) {
+    Document& doc = document(path);
+    std::promise<void> done;
+    std::future<void> future = done.get_future();
+    start_work();
+    bool schedule;
+    {
+        std::lock_guard<std::mutex> lock(doc.mutex);
+        doc.queue.push_back({std::move(task), std::move(done)});
+        schedule = !doc.scheduled;
+        doc.scheduled = true;
+    }
+    if (schedule) {
+        start_work();
+        _pool.submit([this, &doc] { drain(doc); });
+    }
+    return future;
+}
+
+// Applies a command batch to the document at path, as one TextEditor::apply.
+std::future<void> DocumentManager::apply(const std::string& path, std::vector<Command> commands) {
+    return submit(path, [commands = std::move(commands)](TextEditor& editor) {
+        editor.apply(commands);
+    });
+}
+
+// Blocks until every task submitted so far has run, and the evictions
+// that followed have finished.
+void DocumentManager::wait_idle() {
+    std::unique_lock<std::mutex> lock(_idle_mutex);
+    _idle_cv.wait(lock, [this] { return _outstanding == 0; });
+}
+
+bool DocumentManager::resident(const std::string& path) {
+    Document* doc;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto found = _documents.find(path);
+        if (found == _documents.end()) return false;
+        doc = found->second.get();
+    }
+    std::lock_guard<std::mutex> lock(doc->mutex);
+    return doc->editor != nullptr;
+}
+
+DocumentStats DocumentManager::stats() {
+    DocumentStats stats{0, 0, _resident_bytes.load(), _loads.load(), _evictions.load(), _tasks.load()};
+    std::lock_guard<std::mutex> lock(_mutex);
+    stats.documents = _documents.size();
+    for (auto& entry : _documents) {
+        std::lock_guard<std::mutex> doc_lock(entry.second->mutex);
+        stats.resident += entry.second->editor ? 1 : 0;
+    }
+    return stats;
+}
+
+// The document for path, created (but not loaded) on first use.
+DocumentManager::Document& DocumentManager::document(const std::string& path) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::unique_ptr<Document>& doc = _documents[path];
+    if (!doc) {
+        doc = std::make_unique<Document>();
+        doc->path = path;
+    }
+    return *doc;
+}
+
+/*
+ * Runs queued tasks for one document on the current worker, loading it
+ * first if it was evicted. Only one drain per document is ever queued or
+ * running, which is what keeps its tasks in order. After kTasksPerTurn
+ * tasks it requeues itself behind whatever else is waiting.
+ */
+void DocumentManager::drain(Document& doc) {
+    for (int turn = 0; turn < kTasksPerTurn; ++turn) {
+        Job job;
+        TextEditor* editor;
+        size_t cursor;
+        {
+            std::lock_guard<std::mutex> lock(doc.mutex);
+            if (doc.queue.empty()) {
+                doc.scheduled = false;
+                editor = nullptr;
+            } else {
+                job = std::move(doc.queue.front());
+                doc.queue.pop_front();
+                editor = doc.editor.get();
+            }
+            cursor = doc.cursor;
+        }
+        if (!job.task) {
+            if (_resident_bytes.load() > _memory_budget) {
+                enforce_budget();
+            }
+            finish_work();
+            return;
+        }
+        try {
+            if (!editor) {
+                auto loaded = std::make_unique<TextEditor>(doc.path);
+                loaded->wait_until_loaded();
+                loaded->move_to(cursor);
+                editor = loaded.get();
+                std::lock_guard<std::mutex> lock(doc.mutex);
+                doc.editor = std::move(loaded);
+                _loads++;
+            }
+            job.task(*editor);
+            job.done.set_value();
+        } catch (...) {
+            job.done.set_exception(std::current_exception());
+        }
+        if (editor) {
+            std::lock_guard<std::mutex> lock(doc.mutex);
+            size_t bytes = editor->size();
+            _resident_bytes += bytes;
+            _resident_bytes -= doc.resident_bytes;
+            doc.resident_bytes = bytes;
+            doc.last_used = ++_clock;
+        }
+        _tasks++;
+        finish_work();
+    }
+    _pool.submit([this, &doc] { drain(doc); });
+}
+
+// Work is every queued task and every queued or running drain.
+void DocumentManager::start_work() {
+    std::lock_guard<std::mutex> lock(_idle_mutex);
+    _outstanding++;
+}
+
+void DocumentManager::finish_work() {
+    {
+        std::lock_guard<std::mutex> lock(_idle_mutex);
+        _outstanding--;
+    }
+    _idle_cv.notify_all();
+}
+
+/*
+ * Saves and drops the least recently used idle documents until the
+ * editors in memory fit the budget. Documents with work queued or running
+ * are never evicted, and neither is one whose save fails. Runs after a
+ * document goes idle while over budget. Passes take turns, so a document
+ * that went idle during another pass is considered by its own.
+ */
+void DocumentManager::enforce_budget() {
+    std::lock_guard<std::mutex> evicting(_evict_mutex);
+    if (_resident_bytes.load() <= _memory_budget) return;
+    std::vector<std::pair<uint64_t, Document*>> candidates;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& entry : _documents) {
+            Document& doc = *entry.second;
+            std::lock_guard<std::mutex> doc_lock(doc.mutex);
+            if (doc.editor && !doc.scheduled) {
+                candidates.emplace_back(doc.last_used, &doc);
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    for (auto& candidate : candidates) {
+        if (_resident_bytes.load() <= _memory_budget) break;
+        Document& doc = *candidate.second;
+        std::lock_guard<std::mutex> lock(doc.mutex);
+        if (!doc.editor || doc.scheduled || !doc.editor->save()) continue;
+        doc.cursor = doc.editor->cursor_index();
+        doc.editor.reset();
+        _resident_bytes -= doc.resident_bytes;
+        doc.resident_bytes = 0;
+        _evictions++;
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef DOCUMENTMANAGER_H
+#define DOCUMENTMANAGER_H
+
+#include "texteditor.h"
+#include "threadpool.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct DocumentStats {
+    size_t documents;
+    size_t resident;        // documents with an editor in memory
+    size_t resident_bytes;  // characters held by those editors
+    uint64_t loads;
+    uint64_t evictions;
+    uint64_t tasks;
+};
+
+/*
+ * Hosts many documents, each a TextEditor on a file, and runs work on them
+ * on one shared WorkStealingPool. Work for a document goes through its own
+ * serial queue: tasks for one document run one at a time in the order they
+ * were submitted, while different documents run in parallel on all the
+ * workers. A document runs at most kTasksPerTurn tasks before giving its
+ * worker back, so a busy document cannot starve the others.
+ *
+ * Documents are loaded on first use. Whenever the editors in memory hold
+ * more than memory_budget characters, the least recently used idle ones
+ * are saved to their files and dropped; the next task reloads them with
+ * the cursor where it was.
+ */
+class DocumentManager {
+public:
+    using Task = std::function<void(TextEditor&)>;
+
+    explicit DocumentManager(size_t threads = std::thread::hardware_concurrency(),
+                             size_t memory_budget = 256 * 1024 * 1024);
+    ~DocumentManager();
+    DocumentManager(const DocumentManager& other) = delete;
+    DocumentManager& operator=(const DocumentManager& rhs) = delete;
+
+    std::future<void> submit(const std::string& path, Task task);
+    std::future<void> apply(const std::string& path, std::vector<Command> commands);
+    void wait_idle();
+    void enforce_budget();
+    bool resident(const std::string& path);
+    DocumentStats stats();
+
+private:
+    static constexpr int kTasksPerTurn = 16;
+
+    struct Job {
+        Task task;
+        std::promise<void> done;
+    };
+
+    struct Document {
+        std::string path;
+        std::mutex mutex;           // guards everything below
+        std::deque<Job> queue;
+        bool scheduled = false;     // a drain for this document is queued or running
+        std::unique_ptr<TextEditor> editor;
+        size_t resident_bytes = 0;
+        uint64_t last_used = 0;
+        size_t cursor = 0;          // where the cursor was when it was evicted
+    };
+
+    size_t _memory_budget;
+    std::mutex _mutex; // guards _documents
+    std::unordered_map<std::string, std::unique_ptr<Document>> _documents;
+    std::atomic<size_t> _resident_bytes;
+    std::atomic<uint64_t> _clock; // ticks once per task, for last_used
+    std::atomic<uint64_t> _loads;
+    std::atomic<uint64_t> _evictions;
+    std::atomic<uint64_t> _tasks;
+    std::mutex _evict_mutex; // one eviction pass at a time
+
+    std::mutex _idle_mutex;
+    std::condition_variable _idle_cv;
+    size_t _outstanding; // tasks and drains not yet finished, guarded by _idle_mutex
+
+    WorkStealingPool _pool; // last, so its workers stop before the rest goes away
+
+    Document& document(const std::string& path);
+    void drain(Document& document);
+    void start_work();
+    void finish_work();
+};
+
+#endif // DOCUMENTMANAGER_H
@@ -0,0 +1,378 @@
+#include "journal.h"
+#include <cstdio> // for rename
+#include <cstring> // for memcpy
+#include <fstream>
+#include <iterator>
+#include <fcntl.h> // for open
+#include <unistd.h> // for fsync, fdatasync, pread
+
+/*
+ * Log record:   [ payload size u32 | checksum u32 | lsn u64 | payload ]
+ * Checkpoint:   [ magic u32 | checksum u32 | lsn u64 | cursor u64 | size u64 | text ]
+ *
+ * A payload is a sequence of operations, each a type byte followed by its
+ * argument: Key (the character), Move (an int32 delta), Backspace (none)
+ * or Text (a u32 length and that many typed characters). Integers are in
+ * host byte order; the journal is only ever read back on the same machine.
+ */
+const uint32_t kCheckpointMagic = 0x504b434a; // "JCKP"
+const size_t kRecordHeaderSize = 16;
+const size_t kCheckpointHeaderSize = 32;
+
+enum : char { kOpKey, kOpMove, kOpBackspace, kOpText };
+
+namespace {
+
+// FNV-1a, enough to tell a torn or half-written record from a whole one.
+uint32_t checksum(const char* data, size_t size, uint32_t hash = 2166136261u) {
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+template <typename Int>
+void put(std::string& out, Int value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename Int>
+Int get(const char* data) {
+    Int value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+bool write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) return false;
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// Makes a rename in the directory of path durable.
+void sync_directory(const std::string& path) {
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Decodes one record's payload onto out. False if it is malformed.
+bool decode(const char* data, size_t size, std::vector<Command>& out) {
+    size_t i = 0;
+    while (i < size) {
+        char op = data[i++];
+        if (op == kOpKey && i + 1 <= size) {
+            out.push_back(Command::key(data[i]));
+            i += 1;
+        } else if (op == kOpMove && i + 4 <= size) {
+            out.push_back(Command::move(get<int32_t>(data + i)));
+            i += 4;
+        } else if (op == kOpBackspace) {
+            out.push_back(Command::backspace());
+        } else if (op == kOpText && i + 4 <= size && i + 4 + get<uint32_t>(data + i) <= size) {
+            uint32_t length = get<uint32_t>(data + i);
+            for (uint32_t j = 0; j < length; ++j) {
+                out.push_back(Command::key(data[i + 4 + j]));
+            }
+            i += 4 + length;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+/*
+ * Starts a new journal at path. Any previous journal there is discarded,
+ * so recover() it first if it matters; until the owner writes the first
+ * checkpoint, recover() finds nothing.
+ */
+Journal::Journal(const std::string& path, JournalOptions options) :
+    _log_path(path + ".log"),
+    _checkpoint_path(path + ".checkpoint"),
+    _options(options),
+    _fd(-1),
+    _last_lsn(0),
+    _durable_lsn(0),
+    _waiters(0),
+    _failed(false),
+    _stopping(false),
+    _log_size(0),
+    _stats{0, 0, 0, 0} {
+    unlink(_checkpoint_path.c_str());
+    _fd = open(_log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (_fd < 0) {
+        throw std::string("Journal: cannot open ") + _log_path;
+    }
+    _flusher = std::thread(&Journal::flush_loop, this);
+}
+
+// Writes out whatever is pending before closing the log.
+Journal::~Journal() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _flush_cv.notify_all();
+    _flusher.join();
+    close(_fd);
+}
+
+// Queues one record holding commands and returns its LSN. Never touches
+// the disk; see wait_durable.
+uint64_t Journal::append(const Command* commands, size_t count) {
+    std::string payload;
+    for (size_t i = 0; i < count; ++i) {
+        switch (commands[i].type) {
+        case Command::Type::Key:
+            payload.push_back(kOpKey);
+            payload.push_back(commands[i].ch);
+            break;
+        case Command::Type::Move:
+            payload.push_back(kOpMove);
+            put<int32_t>(payload, commands[i].delta);
+            break;
+        case Command::Type::Backspace:
+            payload.push_back(kOpBackspace);
+            break;
+        }
+    }
+    return append_record(payload);
+}
+
+// Queues one record that types text.
+uint64_t Journal::append(std::string_view text) {
+    std::string payload;
+    payload.reserve(5 + text.size());
+    payload.push_back(kOpText);
+    put<uint32_t>(payload, static_cast<uint32_t>(text.size()));
+    payload.append(text.data(), text.size());
+    return append_record(payload);
+}
+
+uint64_t Journal::append_record(std::string_view payload) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint64_t lsn = ++_last_lsn;
+    uint32_t sum = checksum(reinterpret_cast<const char*>(&lsn), sizeof(lsn));
+    sum = checksum(payload.data(), payload.size(), sum);
+    put<uint32_t>(_pending, static_cast<uint32_t>(payload.size()));
+    put<uint32_t>(_pending, sum);
+    put<uint64_t>(_pending, lsn);
+    _pending.append(payload.data(), payload.size());
+    _stats.records++;
+    if (_pending.size() >= _options.max_batch_bytes) {
+        _flush_cv.notify_one();
+    }
+    return lsn;
+}
+
+/*
+ * Blocks until every record up to lsn is on disk. Asks for a flush right
+ * away; whatever other threads append meanwhile rides along in the same
+ * batch. Returns false if the log could not be written.
+ */
+bool Journal::wait_durable(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_durable_lsn >= lsn) return true;
+    _waiters++;
+    _flush_cv.notify_one();
+    _durable_cv.wait(lock, [&] { return _durable_lsn >= lsn || _failed; });
+    _waiters--;
+    return _durable_lsn >= lsn;
+}
+
+// Appends commands and waits until they are durable. Returns the LSN.
+uint64_t Journal::commit(const Command* commands, size_t count) {
+    uint64_t lsn = append(commands, count);
+    if (!wait_durable(lsn)) {
+        throw std::string("Journal: cannot write ") + _log_path;
+    }
+    return lsn;
+}
+
+uint64_t Journal::last_lsn() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _last_lsn;
+}
+
+uint64_t Journal::durable_lsn() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _durable_lsn;
+}
+
+// True once the log has grown past checkpoint_bytes since the last checkpoint.
+bool Journal::needs_checkpoint() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _log_size + _pending.size() >= _options.checkpoint_bytes;
+}
+
+JournalStats Journal::stats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+void Journal::flush_loop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _flush_cv.wait_for(lock, _options.max_delay, [this] {
+            return _stopping || _pending.size() >= _options.max_batch_bytes ||
+                   (_waiters > 0 && !_pending.empty());
+        });
+        if (_pending.empty()) {
+            if (_stopping) break;
+            continue;
+        }
+        std::string batch;
+        batch.swap(_pending);
+        uint64_t last = _last_lsn;
+        lock.unlock();
+
+        std::unique_lock<std::mutex> io_lock(_io_mutex);
+        bool ok = write_all(_fd, batch.data(), batch.size()) && fdatasync(_fd) == 0;
+        lock.lock();
+        if (ok) {
+            _log_size += batch.size();
+            _batches.emplace_back(last, _log_size);
+            _durable_lsn = last;
+            _stats.syncs++;
+            _stats.bytes_written += batch.size();
+        } else {
+            _failed = true;
+        }
+        io_lock.unlock();
+        _durable_cv.notify_all();
+    }
+}
+
+/*
+ * Saves text and cursor as the state after record lsn, then drops the
+ * records it covers from the log. The checkpoint is written to a
+ * temporary file and renamed into place, so a crash leaves either the old
+ * checkpoint or the new one; records it already covers are skipped on
+ * recovery, so a crash before the log is cut is harmless too.
+ */
+bool Journal::write_checkpoint(std::string_view text, size_t cursor, uint64_t lsn) {
+    std::string header;
+    put<uint32_t>(header, kCheckpointMagic);
+    put<uint32_t>(header, 0);
+    put<uint64_t>(header, lsn);
+    put<uint64_t>(header, cursor);
+    put<uint64_t>(header, text.size());
+    uint32_t sum = checksum(header.data() + 8, header.size() - 8);
+    sum = checksum(text.data(), text.size(), sum);
+    std::memcpy(&header[4], &sum, sizeof(sum));
+
+    std::string temp = _checkpoint_path + ".tmp";
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    bool ok = write_all(fd, header.data(), header.size()) &&
+              write_all(fd, text.data(), text.size()) && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    ok = ok && std::rename(temp.c_str(), _checkpoint_path.c_str()) == 0;
+    if (!ok) return false;
+    sync_directory(_checkpoint_path);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stats.checkpoints++;
+    }
+    return wait_durable(lsn) && truncate_log(lsn);
+}
+
+/*
+ * Cuts the log down to the batches after the one holding lsn. The tail is
+ * copied to a new file that replaces the log; flushing waits meanwhile,
+ * but right after a checkpoint the tail is at most a batch or two.
+ */
+bool Journal::truncate_log(uint64_t lsn) {
+    std::lock_guard<std::mutex> io_lock(_io_mutex);
+    size_t cut = 0;
+    size_t log_size;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        while (!_batches.empty() && _batches.front().first <= lsn) {
+            cut = _batches.front().second;
+            _batches.pop_front();
+        }
+        log_size = _log_size;
+    }
+    if (cut == 0) return true;
+
+    std::string tail(log_size - cut, '\0');
+    if (!tail.empty() && pread(_fd, &tail[0], tail.size(), cut) != static_cast<ssize_t>(tail.size())) {
+        return false;
+    }
+    std::string temp = _log_path + ".tmp";
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) return false;
+    if (!write_all(fd, tail.data(), tail.size()) || fsync(fd) != 0 ||
+        std::rename(temp.c_str(), _log_path.c_str()) != 0) {
+        close(fd);
+        return false;
+    }
+    sync_directory(_log_path);
+    close(_fd);
+    _fd = fd;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _log_size -= cut;
+    for (auto& batch : _batches) {
+        batch.second -= cut;
+    }
+    return true;
+}
+
+/*
+ * Reads back the journal at path: the checkpoint, then every intact record
+ * after it, up to the first torn or corrupt one.
+ */
+JournalRecovery Journal::recover(const std::string& path) {
+    JournalRecovery result{false, "", 0, 0, {}, 0};
+    std::string checkpoint = read_file(path + ".checkpoint");
+    if (checkpoint.size() < kCheckpointHeaderSize ||
+        get<uint32_t>(checkpoint.data()) != kCheckpointMagic) {
+        return result;
+    }
+    uint64_t size = get<uint64_t>(checkpoint.data() + 24);
+    if (checkpoint.size() - kCheckpointHeaderSize != size ||
+        checksum(checkpoint.data() + 8, checkpoint.size() - 8) != get<uint32_t>(checkpoint.data() + 4)) {
+        return result;
+    }
+    result.found = true;
+    result.lsn = get<uint64_t>(checkpoint.data() + 8);
+    result.cursor = get<uint64_t>(checkpoint.data() + 16);
+    result.text = checkpoint.substr(kCheckpointHeaderSize);
+
+    std::string log = read_file(path + ".log");
+    size_t offset = 0;
+    while (offset + kRecordHeaderSize <= log.size()) {
+        const char* record = log.data() + offset;
+        uint32_t payload_size = get<uint32_t>(record);
+        if (payload_size > log.size() - offset - kRecordHeaderSize) break;
+        uint32_t sum = checksum(record + 8, sizeof(uint64_t) + payload_size);
+        if (sum != get<uint32_t>(record + 4)) break;
+        uint64_t lsn = get<uint64_t>(record + 8);
+        offset += kRecordHeaderSize + payload_size;
+        if (lsn <= result.lsn) continue;
+        std::vector<Command> commands;
+        if (!decode(record + kRecordHeaderSize, payload_size, commands)) break;
+        result.commands.insert(result.commands.end(), commands.begin(), commands.end());
+        result.lsn = lsn;
+        result.records++;
+    }
+    return result;
+}
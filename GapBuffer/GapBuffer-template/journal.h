@@ -0,0 +1,103 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "texteditor.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// When the flusher writes the log. A batch goes to disk as soon as someone
+// waits for it or it reaches max_batch_bytes, and at the latest max_delay
+// after its first record. checkpoint_bytes is the log size at which
+// needs_checkpoint() starts returning true.
+struct JournalOptions {
+    std::chrono::microseconds max_delay{2000};
+    size_t max_batch_bytes = 64 * 1024;
+    size_t checkpoint_bytes = 16 * 1024 * 1024;
+};
+
+struct JournalStats {
+    uint64_t records;
+    uint64_t syncs;         // fdatasync calls, one per batch
+    uint64_t bytes_written;
+    uint64_t checkpoints;
+};
+
+// What Journal::recover found: the last checkpoint and the commands logged
+// after it, in order. found is false if there is no valid checkpoint.
+struct JournalRecovery {
+    bool found;
+    std::string text;
+    size_t cursor;
+    uint64_t lsn;
+    std::vector<Command> commands;
+    size_t records;
+};
+
+/*
+ * Append-only log of editor commands with group commit, in two files next
+ * to each other: <path>.log holds the records and <path>.checkpoint the
+ * whole document as of some record. Every record carries a sequence number
+ * (LSN) and a checksum, so recovery skips what the checkpoint already
+ * covers and stops at a record torn by a crash.
+ *
+ * append() only copies the record into memory; a flusher thread writes
+ * everything pending with one write and one fdatasync. Threads waiting in
+ * wait_durable() share that sync, so durable operations per second grow
+ * with the batch size instead of being one per fsync.
+ */
+class Journal {
+public:
+    explicit Journal(const std::string& path, JournalOptions options = JournalOptions());
+    ~Journal();
+    Journal(const Journal& other) = delete;
+    Journal& operator=(const Journal& rhs) = delete;
+
+    uint64_t append(const Command* commands, size_t count);
+    uint64_t append(std::string_view text);
+    bool wait_durable(uint64_t lsn);
+    uint64_t commit(const Command* commands, size_t count);
+    uint64_t last_lsn();
+    uint64_t durable_lsn();
+    bool needs_checkpoint();
+    bool write_checkpoint(std::string_view text, size_t cursor, uint64_t lsn);
+    JournalStats stats();
+
+    static JournalRecovery recover(const std::string& path);
+
+private:
+    std::string _log_path;
+    std::string _checkpoint_path;
+    JournalOptions _options;
+    int _fd;
+
+    std::mutex _mutex; // guards everything below but the log file itself
+    std::condition_variable _flush_cv;
+    std::condition_variable _durable_cv;
+    std::string _pending; // encoded records not yet written
+    uint64_t _last_lsn;
+    uint64_t _durable_lsn;
+    size_t _waiters;
+    bool _failed;
+    bool _stopping;
+    size_t _log_size;
+    JournalStats _stats;
+    // (last LSN, log size) after each batch, for cutting the log at a checkpoint
+    std::deque<std::pair<uint64_t, size_t>> _batches;
+
+    std::mutex _io_mutex; // held while writing or replacing the log file
+    std::thread _flusher;
+
+    void flush_loop();
+    uint64_t append_record(std::string_view payload);
+    bool truncate_log(uint64_t lsn);
+};
+
+#endif // JOURNAL_H
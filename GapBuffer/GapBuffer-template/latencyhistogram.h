@@ -0,0 +1,170 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Summary of a LatencyHistogram, in nanoseconds. Percentiles are the upper
+// bound of the bucket they fall in, so they overstate by at most 1/16.
+struct LatencySnapshot {
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+    uint64_t mean;
+};
+
+/*
+ * HDR-style latency histogram with log-linear buckets: values below 16ns
+ * get a bucket each, and every power of two above that is split into 16
+ * equal buckets, so any value from 1ns to centuries is kept to within
+ * about 6%. Recording is a relaxed fetch_add on a fixed bucket plus the
+ * sum and max, with no locks or allocation, so any number of
+ * threads can record at once. snapshot() may run concurrently with them;
+ * it sees each counter at some point during the call.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr size_t kSubBuckets = 1 << kSubBucketBits;
+    static constexpr size_t kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    LatencyHistogram();
+    void record(uint64_t nanoseconds);
+    LatencySnapshot snapshot() const;
+    uint64_t percentile(double quantile) const;
+    void reset();
+    std::string to_json() const;
+
+    static size_t bucket_of(uint64_t value);
+    static uint64_t bucket_upper_bound(size_t bucket);
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> _buckets;
+    std::atomic<uint64_t> _sum;
+    std::atomic<uint64_t> _max;
+
+    uint64_t percentile(const std::array<uint64_t, kBuckets>& counts, uint64_t total, double quantile) const;
+};
+
+/*
+ * Records the time from construction to destruction into a histogram, or
+ * does nothing (not even read the clock) if histogram is null.
+ */
+class LatencyTimer {
+public:
+    explicit LatencyTimer(LatencyHistogram* histogram);
+    ~LatencyTimer();
+    LatencyTimer(const LatencyTimer& other) = delete;
+    LatencyTimer& operator=(const LatencyTimer& rhs) = delete;
+
+private:
+    LatencyHistogram* _histogram;
+    std::chrono::steady_clock::time_point _start;
+};
+
+inline LatencyHistogram::LatencyHistogram() :
+    _sum(0),
+    _max(0) {
+    for (auto& bucket : _buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+// Values below kSubBuckets map to themselves; above, the bucket is the
+// position of the top bit and the kSubBucketBits bits just below it.
+inline size_t LatencyHistogram::bucket_of(uint64_t value) {
+    if (value < kSubBuckets) return static_cast<size_t>(value);
+    int top_bit = 63 - __builtin_clzll(value);
+    int shift = top_bit - kSubBucketBits;
+    size_t sub_bucket = static_cast<size_t>(value >> shift) & (kSubBuckets - 1);
+    return (shift + 1) * kSubBuckets + sub_bucket;
+}
+
+// The largest value that lands in bucket.
+inline uint64_t LatencyHistogram::bucket_upper_bound(size_t bucket) {
+    if (bucket < kSubBuckets) return bucket;
+    int shift = static_cast<int>(bucket / kSubBuckets) - 1;
+    uint64_t sub_bucket = bucket % kSubBuckets;
+    uint64_t next = (kSubBuckets + sub_bucket + 1) << shift;
+    return next == 0 ? UINT64_MAX : next - 1;
+}
+
+inline void LatencyHistogram::record(uint64_t nanoseconds) {
+    _buckets[bucket_of(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while (nanoseconds > max &&
+           !_max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {}
+}
+
+inline uint64_t LatencyHistogram::percentile(const std::array<uint64_t, kBuckets>& counts,
+                                             uint64_t total, double quantile) const {
+    if (total == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += counts[i];
+        if (seen >= rank) return bucket_upper_bound(i);
+    }
+    return bucket_upper_bound(kBuckets - 1);
+}
+
+// The value at quantile (0.5 for the median), to bucket precision.
+inline uint64_t LatencyHistogram::percentile(double quantile) const {
+    std::array<uint64_t, kBuckets> counts;
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        counts[i] = _buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    return percentile(counts, total, quantile);
+}
+
+inline LatencySnapshot LatencyHistogram::snapshot() const {
+    std::array<uint64_t, kBuckets> counts;
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        counts[i] = _buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    uint64_t sum = _sum.load(std::memory_order_relaxed);
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    return {total, percentile(counts, total, 0.5), percentile(counts, total, 0.99),
+            percentile(counts, total, 0.999), max, total == 0 ? 0 : sum / total};
+}
+
+inline void LatencyHistogram::reset() {
+    for (auto& bucket : _buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    _sum.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
+
+// {"count":..,"p50":..,"p99":..,"p999":..,"max":..,"mean":..}, in ns.
+inline std::string LatencyHistogram::to_json() const {
+    LatencySnapshot s = snapshot();
+    return "{\"count\":" + std::to_string(s.count) + ",\"p50\":" + std::to_string(s.p50) +
+           ",\"p99\":" + std::to_string(s.p99) + ",\"p999\":" + std::to_string(s.p999) +
+           ",\"max\":" + std::to_string(s.max) + ",\"mean\":" + std::to_string(s.mean) + "}";
+}
+
+inline LatencyTimer::LatencyTimer(LatencyHistogram* histogram) :
+    _histogram(histogram) {
+    if (_histogram) {
+        _start = std::chrono::steady_clock::now();
+    }
+}
+
+inline LatencyTimer::~LatencyTimer() {
+    if (_histogram) {
+        auto elapsed = std::chrono::steady_clock::now() - _start;
+        _histogram->record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+}
+
+#endif // LATENCYHISTOGRAM_H
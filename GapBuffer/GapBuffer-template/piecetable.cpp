@@ -0,0 +1,313 @@
+#include "piecetable.h"
+#include <algorithm>
+#include <cstring> // for memcpy
+#include <fcntl.h> // for open
+#include <sys/mman.h> // for mmap, munmap
+#include <sys/stat.h> // for fstat
+#include <unistd.h> // for close
+
+PieceTable::PieceTable(const std::string& filename) :
+    _mapping(nullptr),
+    _mapping_size(0),
+    _add_block_used(0),
+    _add_block_capacity(0),
+    _added(0),
+    _root(kNil),
+    _piece_count(0),
+    _random(2463534242u),
+    _size(0),
+    _cursor(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::string("PieceTable: cannot open ") + filename;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::string("PieceTable: cannot stat ") + filename;
+    }
+    _mapping_size = static_cast<size_t>(info.st_size);
+    if (_mapping_size > 0) {
+        void* mapping = mmap(nullptr, _mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::string("PieceTable: cannot map ") + filename;
+        }
+        _mapping = static_cast<char*>(mapping);
+        _root = make_node(_mapping, _mapping_size);
+        _size = _mapping_size;
+    }
+    close(fd);
+}
+
+PieceTable::~PieceTable() {
+    if (_mapping) {
+        munmap(_mapping, _mapping_size);
+    }
+}
+
+size_t PieceTable::size() const {
+    return _size;
+}
+
+size_t PieceTable::cursor_index() const {
+    return _cursor;
+}
+
+void PieceTable::move_cursor(long long delta) {
+    long long new_index = static_cast<long long>(_cursor) + delta;
+    if (new_index < 0 || new_index > static_cast<long long>(_size)) {
+        throw std::string("move_cursor: delta moves cursor out of bounds");
+    }
+    _cursor = static_cast<size_t>(new_index);
+}
+
+void PieceTable::insert_at_cursor(char ch) {
+    insert_at_cursor(std::string_view(&ch, 1));
+}
+
+/*
+ * Copies text to the add buffer and links it in at the cursor. If the
+ * piece just before the cursor ends where the copy begins in the same
+ * block (the previous insert was here), it grows instead of a new piece
+ * being added.
+ */
+void PieceTable::insert_at_cursor(std::string_view text) {
+    if (text.empty()) return;
+    const char* data = append(text);
+    bool fresh_block = data == _add_blocks.back().get();
+    auto [before, after] = split(_root, _cursor);
+    if (fresh_block || !extend_last(before, data, text.size())) {
+        before = merge(before, make_node(data, text.size()));
+    }
+    _root = merge(before, after);
+    _size += text.size();
+    _cursor += text.size();
+}
+
+// Deletes the character before the cursor, if there is one.
+void PieceTable::delete_at_cursor() {
+    if (_cursor == 0) return;
+    auto [before, rest] = split(_root, _cursor - 1);
+    auto [deleted, after] = split(rest, 1);
+    free_node(deleted); // no piece is empty, so this is a single node
+    _root = merge(before, after);
+    _size--;
+    _cursor--;
+}
+
+// Empties the text. The mapping and the add buffer stay, so views handed
+// out by runs() stay valid.
+void PieceTable::clear() {
+    _nodes.clear();
+    _free_nodes.clear();
+    _root = kNil;
+    _piece_count = 0;
+    _size = 0;
+    _cursor = 0;
+}
+
+char PieceTable::at(size_t pos) const {
+    if (pos >= _size) {
+        throw ("at: pos is out of bounds!");
+    }
+    uint32_t node = _root;
+    while (true) {
+        const Node& piece = _nodes[node];
+        size_t before = total(piece.left);
+        if (pos < before) {
+            node = piece.left;
+        } else if (pos - before < piece.length) {
+            return piece.data[pos - before];
+        } else {
+            pos -= before + piece.length;
+            node = piece.right;
+        }
+    }
+}
+
+char PieceTable::get_at_cursor() const {
+    if (_cursor == _size) {
+        throw ("cursor: array_index is out of bounds!");
+    }
+    return at(_cursor);
+}
+
+// Replaces out with up to count characters starting at position.
+void PieceTable::copy(size_t position, size_t count, std::string& out) const {
+    out.clear();
+    if (position >= _size) return;
+    count = std::min(count, _size - position);
+    out.reserve(count);
+    visit(position, [&](const char* data, size_t length) {
+        out.append(data, std::min(length, count - out.size()));
+        return out.size() < count;
+    });
+}
+
+// The text from position to the end, as views into the table's storage.
+std::vector<std::string_view> PieceTable::runs(size_t position) const {
+    std::vector<std::string_view> views;
+    if (position >= _size) return views;
+    visit(position, [&](const char* data, size_t length) {
+        views.emplace_back(data, length);
+        return true;
+    });
+    return views;
+}
+
+size_t PieceTable::piece_count() const {
+    return _piece_count;
+}
+
+// Characters held in the add buffer, deleted ones included.
+size_t PieceTable::added_size() const {
+    return _added;
+}
+
+uint32_t PieceTable::make_node(const char* data, size_t length) {
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    Node node{data, length, length, kNil, kNil, _random};
+    _piece_count++;
+    if (!_free_nodes.empty()) {
+        uint32_t index = _free_nodes.back();
+        _free_nodes.pop_back();
+        _nodes[index] = node;
+        return index;
+    }
+    _nodes.push_back(node);
+    return static_cast<uint32_t>(_nodes.size() - 1);
+}
+
+void PieceTable::free_node(uint32_t node) {
+    _free_nodes.push_back(node);
+    _piece_count--;
+}
+
+size_t PieceTable::total(uint32_t node) const {
+    return node == kNil ? 0 : _nodes[node].total;
+}
+
+// Recomputes node's total from its children.
+void PieceTable::update(uint32_t node) {
+    Node& piece = _nodes[node];
+    piece.total = total(piece.left) + piece.length + total(piece.right);
+}
+
+/*
+ * Splits the subtree under node into its first position characters and
+ * the rest, and returns the roots of the two. A piece across position is
+ * cut in two, the second half becoming a new node.
+ */
+std::pair<uint32_t, uint32_t> PieceTable::split(uint32_t node, size_t position) {
+    if (node == kNil) return {kNil, kNil};
+    size_t before = total(_nodes[node].left);
+    size_t length = _nodes[node].length;
+    if (position <= before) {
+        auto [left, right] = split(_nodes[node].left, position);
+        _nodes[node].left = right;
+        update(node);
+        return {left, node};
+    }
+    if (position >= before + length) {
+        auto [left, right] = split(_nodes[node].right, position - before - length);
+        _nodes[node].right = left;
+        update(node);
+        return {node, right};
+    }
+    size_t offset = position - before;
+    uint32_t rest = make_node(_nodes[node].data + offset, length - offset);
+    uint32_t right = _nodes[node].right;
+    _nodes[node].length = offset;
+    _nodes[node].right = kNil;
+    update(node);
+    return {node, merge(rest, right)};
+}
+
+// Joins two subtrees, all of left's text coming before right's.
+uint32_t PieceTable::merge(uint32_t left, uint32_t right) {
+    if (left == kNil) return right;
+    if (right == kNil) return left;
+    if (_nodes[left].priority > _nodes[right].priority) {
+        uint32_t merged = merge(_nodes[left].right, right);
+        _nodes[left].right = merged;
+        update(left);
+        return left;
+    }
+    uint32_t merged = merge(left, _nodes[right].left);
+    _nodes[right].left = merged;
+    update(right);
+    return right;
+}
+
+// Grows the last piece under root by count if it ends where data starts.
+// Every node on the way down to it holds it, so all their totals grow.
+bool PieceTable::extend_last(uint32_t root, const char* data, size_t count) {
+    if (root == kNil) return false;
+    uint32_t last = root;
+    while (_nodes[last].right != kNil) {
+        last = _nodes[last].right;
+    }
+    if (_nodes[last].data + _nodes[last].length != data) return false;
+    for (uint32_t node = root; node != kNil; node = _nodes[node].right) {
+        _nodes[node].total += count;
+    }
+    _nodes[last].length += count;
+    return true;
+}
+
+/*
+ * Calls visit(data, length) with each piece from the one holding position
+ * on, in text order, the first one cut to start at position, until visit
+ * returns false. position must be in the text.
+ */
+template <typename Visit>
+void PieceTable::visit(size_t position, Visit visit) const {
+    std::vector<uint32_t> later; // nodes passed on the left, still to come
+    uint32_t node = _root;
+    while (true) {
+        const Node& piece = _nodes[node];
+        size_t before = total(piece.left);
+        if (position < before) {
+            later.push_back(node);
+            node = piece.left;
+        } else if (position - before < piece.length) {
+            position -= before;
+            break;
+        } else {
+            position -= before + piece.length;
+            node = piece.right;
+        }
+    }
+    while (visit(_nodes[node].data + position, _nodes[node].length - position)) {
+        position = 0;
+        node = _nodes[node].right;
+        if (node != kNil) {
+            while (_nodes[node].left != kNil) {
+                later.push_back(node);
+                node = _nodes[node].left;
+            }
+        } else if (!later.empty()) {
+            node = later.back();
+            later.pop_back();
+        } else {
+            return;
+        }
+    }
+}
+
+// Copies text to the end of the add buffer and returns where it went.
+const char* PieceTable::append(std::string_view text) {
+    if (_add_block_capacity - _add_block_used < text.size()) {
+        _add_block_capacity = std::max(kAddBlockSize, text.size());
+        _add_blocks.push_back(std::make_unique<char[]>(_add_block_capacity));
+        _add_block_used = 0;
+    }
+    char* destination = _add_blocks.back().get() + _add_block_used;
+    std::memcpy(destination, text.data(), text.size());
+    _add_block_used += text.size();
+    _added += text.size();
+    return destination;
+}
@@ -0,0 +1,94 @@
+#ifndef PIECETABLE_H
+#define PIECETABLE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * Text as a list of pieces, each a run of characters in one of two places:
+ * the original file, mapped read-only with mmap, or an append-only add
+ * buffer holding everything typed since. Opening maps the file and makes
+ * one piece, so it costs the same for any file size, and the kernel pages
+ * the file in only as it is read. An edit splits at most one piece, and
+ * typing right after the last typed run just extends it. The pieces are
+ * kept in a balanced tree that knows the length under each node, so an
+ * edit anywhere costs O(log pieces), however fragmented the text gets.
+ *
+ * Neither the mapping nor the add buffer ever moves or overwrites what it
+ * holds, so the views runs() returns stay valid as long as the table does,
+ * even across later edits. That is what lets TextEditor::save write the
+ * document out without copying it.
+ *
+ * The file must not be changed by anyone else while it is mapped. The
+ * interface mirrors the parts of GapBuffer<char> that TextEditor uses.
+ */
+class PieceTable {
+public:
+    explicit PieceTable(const std::string& filename);
+    ~PieceTable();
+    PieceTable(const PieceTable& other) = delete;
+    PieceTable& operator=(const PieceTable& rhs) = delete;
+
+    size_t size() const;
+    size_t cursor_index() const;
+    void move_cursor(long long delta);
+    void insert_at_cursor(char ch);
+    void insert_at_cursor(std::string_view text);
+    void delete_at_cursor();
+    void clear();
+    char at(size_t pos) const;
+    char get_at_cursor() const;
+    void copy(size_t position, size_t count, std::string& out) const;
+    std::vector<std::string_view> runs(size_t position) const;
+    size_t piece_count() const;
+    size_t added_size() const;
+
+private:
+    // One piece, as a node of a treap in text order: a binary tree that is
+    // also a heap on random priorities, which keeps it balanced. total is
+    // the length of the text in the subtree, so a position is found on the
+    // way down. Nodes live in _nodes and link by index; kNil is no node.
+    struct Node {
+        const char* data;
+        size_t length;
+        size_t total;
+        uint32_t left;
+        uint32_t right;
+        uint32_t priority;
+    };
+
+    static constexpr size_t kAddBlockSize = 64 * 1024;
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    char* _mapping;
+    size_t _mapping_size;
+    // The add buffer: blocks are only ever appended to, never reallocated.
+    std::vector<std::unique_ptr<char[]>> _add_blocks;
+    size_t _add_block_used;
+    size_t _add_block_capacity;
+    size_t _added;
+    std::vector<Node> _nodes;
+    std::vector<uint32_t> _free_nodes; // slots in _nodes to reuse
+    uint32_t _root;
+    size_t _piece_count;
+    uint32_t _random; // xorshift state for priorities
+    size_t _size;
+    size_t _cursor;
+
+    uint32_t make_node(const char* data, size_t length);
+    void free_node(uint32_t node);
+    size_t total(uint32_t node) const;
+    void update(uint32_t node);
+    std::pair<uint32_t, uint32_t> split(uint32_t node, size_t position);
+    uint32_t merge(uint32_t left, uint32_t right);
+    bool extend_last(uint32_t root, const char* data, size_t count);
+    template <typename Visit>
+    void visit(size_t position, Visit visit) const;
+    const char* append(std::string_view text);
+};
+
+#endif // PIECETABLE_H
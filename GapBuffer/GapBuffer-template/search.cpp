@@ -0,0 +1,374 @@
+#include "search.h"
+#include <algorithm>
+
+// Unsearched stretches are read at most this many starting positions at a
+// time; neighbouring blocks are merged up to twice that.
+const size_t kSearchBlock = 64 * 1024;
+
+// Blocks with more matches than this are rechecked with one read of the
+// block instead of one read per match.
+const size_t kDenseBlock = 16;
+
+// A block whose matches are closer together than this on average keeps
+// only their count: their offsets would take a quarter of the text's size
+// or more.
+const size_t kMatchSpacing = 16;
+
+SearchSession::SearchSession(TextEditor& editor) :
+    _editor(editor),
+    _focus(0),
+    _edits_seen(editor.edit_count()),
+    _count(0),
+    _unchecked(0),
+    _stats{0, 0, 0} {}
+
+/*
+ * A query that extends the current one keeps the matches found so far,
+ * to be rechecked against the new characters by step(). Anything else
+ * starts over.
+ */
+void SearchSession::set_query(std::string_view query) {
+    catch_up();
+    if (query == _query) return;
+    bool extends = !_query.empty() && query.size() > _query.size()
+                   && query.substr(0, _query.size()) == _query;
+    _query = query;
+    if (extends) {
+        refine();
+    } else {
+        if (!_blocks.empty()) _stats.restarts++;
+        restart();
+    }
+}
+
+const std::string& SearchSession::query() const {
+    return _query;
+}
+
+// Searching continues from here, and results() lists from here.
+void SearchSession::focus(size_t position) {
+    _focus = position;
+}
+
+/*
+ * Rechecks and searches up to budget more characters, nearest the focus
+ * first. Returns true once the whole document has been searched for the
+ * current query.
+ */
+bool SearchSession::step(size_t budget) {
+    catch_up();
+    auto it = _blocks.upper_bound(_focus);
+    if (it != _blocks.begin()) --it;
+    while (budget > 0 && _unchecked > 0) {
+        if (it == _blocks.end()) it = _blocks.begin();
+        if (!current(it->second)) {
+            budget -= std::min(budget, std::max<size_t>(recheck(it->first, it->second), 1));
+        }
+        ++it;
+    }
+    size_t start, end;
+    while (budget > 0 && next_hole(start, end)) {
+        end = std::min({end, start + budget, start + kSearchBlock});
+        scan(start, end);
+        budget -= end - start;
+    }
+    return complete();
+}
+
+bool SearchSession::complete() {
+    catch_up();
+    size_t start, end;
+    return _unchecked == 0 && !next_hole(start, end);
+}
+
+/*
+ * Up to max of the matches confirmed so far into out: those at or after
+ * the focus in document order, then the ones before it. Returns how many.
+ */
+size_t SearchSession::results(std::vector<size_t>& out, size_t max) {
+    catch_up();
+    out.clear();
+    std::vector<size_t> found;
+    auto first = _blocks.upper_bound(_focus);
+    if (first != _blocks.begin()) --first;
+    for (auto it = first; it != _blocks.end() && out.size() < max; ++it) {
+        if (!current(it->second)) continue;
+        positions(it->first, it->second, found);
+        for (size_t position : found) {
+            if (out.size() == max) break;
+            if (position >= _focus) out.push_back(position);
+        }
+    }
+    for (auto it = _blocks.begin(); it != _blocks.end() && out.size() < max; ++it) {
+        if (!current(it->second)) continue;
+        positions(it->first, it->second, found);
+        for (size_t position : found) {
+            if (position >= _focus || out.size() == max) return out.size();
+            out.push_back(position);
+        }
+    }
+    return out.size();
+}
+
+size_t SearchSession::count() const {
+    return _count;
+}
+
+SearchStats SearchSession::stats() const {
+    return _stats;
+}
+
+void SearchSession::restart() {
+    _blocks.clear();
+    _count = 0;
+    _unchecked = 0;
+    _edits_seen = _editor.edit_count();
+}
+
+// Brings the blocks and the focus up to date with the editor's edits.
+void SearchSession::catch_up() {
+    std::vector<TextEdit> edits;
+    if (!_editor.edits_since(_edits_seen, edits)) {
+        if (!_blocks.empty()) _stats.restarts++;
+        restart();
+        _focus = std::min(_focus, _editor.size());
+        return;
+    }
+    _edits_seen += edits.size();
+    for (const TextEdit& edit : edits) {
+        if (!_blocks.empty()) invalidate(edit);
+        if (_focus > edit.position + edit.removed) {
+            _focus = _focus - edit.removed + edit.inserted;
+        } else if (_focus > edit.position) {
+            _focus = edit.position;
+        }
+    }
+}
+
+/*
+ * Applies one edit to the blocks. A match starting in [lo, hi) overlapped
+ * the changed text, so it is dropped and those starts are left unsearched;
+ * starts before lo keep their place and starts from hi on move by the size
+ * change. A block across [lo, hi) is split around it, unless it is dense:
+ * then its matches cannot be told apart, and the whole block is searched
+ * again.
+ */
+void SearchSession::invalidate(const TextEdit& edit) {
+    size_t reach = _query.size() - 1;
+    size_t lo = edit.position > reach ? edit.position - reach : 0;
+    size_t hi = edit.position + edit.removed;
+    auto it = _blocks.upper_bound(lo);
+    if (it != _blocks.begin() && std::prev(it)->second.end > lo) --it;
+
+    // taken out and put back afterwards, since moved keys can collide with
+    // ones not visited yet
+    std::vector<std::pair<size_t, Block>> moved;
+    while (it != _blocks.end()) {
+        size_t start = it->first;
+        Block block = std::move(it->second);
+        it = _blocks.erase(it);
+        if (start >= hi) {
+            block.end = block.end - edit.removed + edit.inserted;
+            moved.emplace_back(start - edit.removed + edit.inserted, std::move(block));
+            continue;
+        }
+        count_out(block);
+        if (dense(block)) continue;
+        if (block.end > hi) {
+            Block right{block.end - edit.removed + edit.inserted, block.checked, 0, {}};
+            size_t cut = hi - start;
+            for (uint32_t offset : block.offsets) {
+                if (offset >= cut) right.offsets.push_back(offset - cut);
+            }
+            right.matches = right.offsets.size();
+            count_in(right);
+            moved.emplace_back(edit.position + edit.inserted, std::move(right));
+        }
+        if (start < lo) {
+            size_t cut = lo - start;
+            auto end = std::lower_bound(block.offsets.begin(), block.offsets.end(), cut);
+            block.offsets.erase(end, block.offsets.end());
+            block.matches = block.offsets.size();
+            block.end = lo;
+            count_in(block);
+            _blocks.emplace(start, std::move(block));
+        }
+    }
+    for (auto& [start, block] : moved) {
+        _blocks.emplace_hint(_blocks.end(), start, std::move(block));
+    }
+}
+
+/*
+ * The query grew, so every block is now checked for less of it than it
+ * needs. Nothing is read here; step() rechecks the blocks. Dense blocks
+ * are dropped instead, since finding their matches again means reading
+ * all of their text anyway, which is just what searching them does.
+ */
+void SearchSession::refine() {
+    for (auto it = _blocks.begin(); it != _blocks.end();) {
+        it = dense(it->second) ? _blocks.erase(it) : std::next(it);
+    }
+    _count = 0;
+    _unchecked = _blocks.size();
+}
+
+/*
+ * Keeps the matches of a block that are followed by the rest of the query,
+ * and returns how many characters that read. Sparse blocks are checked
+ * match by match, dense ones with a single read.
+ */
+size_t SearchSession::recheck(size_t start, Block& block) {
+    std::string_view added = std::string_view(_query).substr(block.checked);
+    std::vector<uint32_t>& offsets = block.offsets;
+    _stats.matches_verified += offsets.size();
+    size_t read = 0;
+    size_t kept = 0;
+    if (offsets.size() > kDenseBlock) {
+        uint32_t first = offsets.front();
+        std::string text = _editor.retrieve_range(start + first + block.checked,
+                                                  offsets.back() - first + added.size());
+        read = text.size();
+        std::string_view view(text);
+        for (uint32_t offset : offsets) {
+            if (view.substr(offset - first, added.size()) == added) {
+                offsets[kept++] = offset;
+            }
+        }
+    } else {
+        for (uint32_t offset : offsets) {
+            read += added.size();
+            if (_editor.retrieve_range(start + offset + block.checked, added.size()) == added) {
+                offsets[kept++] = offset;
+            }
+        }
+    }
+    count_out(block);
+    offsets.resize(kept);
+    block.matches = kept;
+    block.checked = _query.size();
+    count_in(block);
+    return read;
+}
+
+/*
+ * The next unsearched stretch of starting positions, [start, end): the
+ * first at or after the focus, else the first before it. Positions too
+ * close to the end to fit the query count as searched.
+ */
+bool SearchSession::next_hole(size_t& start, size_t& end) {
+    size_t size = _editor.size();
+    if (_query.empty() || _query.size() > size) return false;
+    size_t limit = size - _query.size() + 1;
+    size_t focus = std::min(_focus, limit);
+
+    auto find = [this, &start, &end](size_t position, size_t stop) {
+        auto it = _blocks.upper_bound(position);
+        if (it != _blocks.begin()) {
+            position = std::max(position, std::prev(it)->second.end);
+        }
+        while (it != _blocks.end() && it->first <= position) {
+            position = std::max(position, it->second.end);
+            ++it;
+        }
+        if (position >= stop) return false;
+        start = position;
+        end = it != _blocks.end() ? std::min(it->first, stop) : stop;
+        return true;
+    };
+    return find(focus, limit) || find(0, focus);
+}
+
+// Finds the matches starting in [start, end) and records them as a block.
+void SearchSession::scan(size_t start, size_t end) {
+    std::string text = _editor.retrieve_range(start, end - start + _query.size() - 1);
+    _stats.characters_scanned += text.size();
+    std::string_view view(text);
+    Block block{end, _query.size(), 0, {}};
+    for (size_t found = view.find(_query); found < end - start; found = view.find(_query, found + 1)) {
+        block.offsets.push_back(found);
+    }
+    block.matches = block.offsets.size();
+    if (block.matches * kMatchSpacing > end - start) {
+        std::vector<uint32_t>().swap(block.offsets);
+    }
+    add_block(start, std::move(block));
+}
+
+// The positions of a block's matches, found again in its text if it is dense.
+void SearchSession::positions(size_t start, const Block& block, std::vector<size_t>& out) {
+    out.clear();
+    if (!dense(block)) {
+        for (uint32_t offset : block.offsets) {
+            out.push_back(start + offset);
+        }
+        return;
+    }
+    std::string text = _editor.retrieve_range(start, block.end - start + _query.size() - 1);
+    std::string_view view(text);
+    for (size_t found = view.find(_query); found < block.end - start; found = view.find(_query, found + 1)) {
+        out.push_back(start + found);
+    }
+}
+
+// Inserts a block, merging it with the blocks it touches while they stay
+// small and alike, so that typing does not leave a trail of tiny blocks.
+void SearchSession::add_block(size_t start, Block block) {
+    auto alike = [](const Block& left, const Block& right) {
+        return left.checked == right.checked && dense(left) == dense(right);
+    };
+    auto next = _blocks.lower_bound(start);
+    if (next != _blocks.end() && next->first == block.end
+            && next->second.end - start <= 2 * kSearchBlock && alike(block, next->second)) {
+        count_out(next->second);
+        for (uint32_t offset : next->second.offsets) {
+            block.offsets.push_back(offset + (next->first - start));
+        }
+        block.matches += next->second.matches;
+        block.end = next->second.end;
+        next = _blocks.erase(next);
+    }
+    if (next != _blocks.begin()) {
+        auto previous = std::prev(next);
+        if (previous->second.end == start && block.end - previous->first <= 2 * kSearchBlock
+                && alike(previous->second, block)) {
+            count_out(previous->second);
+            for (uint32_t offset : block.offsets) {
+                previous->second.offsets.push_back(offset + (start - previous->first));
+            }
+            previous->second.matches += block.matches;
+            previous->second.end = block.end;
+            count_in(previous->second);
+            return;
+        }
+    }
+    count_in(block);
+    _blocks.emplace_hint(next, start, std::move(block));
+}
+
+// Whether the block is checked for the whole query.
+bool SearchSession::current(const Block& block) const {
+    return block.checked == _query.size();
+}
+
+bool SearchSession::dense(const Block& block) {
+    return block.offsets.size() != block.matches;
+}
+
+// Adds the block's matches to _count if it is current, else the block to
+// _unchecked; count_out takes them away again.
+void SearchSession::count_in(const Block& block) {
+    if (current(block)) {
+        _count += block.matches;
+    } else {
+        _unchecked++;
+    }
+}
+
+void SearchSession::count_out(const Block& block) {
+    if (current(block)) {
+        _count -= block.matches;
+    } else {
+        _unchecked--;
+    }
+}
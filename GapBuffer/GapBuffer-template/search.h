@@ -0,0 +1,89 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "texteditor.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct SearchStats {
+    uint64_t characters_scanned; // read from the editor to find new matches
+    uint64_t matches_verified;   // old matches rechecked after the query grew
+    uint64_t restarts;           // times the matches found so far were thrown away
+};
+
+/*
+ * Search-as-you-type over a TextEditor. The session remembers which parts
+ * of the document it has searched and the matches found there, and keeps
+ * them as the query and the document change:
+ *
+ *  - extending the query only rechecks the matches it already has, since
+ *    every match of the longer query is a match of the shorter one; the
+ *    rechecking is left to step(), like searching. Any other change to
+ *    the query starts over.
+ *  - an edit drops the matches that overlapped it and marks that stretch
+ *    as unsearched; everything after it just moves by the size change.
+ *
+ * Searching is done in steps of a bounded number of characters, starting
+ * at the focus (the top of the viewport) and wrapping around, so results
+ * on screen come first and a huge document never stalls a keystroke.
+ * Call step() until it returns true; results() and count() cover the
+ * matches confirmed for the current query so far.
+ *
+ * Where matches are dense (a one-character query, say) a block keeps only
+ * how many it has, and results() finds them again in its text, so memory
+ * stays well below the size of the document.
+ *
+ * Use it on the thread that edits, like Viewport.
+ */
+class SearchSession {
+public:
+    explicit SearchSession(TextEditor& editor);
+
+    void set_query(std::string_view query);
+    const std::string& query() const;
+    void focus(size_t position);
+    bool step(size_t budget = 1024 * 1024);
+    bool complete();
+    size_t results(std::vector<size_t>& out, size_t max);
+    size_t count() const;
+    SearchStats stats() const;
+
+private:
+    // Every match starting in [start, end) of the query's first checked
+    // characters is known; start is the key in _blocks and offsets
+    // (sorted) are from it. A dense block has no offsets, only matches.
+    struct Block {
+        size_t end;
+        size_t checked;
+        size_t matches;
+        std::vector<uint32_t> offsets;
+    };
+
+    TextEditor& _editor;
+    std::string _query;
+    size_t _focus;
+    uint64_t _edits_seen;
+    std::map<size_t, Block> _blocks; // by start, not overlapping
+    size_t _count;                   // matches in the blocks checked for all of _query
+    size_t _unchecked;               // blocks checked for less of it
+    SearchStats _stats;
+
+    void restart();
+    void catch_up();
+    void invalidate(const TextEdit& edit);
+    void refine();
+    size_t recheck(size_t start, Block& block);
+    bool next_hole(size_t& start, size_t& end);
+    void scan(size_t start, size_t end);
+    void positions(size_t start, const Block& block, std::vector<size_t>& out);
+    void add_block(size_t start, Block block);
+    bool current(const Block& block) const;
+    static bool dense(const Block& block);
+    void count_in(const Block& block);
+    void count_out(const Block& block);
+};
+
+#endif // SEARCH_H
@@ -1,28 +1,1245 @@
 #include "texteditor.h"
+#include "journal.h"
+#include <climits> // for IOV_MAX
+#include <cstdio> // for rename
+#include <limits>
+#include <fcntl.h> // for open
+#include <sys/uio.h> // for writev, pwritev
+#include <unistd.h> // for fsync, ftruncate
 
+// The constructor loads a small first block so the first screen is ready
+// at once; the loader thread then reads big blocks.
+const size_t kFirstBlockSize = 64 * 1024;
+const size_t kLoadBlockSize = 4 * 1024 * 1024;
 
-TextEditor::TextEditor(const std::string& filename) : _buffer
+// Autosave copies the document in pieces this small, so in Locked mode it
+// never holds the shared lock for more than a few microseconds at a time.
+const size_t kSaveChunkSize = 16 * 1024;
+
+namespace {
+
+// Replaces out with up to count characters from position on in the text
+// made of segments laid end to end.
+void copy_segments(std::initializer_list<std::string_view> segments,
+                   size_t position, size_t count, std::string& out) {
+    out.clear();
+    size_t start = 0; // where the segment starts in the text
+    for (std::string_view segment : segments) {
+        if (out.size() == count) break;
+        if (position < start + segment.size()) {
+            size_t from = position > start ? position - start : 0;
+            out.append(segment.substr(from, count - out.size()));
+        }
+        start += segment.size();
+    }
+}
+
+}
+
+TextEditor::TextEditor(const std::string& filename, ReadMode mode, Storage storage) :
+    _buffer(),
+    _filename(filename),
+    _file(filename),
+    _mode(mode),
+    _sequence(0),
+    _first(nullptr),
+    _first_size(0),
+    _second(nullptr),
+    _second_size(0),
+    _tail_text(nullptr),
+    _tail_size(0),
+    _cursor(0),
+    _version(0),
+    _reader_epoch(0),
+    _epoch_readers{},
+    _retired_bytes(0),
+    _dirty_from(kClean),
+    _save_stats{0, 0, 0, 0},
+    _autosave_running(false),
+    _history_start(0),
+    _history_hold(kNoHold),
+    _edit_count(0),
+    _metrics_enabled(false),
+    _writer_locks(0),
+    _writer_contended(0),
+    _reader_locks(0),
+    _reader_contended(0),
+    _tail_capacity(0),
+    _tail_begin(0),
+    _tail_end(0),
+    _tail_filling(false),
+    _total_bytes(0),
+    _bytes_loaded(0),
+    _loading(true),
+    _stop_loading(false) {
+    if (!_file) {
+        throw std::string("TextEditor: cannot open ") + filename;
+    }
+    if (storage == Storage::Mapped) {
+        if (_mode == ReadMode::LockFree) {
+            throw std::string("TextEditor: mapped storage needs ReadMode::Locked");
+        }
+        // nothing to load: the mapping is the whole file from the start
+        _file.close();
+        _pieces = std::make_unique<PieceTable>(filename);
+        _total_bytes = _pieces->size();
+        _bytes_loaded = _total_bytes;
+        _loading = false;
+        return;
+    }
+    if (_mode == ReadMode::LockFree) {
+        // geometric growth keeps the retired storage below the live capacity
+        _buffer.set_gap_policy(GapPolicy::Doubling);
+    }
+    _file.seekg(0, std::ios::end);
+    std::streamoff file_size = _file.tellg();
+    _file.seekg(0, std::ios::beg);
+    if (file_size > 0) {
+        _total_bytes = static_cast<size_t>(file_size);
+    }
+    begin_write();
+    end_write();
+    if (load_block(kFirstBlockSize)) {
+        _loader = std::thread(&TextEditor::load_rest, this);
+    } else {
+        _loading = false;
+    }
+}
 
 TextEditor::~TextEditor() {
-    
+    stop_autosave();
+    _stop_loading = true;
+    if (_loader.joinable()) {
+        _loader.join();
+    }
+}
+
+/*
+ * Seqlock read. The view is validated before any character is touched,
+ * so the pointers always belong to one published state; the result is
+ * validated again afterwards and recomputed if the writer got in between.
+ * The reader is counted in its epoch for the whole read, so storage it
+ * may be looking at is not freed under it (see reclaim_retired).
+ */
+template <typename Read>
+auto TextEditor::read_lock_free(Read read) {
+    struct Counted {
+        std::atomic<size_t>& readers;
+        ~Counted() { readers.fetch_sub(1, std::memory_order_release); }
+    } counted{_epoch_readers[_reader_epoch.load(std::memory_order_seq_cst) % 2]};
+    counted.readers.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (true) {
+        uint64_t before = _sequence.load(std::memory_order_acquire);
+        if (before % 2 == 1) continue;
+        View view{_first.load(std::memory_order_relaxed), _first_size.load(std::memory_order_relaxed),
+                  _second.load(std::memory_order_relaxed), _second_size.load(std::memory_order_relaxed),
+                  _tail_text.load(std::memory_order_relaxed), _tail_size.load(std::memory_order_relaxed),
+                  _cursor.load(std::memory_order_relaxed)};
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_sequence.load(std::memory_order_relaxed) != before) continue;
+        auto result = read(view);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_sequence.load(std::memory_order_relaxed) == before) {
+            return result;
+        }
+    }
+}
+
+size_t TextEditor::View::size() const {
+    return first_size + second_size + tail_size;
+}
+
+char TextEditor::View::at(size_t position) const {
+    if (position < first_size) return first[position];
+    position -= first_size;
+    return position < second_size ? second[position] : tail[position - second_size];
+}
+
+// Runs edit on whatever holds the text: the piece table in Storage::Mapped,
+// else the gap buffer. Call it with the lock held.
+template <typename Edit>
+auto TextEditor::with_text(Edit edit) {
+    return _pieces ? edit(*_pieces) : edit(_buffer);
 }
 
 void TextEditor::press_left() {
-    
+    LatencyTimer timer(timed(_press_move_latency));
+    auto lock = lock_for_write();
+    with_text([&](auto& text) {
+        if (text.cursor_index() > 0) {
+            begin_write();
+            text.move_cursor(-1);
+            const Command left = Command::left();
+            log(&left, 1);
+            end_write(false);
+        }
+    });
 }
 
 void TextEditor::press_right() {
-    
+    LatencyTimer timer(timed(_press_move_latency));
+    auto lock = lock_for_write();
+    with_text([&](auto& text) {
+        if (text.cursor_index() < text.size() + tail_size()) {
+            begin_write();
+            reach(text.cursor_index() + 1);
+            text.move_cursor(1);
+            const Command right = Command::right();
+            log(&right, 1);
+            end_write(false);
+        }
+    });
 }
 
 void TextEditor::press_key(char ch) {
-    
+    LatencyTimer timer(timed(_press_key_latency));
+    auto lock = lock_for_write();
+    reserve_for(1);
+    begin_write();
+    with_text([&](auto& text) {
+        mark_dirty(text.cursor_index());
+        record_edit(text.cursor_index(), 0, 1);
+        text.insert_at_cursor(ch);
+    });
+    const Command key = Command::key(ch);
+    log(&key, 1);
+    end_write();
+}
+
+// Deletes the character before the cursor, if there is one.
+void TextEditor::press_backspace() {
+    LatencyTimer timer(timed(_press_backspace_latency));
+    auto lock = lock_for_write();
+    with_text([&](auto& text) {
+        if (text.cursor_index() == 0) return;
+        begin_write();
+        text.delete_at_cursor();
+        mark_dirty(text.cursor_index());
+        record_edit(text.cursor_index(), 1, 0);
+        const Command backspace = Command::backspace();
+        log(&backspace, 1);
+        end_write();
+    });
+}
+
+// Types text as if each character were pressed in turn, as one edit.
+// Empty text is no edit at all.
+void TextEditor::press_keys(std::string_view text) {
+    if (text.empty()) return;
+    auto lock = lock_for_write();
+    reserve_for(text.size());
+    begin_write();
+    with_text([&](auto& stored) {
+        mark_dirty(stored.cursor_index());
+        record_edit(stored.cursor_index(), 0, text.size());
+        stored.insert_at_cursor(text);
+    });
+    log(text);
+    end_write();
 }
 
+/*
+ * Appends moves that add up to delta, each small enough for delta and the
+ * journal's 32-bit field, so a jump across a huge document is not cut short.
+ */
+void Command::append_move(std::vector<Command>& commands, long long delta) {
+    constexpr long long kLongest = std::numeric_limits<int32_t>::max();
+    do {
+        long long step = std::min(std::max(delta, -kLongest), kLongest);
+        commands.push_back(Command::move(static_cast<int>(step)));
+        delta -= step;
+    } while (delta != 0);
+}
+
+// Moves like |delta| presses of left or right, stopping at either end.
+void TextEditor::move_by(int delta) {
+    apply({Command::move(delta)});
+}
+
+// Moves the cursor to position, or to the end if that is past it; for
+// positions too far off for move_by.
+void TextEditor::move_to(size_t position) {
+    std::vector<Command> commands;
+    Command::append_move(commands, static_cast<long long>(position)
+                                   - static_cast<long long>(cursor_index()));
+    apply(commands);
+}
+
+void TextEditor::apply(const std::vector<Command>& commands) {
+    apply(commands.data(), commands.size());
+}
+
+/*
+ * Applies a batch under one lock, as one edit for readers. Runs of
+ * adjacent moves collapse into a single cursor move (clamped step by step,
+ * so the result matches pressing them one by one) and runs of keys into
+ * a single bulk insert.
+ */
+void TextEditor::apply(const Command* commands, size_t count) {
+    size_t keys = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (commands[i].type == Command::Type::Key) keys++;
+    }
+    auto lock = lock_for_write();
+    reserve_for(keys);
+    begin_write();
+    bool modified = false;
+    with_text([&](auto& text) {
+        std::string run;
+        size_t i = 0;
+        while (i < count) {
+            if (commands[i].type == Command::Type::Key) {
+                run.clear();
+                for (; i < count && commands[i].type == Command::Type::Key; ++i) {
+                    run.push_back(commands[i].ch);
+                }
+                mark_dirty(text.cursor_index());
+                record_edit(text.cursor_index(), 0, run.size());
+                text.insert_at_cursor(std::string_view(run));
+                modified = true;
+            } else if (commands[i].type == Command::Type::Backspace) {
+                size_t deleted = 0;
+                for (; i < count && commands[i].type == Command::Type::Backspace; ++i) {
+                    if (text.cursor_index() > 0) {
+                        text.delete_at_cursor();
+                        deleted++;
+                    }
+                }
+                if (deleted > 0) {
+                    mark_dirty(text.cursor_index());
+                    record_edit(text.cursor_index(), deleted, 0);
+                    modified = true;
+                }
+            } else {
+                long long cursor = text.cursor_index();
+                long long size = text.size() + tail_size();
+                for (; i < count && commands[i].type == Command::Type::Move; ++i) {
+                    cursor = std::min(std::max(cursor + commands[i].delta, 0LL), size);
+                }
+                reach(static_cast<size_t>(cursor));
+                text.move_cursor(cursor - static_cast<long long>(text.cursor_index()));
+            }
+        }
+    });
+    log(commands, count);
+    end_write(modified);
+}
+
+/*
+ * Applies a batch of positioned edits from a collaborator under one lock,
+ * provided the document has had exactly edit_count edits (see
+ * edit_count()). Otherwise it changes nothing and returns false, so the
+ * caller can transform the batch against the newer edits and try again.
+ * On success edit_count is moved past the batch, which goes into the
+ * edit history as one edit per RemoteEdit.
+ *
+ * The edits must be sorted by position and must not overlap; at one
+ * position, pure inserts come before an edit that erases from there. The cursor
+ * stays next to the same character, as with GapBuffer::apply_edits. That
+ * function does the work when the edits are spread out enough that one
+ * sweep over the buffer beats moving the gap to each of them. Otherwise
+ * they are applied one at a time from the last to the first, so no
+ * position needs adjusting. The one-at-a-time path is always used for
+ * LockFree readers, whose storage must not be freed, and for a mapped
+ * document.
+ */
+bool TextEditor::apply_remote(const std::vector<RemoteEdit>& edits, uint64_t& edit_count) {
+    size_t inserted = 0;
+    for (const RemoteEdit& edit : edits) {
+        inserted += edit.insert.size();
+    }
+    auto lock = lock_for_write();
+    if (_edit_count != edit_count) return false;
+    if (edits.empty()) return true;
+    size_t size = with_text([](const auto& text) { return text.size(); }) + tail_size();
+    size_t cursor = with_text([](const auto& text) { return text.cursor_index(); });
+    size_t new_cursor = cursor;
+    size_t end = 0;
+    for (const RemoteEdit& edit : edits) {
+        if (edit.position < end) {
+            throw std::string("apply_remote: edits overlap");
+        }
+        if (edit.position > size || edit.erase > size - edit.position) {
+            throw std::string("apply_remote: edit is out of bounds");
+        }
+        end = edit.position + edit.erase;
+        if (end <= cursor) {
+            new_cursor = new_cursor - edit.erase + edit.insert.size();
+        } else if (edit.position <= cursor) {
+            new_cursor = new_cursor - (cursor - edit.position) + edit.insert.size();
+        }
+    }
+
+    reserve_for(inserted);
+    begin_write();
+    reach(end);
+    size_t lowest = edits.front().position;
+    size_t gap_travel = (cursor > end ? cursor - end : end - cursor) + (end - lowest);
+    if (!_pieces && _mode == ReadMode::Locked && 2 * gap_travel > size) {
+        std::vector<GapBuffer<char>::Edit> batch;
+        batch.reserve(edits.size());
+        for (const RemoteEdit& edit : edits) {
+            batch.push_back({edit.position, edit.erase, std::vector<char>(edit.insert.begin(), edit.insert.end())});
+        }
+        _buffer.apply_edits(std::move(batch));
+    } else {
+        with_text([&](auto& text) {
+            for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+                text.move_cursor(static_cast<long long>(edit->position + edit->erase)
+                                 - static_cast<long long>(text.cursor_index()));
+                for (size_t i = 0; i < edit->erase; ++i) {
+                    text.delete_at_cursor();
+                }
+                text.insert_at_cursor(std::string_view(edit->insert));
+            }
+            text.move_cursor(static_cast<long long>(new_cursor) - static_cast<long long>(text.cursor_index()));
+        });
+    }
+
+    // the journal gets the batch as the keystrokes that would make it
+    std::vector<Command> commands;
+    size_t replay_cursor = cursor;
+    for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+        if (edit->erase == 0 && edit->insert.empty()) continue;
+        record_edit(edit->position, edit->erase, edit->insert.size());
+        if (_journal) {
+            Command::append_move(commands, static_cast<long long>(edit->position + edit->erase)
+                                           - static_cast<long long>(replay_cursor));
+            commands.insert(commands.end(), edit->erase, Command::backspace());
+            for (char ch : edit->insert) {
+                commands.push_back(Command::key(ch));
+            }
+            replay_cursor = edit->position + edit->insert.size();
+        }
+    }
+    if (_journal) {
+        Command::append_move(commands, static_cast<long long>(new_cursor)
+                                       - static_cast<long long>(replay_cursor));
+        log(commands.data(), commands.size());
+    }
+    mark_dirty(lowest);
+    edit_count = _edit_count;
+    end_write();
+    return true;
+}
+
+// The character just after the cursor.
 char TextEditor::retrieve_next_character() {
-    
+    wait_for_position(cursor_index());
+    if (_mode == ReadMode::LockFree) {
+        bool in_bounds = true;
+        char ch = read_lock_free([&](const View& view) {
+            in_bounds = view.cursor < view.size();
+            return in_bounds ? view.at(view.cursor) : '\0';
+        });
+        if (!in_bounds) {
+            throw ("cursor: array_index is out of bounds!");
+        }
+        return ch;
+    }
+    auto lock = lock_for_read();
+    if (!_pieces && _buffer.cursor_index() == _buffer.size() && tail_size() > 0) {
+        return _tail[_tail_begin];
+    }
+    return with_text([](const auto& text) -> char { return text.get_at_cursor(); });
 }
 
 char TextEditor::retrieve_character(size_t position) {
-    
+    LatencyTimer timer(timed(_retrieve_latency));
+    wait_for_position(position);
+    if (_mode == ReadMode::LockFree) {
+        bool in_bounds = true;
+        char ch = read_lock_free([&](const View& view) {
+            in_bounds = position < view.size();
+            return in_bounds ? view.at(position) : '\0';
+        });
+        if (!in_bounds) {
+            throw ("at: pos is out of bounds!");
+        }
+        return ch;
+    }
+    auto lock = lock_for_read();
+    if (!_pieces && position >= _buffer.size() && position - _buffer.size() < tail_size()) {
+        return _tail[_tail_begin + (position - _buffer.size())];
+    }
+    return with_text([&](const auto& text) -> char { return text.at(position); });
+}
+
+// Up to count characters starting at position, as one consistent snapshot.
+std::string TextEditor::retrieve_range(size_t position, size_t count) {
+    if (count > 0) {
+        wait_for_position(position + count - 1);
+    }
+    std::string text;
+    copy_range(position, count, text);
+    return text;
+}
+
+uint64_t TextEditor::version() const {
+    return _version.load(std::memory_order_acquire);
+}
+
+/*
+ * Replaces out with up to count characters starting at position, all from
+ * one state of the document, and returns that state's version().
+ */
+uint64_t TextEditor::copy_range(size_t position, size_t count, std::string& out) {
+    if (_mode == ReadMode::LockFree) {
+        return read_lock_free([&](const View& view) {
+            copy_segments({{view.first, view.first_size}, {view.second, view.second_size},
+                           {view.tail, view.tail_size}}, position, count, out);
+            return _version.load(std::memory_order_relaxed);
+        });
+    }
+    auto lock = lock_for_read();
+    copy_text(position, count, out);
+    return _version.load(std::memory_order_relaxed);
+}
+
+// copy_range without taking the lock, for callers that hold it.
+void TextEditor::copy_text(size_t position, size_t count, std::string& out) {
+    if (_pieces) {
+        _pieces->copy(position, count, out);
+    } else {
+        auto halves = _buffer.segments();
+        copy_segments({{halves.first, halves.first_size}, {halves.second, halves.second_size},
+                       {_tail.get() + _tail_begin, tail_size()}}, position, count, out);
+    }
+}
+
+TextEditor::Reader::Reader(TextEditor& editor, size_t position, size_t chunk_size, size_t read_ahead) :
+    _editor(editor),
+    _position(position),
+    _chunk_size(std::max<size_t>(chunk_size, 1)),
+    _read_ahead(std::max<size_t>(read_ahead, 1)),
+    _offset(0),
+    _start_version(editor.version()),
+    _modified(false) {}
+
+/*
+ * The next chunk_size characters (fewer at the end), or an empty view once
+ * the document is exhausted. The view stays valid until the next call.
+ * Each refill copies read_ahead chunks under a single lock.
+ */
+std::string_view TextEditor::Reader::next_chunk() {
+    if (_offset == _window.size()) {
+        _editor.wait_for_position(_position);
+        uint64_t version = _editor.copy_range(_position, _chunk_size * _read_ahead, _window);
+        _modified = _modified || version != _start_version;
+        _offset = 0;
+    }
+    size_t length = std::min(_chunk_size, _window.size() - _offset);
+    std::string_view chunk(_window.data() + _offset, length);
+    _offset += length;
+    _position += length;
+    return chunk;
+}
+
+size_t TextEditor::Reader::position() const {
+    return _position;
+}
+
+// True if the document changed after the reader started (text still
+// arriving from the background load counts as a change).
+bool TextEditor::Reader::modified() const {
+    return _modified || _editor.version() != _start_version;
+}
+
+size_t TextEditor::size() {
+    if (_mode == ReadMode::LockFree) {
+        return read_lock_free([](const View& view) { return view.size(); });
+    }
+    auto lock = lock_for_read();
+    return with_text([](const auto& text) { return text.size(); }) + tail_size();
+}
+
+size_t TextEditor::cursor_index() {
+    if (_mode == ReadMode::LockFree) {
+        return read_lock_free([](const View& view) { return view.cursor; });
+    }
+    auto lock = lock_for_read();
+    return with_text([](const auto& text) { return text.cursor_index(); });
+}
+
+ReadMode TextEditor::read_mode() const {
+    return _mode;
+}
+
+Storage TextEditor::storage() const {
+    return _pieces ? Storage::Mapped : Storage::InMemory;
+}
+
+bool TextEditor::dirty() {
+    auto lock = lock_for_read();
+    return _dirty_from != kClean;
+}
+
+SaveStats TextEditor::save_stats() {
+    std::lock_guard<std::mutex> lock(_save_mutex);
+    return _save_stats;
+}
+
+/*
+ * Appends the edits made after edit number since (see edit_count) to out,
+ * oldest first, and returns true; or returns false if they are no longer
+ * all remembered, in which case the caller should assume the whole
+ * document changed. Each position is in the text as that edit found it.
+ */
+bool TextEditor::edits_since(uint64_t since, std::vector<TextEdit>& out) {
+    auto lock = lock_for_read();
+    if (since > _edit_count || since < _history_start) return false;
+    out.insert(out.end(), _edit_history.begin() + (since - _history_start), _edit_history.end());
+    return true;
+}
+
+/*
+ * Keeps every edit from edit number since on for edits_since, however many
+ * follow, until the hold is moved on or released; for a consumer that must
+ * not miss any. One hold at a time. Returns false if some are already
+ * forgotten.
+ */
+bool TextEditor::hold_edits(uint64_t since) {
+    auto lock = lock_for_write();
+    if (since > _edit_count || since < _history_start) return false;
+    _history_hold = since;
+    trim_history();
+    return true;
+}
+
+void TextEditor::release_edits() {
+    auto lock = lock_for_write();
+    _history_hold = kNoHold;
+    trim_history();
+}
+
+// How many edits have been made; pass it to edits_since later.
+uint64_t TextEditor::edit_count() {
+    auto lock = lock_for_read();
+    return _edit_count;
+}
+
+// Remembers that removed characters at position were replaced by inserted
+// new ones. Called under the writer lock.
+void TextEditor::record_edit(size_t position, size_t removed, size_t inserted) {
+    _edit_history.push_back({position, removed, inserted});
+    _edit_count++;
+    trim_history();
+}
+
+// Forgets the oldest edits beyond kEditHistory that are not held.
+void TextEditor::trim_history() {
+    while (_edit_history.size() > kEditHistory && _history_start < _history_hold) {
+        _edit_history.pop_front();
+        _history_start++;
+    }
+}
+
+// Everything from position on may differ from the file on disk.
+void TextEditor::mark_dirty(size_t position) {
+    _dirty_from = std::min(_dirty_from, position);
+}
+
+void TextEditor::start_autosave(std::chrono::milliseconds interval) {
+    stop_autosave();
+    _autosave_running = true;
+    _autosaver = std::thread([this, interval] {
+        std::unique_lock<std::mutex> lock(_autosave_mutex);
+        while (_autosave_running) {
+            _autosave_cv.wait_for(lock, interval);
+            if (!_autosave_running) break;
+            lock.unlock();
+            save();
+            std::shared_ptr<Journal> current = journal();
+            if (current && current->needs_checkpoint()) {
+                checkpoint();
+            }
+            lock.lock();
+        }
+    });
+}
+
+void TextEditor::stop_autosave() {
+    {
+        std::lock_guard<std::mutex> lock(_autosave_mutex);
+        _autosave_running = false;
+    }
+    _autosave_cv.notify_all();
+    if (_autosaver.joinable()) {
+        _autosaver.join();
+    }
+}
+
+/*
+ * Writes the changes since the last save back to the file. Only the dirty
+ * suffix is copied out of the buffer, in small pieces, and no lock is held
+ * while writing, so the editing thread is never held up by the disk.
+ *
+ * A short dirty suffix is patched in place (pwritev at its offset, then
+ * ftruncate). When most of the file changed, the whole document goes to a
+ * temporary file with writev and is renamed over the original, so the
+ * file is always either the old or the new version.
+ *
+ * With Storage::Mapped nothing is copied: the piece table's runs are
+ * written straight from the mapping and the add buffer, which never move.
+ * The file is always rewritten, since patching it would change the
+ * mapping under the pieces, and afterwards the table is rebuilt on the new
+ * file as a single piece, which also lets the old add buffer go.
+ *
+ * Returns false if there was nothing safe to write: the file is still
+ * loading or failed to load, an edit raced with the copy (the next save picks it up), or the
+ * write failed. Either way, nothing that was dirty is forgotten.
+ */
+bool TextEditor::save() {
+    std::lock_guard<std::mutex> save_lock(_save_mutex);
+    if (_loading || !load_progress().error.empty()) return false;
+    size_t dirty_from;
+    size_t size;
+    uint64_t version;
+    std::vector<std::string_view> runs;
+    {
+        auto lock = lock_for_write();
+        if (_dirty_from == kClean) return true;
+        size = with_text([](const auto& text) { return text.size(); }) + tail_size();
+        dirty_from = std::min(_dirty_from, size);
+        version = _version.load(std::memory_order_relaxed);
+        _dirty_from = kClean;
+        if (_pieces) {
+            runs = _pieces->runs(0);
+        }
+    }
+    auto restore = [&] {
+        auto lock = lock_for_write();
+        mark_dirty(dirty_from);
+        return false;
+    };
+
+    bool in_place = !_pieces && 2 * (size - dirty_from) < size;
+    size_t from = in_place ? dirty_from : 0;
+    std::vector<std::string> pieces;
+    if (!_pieces) {
+        Reader reader(*this, from, kSaveChunkSize, 1);
+        for (auto chunk = reader.next_chunk(); !chunk.empty(); chunk = reader.next_chunk()) {
+            pieces.emplace_back(chunk);
+        }
+        if (version != this->version()) return restore();
+        runs.assign(pieces.begin(), pieces.end());
+    }
+
+    std::vector<iovec> iovecs;
+    for (std::string_view run : runs) {
+        iovecs.push_back({const_cast<char*>(run.data()), run.size()});
+    }
+    size_t written = 0;
+    bool ok = true;
+    if (in_place) {
+        int fd = open(_filename.c_str(), O_WRONLY);
+        if (fd < 0) return restore();
+        off_t offset = from;
+        for (size_t i = 0; ok && i < iovecs.size(); i += IOV_MAX) {
+            int count = static_cast<int>(std::min<size_t>(IOV_MAX, iovecs.size() - i));
+            ssize_t result = pwritev(fd, &iovecs[i], count, offset);
+            ok = result >= 0;
+            offset += ok ? result : 0;
+            written += ok ? result : 0;
+        }
+        ok = ok && ftruncate(fd, size) == 0 && fsync(fd) == 0;
+        ok = close(fd) == 0 && ok;
+    } else {
+        std::string temp = _filename + ".autosave";
+        int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return restore();
+        for (size_t i = 0; ok && i < iovecs.size(); i += IOV_MAX) {
+            int count = static_cast<int>(std::min<size_t>(IOV_MAX, iovecs.size() - i));
+            ssize_t result = writev(fd, &iovecs[i], count);
+            ok = result >= 0;
+            written += ok ? result : 0;
+        }
+        ok = ok && fsync(fd) == 0;
+        ok = close(fd) == 0 && ok;
+        ok = ok && std::rename(temp.c_str(), _filename.c_str()) == 0;
+    }
+    if (!ok || written != size - from) return restore();
+    if (_pieces) {
+        auto lock = lock_for_write();
+        if (version == _version.load(std::memory_order_relaxed)) {
+            try {
+                auto rebuilt = std::make_unique<PieceTable>(_filename);
+                rebuilt->move_cursor(static_cast<long long>(_pieces->cursor_index()));
+                _pieces = std::move(rebuilt);
+            } catch (const std::string&) {
+                // keep editing on the old pieces; the saved file is fine
+            }
+        }
+    }
+    _save_stats.saves++;
+    _save_stats.bytes_written += written;
+    (in_place ? _save_stats.in_place_saves : _save_stats.full_rewrites)++;
+    return true;
+}
+
+LoadProgress TextEditor::load_progress() const {
+    std::lock_guard<std::mutex> lock(_load_mutex);
+    return {_bytes_loaded.load(), _total_bytes, !_loading.load(), _load_error};
+}
+
+void TextEditor::wait_until_loaded() {
+    std::unique_lock<std::mutex> lock(_load_mutex);
+    _loaded_cv.wait(lock, [this] { return !_loading.load(); });
+}
+
+/*
+ * Reads the rest of the file into the tail, which is allocated here for
+ * the size the file had when it was opened, uninitialized and without the
+ * lock held. A failure ends the load early and is reported by
+ * load_progress() rather than taking the process down with the thread.
+ */
+void TextEditor::load_rest() {
+    std::string error;
+    try {
+        if (_total_bytes > _bytes_loaded) {
+            size_t capacity = _total_bytes - _bytes_loaded;
+            std::unique_ptr<char[]> tail(new char[capacity]);
+            auto lock = lock_for_write();
+            _tail = std::move(tail);
+            _tail_capacity = capacity;
+            _tail_filling = true;
+        }
+        while (!_stop_loading && load_block(kLoadBlockSize)) {}
+    } catch (const std::string& message) {
+        error = message;
+    } catch (const std::exception& exception) {
+        error = std::string("load_rest: ") + exception.what();
+    }
+    {
+        auto lock = lock_for_write();
+        begin_write();
+        _tail_filling = false;
+        release_tail();
+        end_write(false);
+    }
+    {
+        std::lock_guard<std::mutex> lock(_load_mutex);
+        _load_error = error;
+        _loading = false;
+    }
+    _loaded_cv.notify_all();
+}
+
+/*
+ * Reads and appends up to block_size bytes. Returns false at end of file.
+ * Blocks go straight into the tail while it has room; a file that grew
+ * since it was opened, or whose size was unknown, has the rest appended to
+ * the buffer instead, through a string.
+ */
+bool TextEditor::load_block(size_t block_size) {
+    size_t room = _tail_capacity - _tail_end;
+    size_t count;
+    if (room > 0) {
+        block_size = std::min(block_size, room);
+        _file.read(_tail.get() + _tail_end, block_size);
+        count = static_cast<size_t>(_file.gcount());
+        if (count > 0) {
+            append_loaded(nullptr, count);
+        }
+    } else {
+        std::string block(block_size, '\0');
+        _file.read(&block[0], block_size);
+        count = static_cast<size_t>(_file.gcount());
+        if (count > 0) {
+            append_loaded(block.data(), count);
+        }
+    }
+    if (_file.bad()) {
+        throw std::string("load_block: cannot read ") + _filename;
+    }
+    return count == block_size;
+}
+
+/*
+ * Appends loaded text at the end of the document, leaving the cursor
+ * alone. A null text means the loader already read count bytes into the
+ * tail, which only has to be extended. Otherwise the tail, if any, goes
+ * into the buffer first, and the text after it.
+ */
+void TextEditor::append_loaded(const char* text, size_t count) {
+    {
+        auto lock = lock_for_write();
+        if (text) {
+            reserve_for(tail_size() + count);
+        }
+        begin_write();
+        record_edit(_buffer.size() + tail_size(), 0, count);
+        if (text) {
+            reach(_buffer.size() + tail_size());
+            long long cursor = _buffer.cursor_index();
+            _buffer.move_cursor(static_cast<long long>(_buffer.size()) - cursor);
+            _buffer.insert_at_cursor(std::string_view(text, count));
+            _buffer.move_cursor(cursor - static_cast<long long>(_buffer.size()));
+        } else {
+            _tail_end += count;
+        }
+        end_write();
+    }
+    {
+        std::lock_guard<std::mutex> lock(_load_mutex);
+        _bytes_loaded += count;
+    }
+    _loaded_cv.notify_all();
+}
+
+size_t TextEditor::tail_size() const {
+    return _tail_end - _tail_begin;
+}
+
+/*
+ * Moves the tail into the buffer if position lies past the buffer's end,
+ * so the cursor can go there. That costs what moving the gap across the
+ * tail would. Call it between begin_write and end_write.
+ */
+void TextEditor::reach(size_t position) {
+    if (position <= _buffer.size() || tail_size() == 0) return;
+    reserve_for(tail_size());
+    if (_mode == ReadMode::Locked) {
+        _buffer.reserve(_buffer.size() + tail_size() + kDefaultSize);
+    }
+    long long cursor = _buffer.cursor_index();
+    _buffer.move_cursor(static_cast<long long>(_buffer.size()) - cursor);
+    _buffer.insert_at_cursor(std::string_view(_tail.get() + _tail_begin, tail_size()));
+    _buffer.move_cursor(cursor - static_cast<long long>(_buffer.size()));
+    _tail_begin = _tail_end;
+    release_tail();
+}
+
+// Frees the tail once it is empty and the loader is done with it.
+void TextEditor::release_tail() {
+    if (!_tail || _tail_filling || tail_size() > 0) return;
+    if (_mode == ReadMode::LockFree) {
+        retire(std::move(_tail), _tail_capacity);
+    }
+    _tail.reset();
+    _tail_capacity = 0;
+    _tail_begin = 0;
+    _tail_end = 0;
+}
+
+// Blocks until position exists or the whole file is in.
+void TextEditor::wait_for_position(size_t position) {
+    if (!_loading || position < size()) return;
+    std::unique_lock<std::mutex> lock(_load_mutex);
+    _loaded_cv.wait(lock, [&] { return !_loading.load() || position < size(); });
+}
+
+/*
+ * Makes room for count more characters without freeing storage that a
+ * lock-free reader may be reading. The current buffer is retired intact
+ * and the editor continues on a grown copy.
+ */
+void TextEditor::reserve_for(size_t count) {
+    if (_mode != ReadMode::LockFree || _buffer.size() + count <= _buffer.capacity()) {
+        return;
+    }
+    auto retired = std::make_unique<GapBuffer<char>>(std::move(_buffer));
+    GapBuffer<char> grown(*retired);
+    grown.reserve(std::max(2 * grown.capacity(), grown.size() + count));
+    _buffer = std::move(grown);
+    retire(std::move(retired));
+}
+
+// Keeps buffer until no lock-free reader can be looking at it. Called
+// under the writer lock, before end_write publishes its replacement.
+void TextEditor::retire(std::unique_ptr<GapBuffer<char>> buffer) {
+    size_t bytes = buffer->capacity();
+    _retired_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    _retired.push_back({std::move(buffer), nullptr, bytes, _reader_epoch.load(std::memory_order_relaxed)});
+}
+
+void TextEditor::retire(std::unique_ptr<char[]> tail, size_t bytes) {
+    _retired_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    _retired.push_back({nullptr, std::move(tail), bytes, _reader_epoch.load(std::memory_order_relaxed)});
+}
+
+/*
+ * Frees the retired buffers no reader can still see, without waiting for
+ * any reader. Called by end_write, after the replacement is published.
+ *
+ * Readers count themselves in the slot of the epoch they start in. The
+ * epoch only advances once the other slot, the one new readers will then
+ * join, has drained. So when that slot is empty again, every reader that
+ * started before the last advance has finished, and everything retired
+ * before it was already unpublished then: it can go. A reader counted too
+ * late for the writer to see is ordered after the publication by the
+ * fences on both sides, so it only ever sees the replacement. Readers
+ * that keep arriving join the new slot, so the old one always drains.
+ */
+void TextEditor::reclaim_retired() {
+    if (_retired.empty()) return;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t epoch = _reader_epoch.load(std::memory_order_relaxed);
+    if (_epoch_readers[(epoch + 1) % 2].load(std::memory_order_acquire) != 0) return;
+    auto kept = std::remove_if(_retired.begin(), _retired.end(), [&](Retired& retired) {
+        if (retired.epoch >= epoch) return false;
+        _retired_bytes.fetch_sub(retired.bytes, std::memory_order_relaxed);
+        retired.buffer.reset();
+        retired.tail.reset();
+        return true;
+    });
+    _retired.erase(kept, _retired.end());
+    if (!_retired.empty()) {
+        _reader_epoch.store(epoch + 1, std::memory_order_seq_cst);
+    }
+}
+
+void TextEditor::begin_write() {
+    if (_mode != ReadMode::LockFree) return;
+    _sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+// Publishes the buffer's current halves, the tail and the cursor to
+// lock-free readers.
+// modified is false for edits that only moved the cursor.
+void TextEditor::end_write(bool modified) {
+    if (modified) {
+        _version.fetch_add(1, std::memory_order_release);
+    }
+    if (_mode != ReadMode::LockFree) return;
+    auto halves = _buffer.segments();
+    _first.store(halves.first, std::memory_order_relaxed);
+    _first_size.store(halves.first_size, std::memory_order_relaxed);
+    _second.store(halves.second, std::memory_order_relaxed);
+    _second_size.store(halves.second_size, std::memory_order_relaxed);
+    _tail_text.store(_tail.get() + _tail_begin, std::memory_order_relaxed);
+    _tail_size.store(tail_size(), std::memory_order_relaxed);
+    _cursor.store(_buffer.cursor_index(), std::memory_order_relaxed);
+    _sequence.store(_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    reclaim_retired();
+}
+
+// Records an edit in the journal, if one is running. Called under the
+// writer lock, so the log order is the order the edits were made in.
+void TextEditor::log(const Command* commands, size_t count) {
+    if (_journal) {
+        _journal->append(commands, count);
+    }
+}
+
+void TextEditor::log(std::string_view text) {
+    if (_journal) {
+        _journal->append(text);
+    }
+}
+
+std::shared_ptr<Journal> TextEditor::journal() {
+    auto lock = lock_for_read();
+    return _journal;
+}
+
+void TextEditor::start_journal(const std::string& path) {
+    start_journal(path, JournalOptions());
+}
+
+/*
+ * Starts logging edits to a new journal at path (see Journal), beginning
+ * with a checkpoint of the whole document. Waits for the file to finish
+ * loading first, since loaded text is not logged.
+ */
+void TextEditor::start_journal(const std::string& path, const JournalOptions& options) {
+    stop_journal();
+    wait_until_loaded();
+    auto started = std::make_shared<Journal>(path, options);
+    {
+        auto lock = lock_for_write();
+        _journal = started;
+    }
+    write_checkpoint(true);
+}
+
+// Stops logging after writing out everything logged so far.
+void TextEditor::stop_journal() {
+    std::shared_ptr<Journal> stopped;
+    {
+        auto lock = lock_for_write();
+        stopped.swap(_journal);
+    }
+    if (stopped) {
+        stopped->wait_durable(stopped->last_lsn());
+    }
+}
+
+// Blocks until every edit made so far is durable. True if there is no journal.
+bool TextEditor::sync() {
+    std::shared_ptr<Journal> current = journal();
+    return !current || current->wait_durable(current->last_lsn());
+}
+
+/*
+ * Writes the whole document to the journal's checkpoint and cuts the log
+ * down to what came after it. The autosaver calls this when the log grows
+ * past JournalOptions::checkpoint_bytes. The document is copied in small
+ * chunks, like save() does, so the shared lock is never held for long;
+ * every edit and cursor move is logged, so an unchanged last LSN means no
+ * edit came between the chunks. Returns false if one did (the next call
+ * tries again) or if no journal is running.
+ */
+bool TextEditor::checkpoint() {
+    return write_checkpoint(false);
+}
+
+// With force set, a copy that raced with edits is taken again under the
+// shared lock, so there is always a checkpoint to recover from.
+bool TextEditor::write_checkpoint(bool force) {
+    std::shared_ptr<Journal> current;
+    uint64_t lsn;
+    {
+        auto lock = lock_for_read();
+        if (!_journal) return false;
+        current = _journal;
+        lsn = current->last_lsn();
+    }
+    std::string text;
+    Reader reader(*this, 0, kSaveChunkSize, 1);
+    for (auto chunk = reader.next_chunk(); !chunk.empty(); chunk = reader.next_chunk()) {
+        text.append(chunk);
+    }
+    size_t cursor;
+    {
+        auto lock = lock_for_read();
+        if (_journal != current) return false;
+        if (current->last_lsn() != lsn) {
+            if (!force) return false;
+            lsn = current->last_lsn();
+            copy_text(0, std::string::npos, text);
+        }
+        cursor = with_text([](const auto& stored) { return stored.cursor_index(); });
+    }
+    return current->write_checkpoint(text, cursor, lsn);
+}
+
+/*
+ * Replaces the document with the state recovered from the journal at path:
+ * its last checkpoint with the logged edits after it replayed as one
+ * batch. Returns false, leaving the document alone, if there is nothing
+ * to recover. Call it before start_journal, which discards the old journal.
+ */
+bool TextEditor::restore_journal(const std::string& path) {
+    if (journal()) {
+        throw std::string("TextEditor: cannot restore while a journal is running");
+    }
+    JournalRecovery recovery = Journal::recover(path);
+    if (!recovery.found) return false;
+    wait_until_loaded();
+    {
+        auto lock = lock_for_write();
+        size_t old_size = with_text([](const auto& text) { return text.size(); }) + tail_size();
+        _tail_begin = _tail_end;
+        release_tail();
+        if (_mode == ReadMode::LockFree) {
+            // readers may still be looking at the old text
+            retire(std::make_unique<GapBuffer<char>>(std::move(_buffer)));
+        }
+        begin_write();
+        if (_pieces) {
+            _pieces->clear();
+        } else {
+            _buffer = GapBuffer<char>();
+            if (_mode == ReadMode::LockFree) {
+                _buffer.set_gap_policy(GapPolicy::Doubling);
+            }
+            _buffer.reserve(recovery.text.size() + kDefaultSize);
+        }
+        with_text([&](auto& text) {
+            text.insert_at_cursor(std::string_view(recovery.text));
+            size_t cursor = std::min(recovery.cursor, text.size());
+            text.move_cursor(static_cast<long long>(cursor) - static_cast<long long>(text.size()));
+            mark_dirty(0);
+            record_edit(0, old_size, text.size());
+        });
+        end_write();
+    }
+    apply(recovery.commands);
+    return true;
+}
+
+/*
+ * Takes the writer lock, counting the acquisition and whether it had to
+ * wait. A high contended count with a long lock wait tail means readers
+ * are starving the writer.
+ */
+std::unique_lock<std::shared_mutex> TextEditor::lock_for_write() {
+    _writer_locks.fetch_add(1, std::memory_order_relaxed);
+    std::unique_lock<std::shared_mutex> lock(_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        _writer_contended.fetch_add(1, std::memory_order_relaxed);
+        LatencyTimer timer(timed(_writer_wait_latency));
+        lock.lock();
+    } else if (LatencyHistogram* wait = timed(_writer_wait_latency)) {
+        wait->record(0);
+    }
+    return lock;
+}
+
+std::shared_lock<std::shared_mutex> TextEditor::lock_for_read() {
+    _reader_locks.fetch_add(1, std::memory_order_relaxed);
+    std::shared_lock<std::shared_mutex> lock(_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        _reader_contended.fetch_add(1, std::memory_order_relaxed);
+        LatencyTimer timer(timed(_reader_wait_latency));
+        lock.lock();
+    } else if (LatencyHistogram* wait = timed(_reader_wait_latency)) {
+        wait->record(0);
+    }
+    return lock;
+}
+
+// histogram if timings are being recorded, else null (see LatencyTimer).
+LatencyHistogram* TextEditor::timed(LatencyHistogram& histogram) {
+    return _metrics_enabled.load(std::memory_order_relaxed) ? &histogram : nullptr;
+}
+
+/*
+ * Turns latency recording on or off. Off by default: recording costs two
+ * clock reads per operation. The lock counters are always kept.
+ */
+void TextEditor::enable_metrics(bool enabled) {
+    _metrics_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+EditorMetrics TextEditor::metrics() const {
+    return {_press_key_latency.snapshot(), _press_move_latency.snapshot(),
+            _press_backspace_latency.snapshot(), _retrieve_latency.snapshot(), _writer_wait_latency.snapshot(),
+            _reader_wait_latency.snapshot(),
+            _writer_locks.load(std::memory_order_relaxed),
+            _writer_contended.load(std::memory_order_relaxed),
+            _reader_locks.load(std::memory_order_relaxed),
+            _reader_contended.load(std::memory_order_relaxed),
+            _retired_bytes.load(std::memory_order_relaxed)};
+}
+
+// metrics() as one JSON object, for dumping to a log or a monitoring agent.
+std::string TextEditor::metrics_json() const {
+    return "{\"press_key\":" + _press_key_latency.to_json() +
+           ",\"press_move\":" + _press_move_latency.to_json() +
+           ",\"press_backspace\":" + _press_backspace_latency.to_json() +
+           ",\"retrieve_character\":" + _retrieve_latency.to_json() +
+           ",\"writer_lock_wait\":" + _writer_wait_latency.to_json() +
+           ",\"reader_lock_wait\":" + _reader_wait_latency.to_json() +
+           ",\"locks\":{\"writer\":" + std::to_string(_writer_locks.load(std::memory_order_relaxed)) +
+           ",\"writer_contended\":" + std::to_string(_writer_contended.load(std::memory_order_relaxed)) +
+           ",\"reader\":" + std::to_string(_reader_locks.load(std::memory_order_relaxed)) +
+           ",\"reader_contended\":" + std::to_string(_reader_contended.load(std::memory_order_relaxed)) +
+           "},\"retired_bytes\":" + std::to_string(_retired_bytes.load(std::memory_order_relaxed)) +
+           "}";
+}
+
+void TextEditor::reset_metrics() {
+    for (LatencyHistogram* histogram : {&_press_key_latency, &_press_move_latency,
+                                        &_press_backspace_latency, &_retrieve_latency,
+                                        &_writer_wait_latency, &_reader_wait_latency}) {
+        histogram->reset();
+    }
+    for (std::atomic<uint64_t>* counter : {&_writer_locks, &_writer_contended,
+                                           &_reader_locks, &_reader_contended}) {
+        counter->store(0, std::memory_order_relaxed);
+    }
 }
@@ -2,13 +2,140 @@
 #define TEXTEDITOR_H
 
 #include "GapBuffer.h"
-#include <ifstream>
+#include "latencyhistogram.h"
+#include "piecetable.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
+class Journal;
+struct JournalOptions;
 
+// How readers synchronize with the editing thread.
+// Locked: readers take the shared_mutex in shared mode.
+// LockFree: readers take no locks and never block the writer; they read a
+// published view of the buffer under a seqlock and retry if an edit raced
+// with them.
+enum class ReadMode { Locked, LockFree };
+
+// Where the text is kept.
+// InMemory: the file is read into a GapBuffer, in the background.
+// Mapped: the file is mapped with mmap and edits go into a PieceTable on
+// top of it, so opening is instant and memory use grows with the edits,
+// not the file. For files too big to hold in RAM. Locked reads only.
+enum class Storage { InMemory, Mapped };
+
+// How far the background load has got. total_bytes is 0 if the file size
+// could not be determined up front. If the load failed, done is set and
+// error says why; the document then holds only what was read before.
+struct LoadProgress {
+    size_t bytes_loaded;
+    size_t total_bytes;
+    bool done;
+    std::string error;
+};
+
+// One editor command for TextEditor::apply.
+struct Command {
+    enum class Type { Key, Move, Backspace };
+    Type type;
+    char ch;   // Key: the character typed
+    int delta; // Move: cursor movement, negative is left
+
+    static Command key(char ch) { return {Type::Key, ch, 0}; }
+    static Command left() { return {Type::Move, '\0', -1}; }
+    static Command right() { return {Type::Move, '\0', 1}; }
+    static Command move(int delta) { return {Type::Move, '\0', delta}; }
+    static Command backspace() { return {Type::Backspace, '\0', 0}; }
+    static void append_move(std::vector<Command>& commands, long long delta);
+};
+
+// One change to the text: removed characters at position were replaced
+// by inserted new ones.
+struct TextEdit {
+    size_t position;
+    size_t removed;
+    size_t inserted;
+};
+
+// One positioned edit for apply_remote, as a collaborator sends it: erase
+// characters at position, then insert insert there. Positions are in the
+// text as it was before the batch.
+struct RemoteEdit {
+    size_t position;
+    size_t erase;
+    std::string insert;
+};
+
+// What save() has written so far. A save either patches the changed tail
+// of the file in place or rewrites the whole file.
+struct SaveStats {
+    size_t saves;
+    size_t bytes_written;
+    size_t in_place_saves;
+    size_t full_rewrites;
+};
+
+// Timings in ns (all empty unless enabled) and shared_mutex counters: how
+// often each side took the lock and how often it had to wait for it.
+struct EditorMetrics {
+    LatencySnapshot press_key;
+    LatencySnapshot press_move; // press_left and press_right
+    LatencySnapshot press_backspace;
+    LatencySnapshot retrieve_character;
+    LatencySnapshot writer_lock_wait;
+    LatencySnapshot reader_lock_wait;
+    uint64_t writer_locks;
+    uint64_t writer_contended;
+    uint64_t reader_locks;
+    uint64_t reader_contended;
+    uint64_t retired_bytes; // LockFree storage kept until readers move past it
+};
+
+/*
+ * The constructor reads the first block of the file itself, so the first
+ * screenful is there as soon as it returns, and leaves the rest to a
+ * background thread that appends it in large blocks. Reads past the loaded
+ * text block until it arrives; edits work on what is loaded so far.
+ */
 class TextEditor {
 public:
-    TextEditor(const std::string& filename);
+    /*
+     * Sequential reader for linear consumers (save, search, tokenizers).
+     * Hands out the document in chunks, copying read_ahead chunks at a time
+     * under one lock instead of taking a lock per character. modified()
+     * tells cheaply whether the document changed while reading.
+     */
+    class Reader {
+    public:
+        explicit Reader(TextEditor& editor, size_t position = 0,
+                        size_t chunk_size = 64 * 1024, size_t read_ahead = 4);
+        std::string_view next_chunk();
+        size_t position() const;
+        bool modified() const;
+
+    private:
+        TextEditor& _editor;
+        size_t _position;   // document position of the next chunk
+        size_t _chunk_size;
+        size_t _read_ahead;
+        std::string _window; // read-ahead copy
+        size_t _offset;      // next chunk's offset in _window
+        uint64_t _start_version;
+        bool _modified;
+    };
+
+    explicit TextEditor(const std::string& filename, ReadMode mode = ReadMode::Locked,
+                        Storage storage = Storage::InMemory);
     ~TextEditor();
     TextEditor(const TextEditor& other) = delete;
     TextEditor& operator=(const TextEditor& rhs) = delete;
@@ -18,14 +145,183 @@ public:
     void press_left();
     void press_right();
     void press_key(char ch);
+    void press_backspace();
+    void press_keys(std::string_view text);
+    void move_by(int delta);
+    void move_to(size_t position);
+    void apply(const Command* commands, size_t count);
+    void apply(const std::vector<Command>& commands);
+    bool apply_remote(const std::vector<RemoteEdit>& edits, uint64_t& edit_count);
     char retrieve_next_character();
     char retrieve_character(size_t position);
+    std::string retrieve_range(size_t position, size_t count);
+    size_t size();
+    size_t cursor_index();
+    ReadMode read_mode() const;
+    Storage storage() const;
+    uint64_t version() const;
+    LoadProgress load_progress() const;
+    void wait_until_loaded();
+    uint64_t edit_count();
+    bool edits_since(uint64_t since, std::vector<TextEdit>& out);
+    bool hold_edits(uint64_t since);
+    void release_edits();
+
+    // Saving. The autosaver calls save() every interval on its own thread.
+    bool save();
+    bool dirty();
+    SaveStats save_stats();
+    void start_autosave(std::chrono::milliseconds interval);
+    void stop_autosave();
+
+    // Crash recovery. While a journal runs every edit is logged to it, and
+    // sync() waits until everything logged so far is on disk.
+    void start_journal(const std::string& path);
+    void start_journal(const std::string& path, const JournalOptions& options);
+    void stop_journal();
+    bool sync();
+    bool checkpoint();
+    bool restore_journal(const std::string& path);
+
+    // Instrumentation.
+    void enable_metrics(bool enabled);
+    EditorMetrics metrics() const;
+    std::string metrics_json() const;
+    void reset_metrics();
 
 private:
+    // What a lock-free reader sees: the buffer's two halves, the loaded
+    // text not yet moved into the buffer, and the cursor.
+    struct View {
+        const char* first;
+        size_t first_size;
+        const char* second;
+        size_t second_size;
+        const char* tail;
+        size_t tail_size;
+        size_t cursor;
+
+        size_t size() const;
+        char at(size_t position) const;
+    };
+
+    static constexpr size_t kClean = GapBuffer<char>::npos;
+    static constexpr size_t kEditHistory = 256;
+    static constexpr uint64_t kNoHold = UINT64_MAX;
+
     GapBuffer<char> _buffer;
+    std::unique_ptr<PieceTable> _pieces; // holds the text instead in Storage::Mapped
+    std::string _filename;
     std::ifstream _file;
-    std::shared_mutex _mutex;
-    
+    std::shared_mutex _mutex; // serializes writers; Locked readers share it
+    const ReadMode _mode;
+
+    // LockFree state. The writer makes _sequence odd while it edits, then
+    // republishes the view and makes it even again.
+    std::atomic<uint64_t> _sequence;
+    std::atomic<const char*> _first;
+    std::atomic<size_t> _first_size;
+    std::atomic<const char*> _second;
+    std::atomic<size_t> _second_size;
+    std::atomic<const char*> _tail_text;
+    std::atomic<size_t> _tail_size;
+    std::atomic<size_t> _cursor;
+    std::atomic<uint64_t> _version; // bumped by every edit to the contents
+    // Storage a reader may still be looking at after the buffer grew,
+    // tagged with the reader epoch it was retired in. Readers count
+    // themselves in _epoch_readers[epoch % 2] for the epoch they start in.
+    struct Retired {
+        std::unique_ptr<GapBuffer<char>> buffer;
+        std::unique_ptr<char[]> tail;
+        size_t bytes;
+        uint64_t epoch;
+    };
+    std::vector<Retired> _retired;
+    std::atomic<uint64_t> _reader_epoch;
+    std::atomic<size_t> _epoch_readers[2];
+    std::atomic<uint64_t> _retired_bytes;
+
+    // Saving. _dirty_from is the first position that may differ from the
+    // file (kClean if none); it is guarded by _mutex like the buffer.
+    size_t _dirty_from;
+    std::mutex _save_mutex; // one save at a time; guards _save_stats
+    SaveStats _save_stats;
+    bool _autosave_running;
+    std::mutex _autosave_mutex;
+    std::condition_variable _autosave_cv;
+    std::thread _autosaver;
+    std::shared_ptr<Journal> _journal; // guarded by _mutex
+
+    // The last kEditHistory edits, and every edit from _history_hold on.
+    // _edit_history.front() is edit number _history_start.
+    std::deque<TextEdit> _edit_history;
+    uint64_t _history_start;
+    uint64_t _history_hold;
+    uint64_t _edit_count;
+
+    // Instrumentation, updated without locks.
+    std::atomic<bool> _metrics_enabled;
+    LatencyHistogram _press_key_latency;
+    LatencyHistogram _press_move_latency;
+    LatencyHistogram _press_backspace_latency;
+    LatencyHistogram _retrieve_latency;
+    LatencyHistogram _writer_wait_latency;
+    LatencyHistogram _reader_wait_latency;
+    std::atomic<uint64_t> _writer_locks;
+    std::atomic<uint64_t> _writer_contended;
+    std::atomic<uint64_t> _reader_locks;
+    std::atomic<uint64_t> _reader_contended;
+
+    // The document is _buffer followed by _tail[_tail_begin, _tail_end):
+    // text the loader read straight into storage of its own, so appending
+    // a block never moves the gap. It goes into the buffer only when the
+    // cursor or an edit goes past the buffer's end. These are guarded by
+    // _mutex; only the loader writes past _tail_end, and it does so without.
+    std::unique_ptr<char[]> _tail;
+    size_t _tail_capacity;
+    size_t _tail_begin;
+    size_t _tail_end;
+    bool _tail_filling; // the loader may still read into _tail
+
+    // Background load. Readers waiting for text wait on _loaded_cv.
+    size_t _total_bytes;
+    std::atomic<size_t> _bytes_loaded;
+    std::atomic<bool> _loading;
+    std::atomic<bool> _stop_loading;
+    std::string _load_error; // guarded by _load_mutex
+    mutable std::mutex _load_mutex;
+    std::condition_variable _loaded_cv;
+    std::thread _loader;
+
+    void load_rest();
+    bool load_block(size_t block_size);
+    void append_loaded(const char* text, size_t count);
+    size_t tail_size() const;
+    void reach(size_t position);
+    void release_tail();
+    void wait_for_position(size_t position);
+    void mark_dirty(size_t position);
+    void record_edit(size_t position, size_t removed, size_t inserted);
+    void trim_history();
+    void log(const Command* commands, size_t count);
+    void log(std::string_view text);
+    std::shared_ptr<Journal> journal();
+    std::unique_lock<std::shared_mutex> lock_for_write();
+    std::shared_lock<std::shared_mutex> lock_for_read();
+    LatencyHistogram* timed(LatencyHistogram& histogram);
+    void reserve_for(size_t count);
+    void retire(std::unique_ptr<GapBuffer<char>> buffer);
+    void retire(std::unique_ptr<char[]> tail, size_t bytes);
+    void reclaim_retired();
+    void begin_write();
+    void end_write(bool modified = true);
+    uint64_t copy_range(size_t position, size_t count, std::string& out);
+    void copy_text(size_t position, size_t count, std::string& out);
+    bool write_checkpoint(bool force);
+    template <typename Read>
+    auto read_lock_free(Read read);
+    template <typename Edit>
+    auto with_text(Edit edit);
 };
 
 #endif // TEXTEDITOR_H
@@ -0,0 +1,108 @@
+#include "threadpool.h"
+#include <algorithm>
+
+namespace {
+
+// The pool and worker the current thread belongs to, if any.
+thread_local WorkStealingPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+}
+
+WorkStealingPool::WorkStealingPool(size_t threads) :
+    _queued(0),
+    _next(0),
+    _steals(0),
+    _stopping(false) {
+    threads = std::max<size_t>(threads, 1);
+    for (size_t i = 0; i < threads; ++i) {
+        _workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        _threads.emplace_back(&WorkStealingPool::run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    shutdown();
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+    size_t index = current_pool == this ? current_worker
+                                        : _next.fetch_add(1, std::memory_order_relaxed) % _workers.size();
+    // count it first, so a worker that sees the count keeps looking until it
+    // finds the task instead of going back to sleep
+    _queued.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(_workers[index]->mutex);
+        _workers[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+    }
+    _sleep_cv.notify_one();
+}
+
+// Runs everything already queued (and whatever that submits), then joins.
+void WorkStealingPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+        _stopping = true;
+    }
+    _sleep_cv.notify_all();
+    for (auto& thread : _threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+size_t WorkStealingPool::size() const {
+    return _workers.size();
+}
+
+uint64_t WorkStealingPool::steals() const {
+    return _steals.load(std::memory_order_relaxed);
+}
+
+// Takes the oldest task from worker index's own deque, or else the newest
+// from another worker's.
+bool WorkStealingPool::take(size_t index, std::function<void()>& task) {
+    {
+        Worker& own = *_workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < _workers.size(); ++i) {
+        Worker& victim = *_workers[(index + i) % _workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            _steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(size_t index) {
+    current_pool = this;
+    current_worker = index;
+    std::function<void()> task;
+    while (true) {
+        if (take(index, task)) {
+            _queued.fetch_sub(1);
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_sleep_mutex);
+        _sleep_cv.wait(lock, [this] { return _queued.load() > 0 || _stopping; });
+        if (_stopping && _queued.load() == 0) return;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed-size thread pool with a task deque per worker. A task submitted
+ * from a worker goes on that worker's own deque, one submitted from
+ * outside goes round-robin; a worker with nothing to do steals from the
+ * other end of someone else's deque. Workers take their own tasks in FIFO
+ * order, so a task that keeps resubmitting itself still lets the tasks
+ * queued before it run.
+ */
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(size_t threads);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool& other) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool& rhs) = delete;
+
+    void submit(std::function<void()> task);
+    void shutdown();
+    size_t size() const;
+    uint64_t steals() const;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<long> _queued; // tasks submitted and not yet taken
+    std::atomic<size_t> _next; // round-robin target for outside submits
+    std::atomic<uint64_t> _steals;
+    bool _stopping;            // guarded by _sleep_mutex
+    std::mutex _sleep_mutex;
+    std::condition_variable _sleep_cv;
+    std::vector<std::thread> _threads;
+
+    void run(size_t index);
+    bool take(size_t index, std::function<void()>& task);
+};
+
+#endif // THREADPOOL_H
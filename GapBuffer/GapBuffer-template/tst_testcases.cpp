@@ -6,10 +6,27 @@
 
 #include <QtTest>
 #include "GapBuffer.h"
+#include "GapBufferSoA.h"
+#include "SharedGapBuffer.h"
+#include "texteditor.h"
+#include "journal.h"
+#include "documentmanager.h"
+#include "viewport.h"
+#include "search.h"
+#include "collab.h"
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <deque>
 #include <chrono>
 #include <sstream>
+#include <string>
+#include <unordered_set>
+#include <random>
+#include <thread>
+#include <fstream>
+#include <cctype>
+#include <sys/wait.h>
 using namespace std;
 
 // add necessary includes here
@@ -80,6 +97,69 @@ private slots:
     void TEST9A_emplace_basic();
     void TEST9B_edge();
     void TEST9C_emplace_time();
+
+    void TEST10A_nothrow_move_swap();
+    void TEST10B_vector_growth_moves();
+
+    void TEST11A_apply_edits_basic();
+    void TEST11B_apply_edits_cursor();
+    void TEST11C_apply_edits_invalid();
+    void TEST11D_apply_edits_time();
+
+    void TEST12A_contiguous_view_basic();
+    void TEST12B_contiguous_view_cached();
+
+    void TEST13A_content_hash_incremental();
+    void TEST13B_content_hash_mutable_access();
+    void TEST13C_content_hash_unordered_set();
+    void TEST13D_content_hash_inequality_time();
+
+    void TEST14A_soa_basic();
+    void TEST14B_soa_column_scan();
+
+    void TEST15A_marker_gravity();
+    void TEST15B_marker_erase();
+    void TEST15C_marker_apply_edits();
+    void TEST15D_marker_many_time();
+    void TEST16A_gap_stats();
+    void TEST16B_adaptive_append_reallocations();
+    void TEST16C_adaptive_rare_edit_slack();
+    void TEST17A_shared_basic();
+    void TEST17B_shared_concurrent_reader();
+    void TEST17C_shared_other_process();
+    void TEST18A_char_find_compare();
+    void TEST18B_string_insert_time();
+    void TEST19A_editor_basic();
+    void TEST19B_editor_lock_free_readers();
+    void TEST20A_editor_streaming_load();
+    void TEST21A_editor_batch_commands();
+    void TEST21B_editor_paste_time();
+    void TEST22A_editor_reader();
+    void TEST22B_editor_reader_time();
+    void TEST23A_editor_save();
+    void TEST23B_editor_autosave();
+    void TEST24A_journal_recovery();
+    void TEST24B_journal_group_commit();
+    void TEST24C_journal_checkpoint_while_typing();
+    void TEST25A_latency_histogram();
+    void TEST25B_editor_metrics();
+    void TEST26A_document_manager_order();
+    void TEST26B_document_manager_eviction();
+    void TEST26C_document_manager_parallel_eviction();
+    void TEST27A_viewport_render();
+    void TEST27B_viewport_incremental();
+
+    void TEST28A_search_matches();
+    void TEST28B_search_incremental();
+
+    void TEST29A_mapped_editing();
+    void TEST29B_mapped_large_file();
+    void TEST29C_mapped_scattered_edits();
+
+    void TEST30A_remote_edit_batches();
+    void TEST30B_collab_converges();
+    void TEST30C_collab_long_offline_typing();
+    void TEST30D_remote_edit_long_cursor_jumps();
 };
 
 TestCases::TestCases() {
@@ -1135,6 +1215,2380 @@ void TestCases::TEST9C_emplace_time() {
 }
 
 
+/*
+ * Verifies that moves and swap are noexcept, so std::vector moves
+ * buffers instead of copying them when it grows, and that swap
+ * exchanges contents and cursors.
+ */
+void TestCases::TEST10A_nothrow_move_swap() {
+    static_assert(std::is_nothrow_move_constructible<GapBuffer<char>>::value,
+                  "GapBuffer move constructor must be noexcept");
+    static_assert(std::is_nothrow_move_assignable<GapBuffer<char>>::value,
+                  "GapBuffer move assignment must be noexcept");
+    static_assert(is_trivially_relocatable<GapBuffer<std::string>>::value,
+                  "GapBuffer should be trivially relocatable");
+    static_assert(!is_trivially_relocatable<std::string>::value,
+                  "only trivially copyable types qualify by default");
+
+    GapBuffer<int> buf1{1, 2, 3};
+    GapBuffer<int> buf2(5, 9);
+    buf2.move_cursor(-2);
+    swap(buf1, buf2);
+    QVERIFY(buf1.size() == 5);
+    QVERIFY(buf1.cursor_index() == 3);
+    QVERIFY(buf1[4] == 9);
+    QVERIFY(buf2 == GapBuffer<int>({1, 2, 3}));
+
+    // a moved-from buffer is empty but still usable
+    GapBuffer<int> buf3 = std::move(buf1);
+    QVERIFY(buf1.empty());
+    QVERIFY(buf1.cursor_index() == 0);
+    int seven = 7;
+    buf1.insert_at_cursor(seven);
+    QVERIFY(buf1.size() == 1);
+    QVERIFY(buf1[0] == 7);
+    QVERIFY(buf3.size() == 5);
+}
+
+/*
+ * Growing a vector<GapBuffer<char>> moves each buffer instead of copying
+ * it, so every line keeps its storage however often the vector grows.
+ * The cost per move still grows with sizeof(GapBuffer<char>), which is
+ * several times sizeof(std::string), so this does not compare timings.
+ */
+void TestCases::TEST10B_vector_growth_moves() {
+    const size_t num_lines = 20000;
+    const size_t line_length = 80;
+    vector<GapBuffer<char>> buffer_lines;
+    for (size_t i = 0; i < num_lines; ++i) {
+        buffer_lines.emplace_back(line_length, 'x');
+    }
+
+    vector<GapBuffer<char>> buffer_grow;
+    const char* first_line = &buffer_lines[0][0];
+    const char* last_line = &buffer_lines.back()[0];
+    for (auto& line : buffer_lines) {
+        buffer_grow.push_back(std::move(line));
+    }
+
+    // the first line was relocated many times but never copied
+    buffer_grow.reserve(2 * buffer_grow.capacity());
+    QVERIFY(&buffer_grow[0][0] == first_line);
+    QVERIFY(&buffer_grow.back()[0] == last_line);
+
+    QVERIFY(buffer_grow.size() == num_lines);
+    QVERIFY(buffer_grow.back().size() == line_length);
+    QVERIFY(buffer_grow.back()[line_length - 1] == 'x');
+}
+/*
+ * Applies an unsorted batch of inserts, deletes and replacements.
+ *
+ * Buffer: [ a b c d e f g ] -> [ X a b d e Y Z g ]
+ */
+void TestCases::TEST11A_apply_edits_basic() {
+    GapBuffer<char> buf{'a', 'b', 'c', 'd', 'e', 'f', 'g'};
+    buf.apply_edits({
+        {5, 1, {'Y', 'Z'}}, // replace f
+        {2, 1, {}},         // delete c
+        {0, 0, {'X'}},      // insert at front
+    });
+
+    std::string expected = "XabdeYZg";
+    QVERIFY(buf.size() == expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        QVERIFY(buf[i] == expected[i]);
+    }
+
+    // an empty batch is a no-op
+    buf.apply_edits({});
+    QVERIFY(buf.size() == expected.size());
+
+    // the buffer keeps working normally afterwards
+    buf.move_cursor(-static_cast<int>(buf.size()));
+    char bang = '!';
+    buf.insert_at_cursor(bang);
+    QVERIFY(buf[0] == '!');
+    QVERIFY(buf[1] == 'X');
+}
+
+/*
+ * Verifies the cursor stays next to the same element through a batch.
+ */
+void TestCases::TEST11B_apply_edits_cursor() {
+    GapBuffer<char> buf{'a', 'b', 'c', 'd', 'e', 'f', 'g'};
+    buf.move_cursor(-3); // cursor on e
+    buf.apply_edits({{0, 2, {'1', '2', '3'}}, {6, 1, {'!'}}});
+    QVERIFY(buf.cursor_index() == 5);
+    QVERIFY(buf.get_at_cursor() == 'e');
+
+    // cursor inside an erased range ends up after the replacement
+    buf.apply_edits({{4, 2, {'#'}}});
+    QVERIFY(buf.cursor_index() == 5);
+    QVERIFY(buf.get_at_cursor() == 'f');
+
+    // insert exactly at the cursor behaves like insert_at_cursor
+    buf.apply_edits({{5, 0, {'+'}}});
+    QVERIFY(buf.cursor_index() == 6);
+    QVERIFY(buf.get_at_cursor() == 'f');
+    QVERIFY(buf[5] == '+');
+
+    // so does a replacement starting at the cursor
+    buf.apply_edits({{6, 1, {'F', 'F'}}});
+    QVERIFY(buf.cursor_index() == 8);
+    QVERIFY(buf.get_at_cursor() == '!');
+    QVERIFY(buf[6] == 'F');
+}
+
+/*
+ * Overlapping or out-of-bounds edits are rejected and leave the buffer unchanged.
+ */
+void TestCases::TEST11C_apply_edits_invalid() {
+    GapBuffer<int> buf{1, 2, 3, 4, 5};
+    bool threw = false;
+    try {
+        buf.apply_edits({{1, 2, {}}, {2, 1, {}}});
+    } catch (const std::string&) {
+        threw = true;
+    }
+    QVERIFY(threw);
+
+    threw = false;
+    try {
+        buf.apply_edits({{4, 2, {}}});
+    } catch (const std::string&) {
+        threw = true;
+    }
+    QVERIFY(threw);
+    QVERIFY(buf == GapBuffer<int>({1, 2, 3, 4, 5}));
+
+    // two edits erasing from one position overlap
+    threw = false;
+    try {
+        buf.apply_edits({{2, 1, {}}, {2, 2, {}}});
+    } catch (const std::string&) {
+        threw = true;
+    }
+    QVERIFY(threw);
+
+    // touching ranges and several inserts at one position are fine
+    buf.apply_edits({{1, 1, {}}, {2, 1, {}}, {5, 0, {6}}, {5, 0, {7}}});
+    QVERIFY(buf == GapBuffer<int>({1, 4, 5, 6, 7}));
+
+    // an insert and an erase at one position work in either order
+    GapBuffer<int> erase_first{1, 2, 3};
+    erase_first.apply_edits({{1, 1, {}}, {1, 0, {9}}});
+    GapBuffer<int> insert_first{1, 2, 3};
+    insert_first.apply_edits({{1, 0, {9}}, {1, 1, {}}});
+    QVERIFY(erase_first == GapBuffer<int>({1, 9, 3}));
+    QVERIFY(insert_first == GapBuffer<int>({1, 9, 3}));
+}
+
+/*
+ * A format-on-save sized batch must be much faster than walking the
+ * cursor to every edit. The edits alternate between the two halves of
+ * the buffer, which is the O(k*n) worst case for the cursor walk.
+ */
+void TestCases::TEST11D_apply_edits_time() {
+    const size_t buffer_size = 400000;
+    const size_t num_edits = 4000;
+    GapBuffer<char> batched(buffer_size, 'x');
+    GapBuffer<char> walked(buffer_size, 'x');
+    vector<GapBuffer<char>::Edit> edits;
+    for (size_t i = 0; i < num_edits; ++i) {
+        size_t offset = (i / 2) * (buffer_size / num_edits);
+        size_t pos = (i % 2 == 0) ? offset : buffer_size / 2 + offset;
+        edits.push_back({pos, 1, {'y'}});
+    }
+
+    auto start_batch = std::chrono::high_resolution_clock::now();
+    batched.apply_edits(edits);
+    auto end_batch = std::chrono::high_resolution_clock::now();
+
+    // replacements keep every position valid, so apply them in the given order
+    auto start_walk = std::chrono::high_resolution_clock::now();
+    for (const auto& edit : edits) {
+        walked.move_cursor(static_cast<int>(edit.pos + 1) - static_cast<int>(walked.cursor_index()));
+        walked.delete_at_cursor();
+        walked.insert_at_cursor(edit.insert[0]);
+    }
+    walked.move_cursor(static_cast<int>(walked.size()) - static_cast<int>(walked.cursor_index()));
+    auto end_walk = std::chrono::high_resolution_clock::now();
+
+    QVERIFY(batched.size() == buffer_size);
+    QVERIFY(batched == walked);
+    QVERIFY(batched.cursor_index() == batched.size());
+    auto elapsed_batch = std::chrono::duration_cast<std::chrono::microseconds>(end_batch - start_batch);
+    auto elapsed_walk = std::chrono::duration_cast<std::chrono::microseconds>(end_walk - start_walk);
+    QVERIFY2(elapsed_batch.count() * 5 < elapsed_walk.count(),
+             "apply_edits should be much faster than one cursor walk per edit");
+}
+/*
+ * data(), c_str() and as_string_view() return the contents contiguously
+ * and leave the cursor where it was.
+ */
+void TestCases::TEST12A_contiguous_view_basic() {
+    GapBuffer<char> buf;
+    for (char ch : std::string("hello world")) {
+        buf.insert_at_cursor(ch);
+    }
+    buf.move_cursor(-6); // cursor on the space
+
+    QVERIFY(buf.as_string_view() == "hello world");
+    QVERIFY(std::string(buf.c_str()) == "hello world");
+    QVERIFY(std::string(buf.data(), buf.size()) == "hello world");
+    QVERIFY(buf.cursor_index() == 5);
+    QVERIFY(buf.get_at_cursor() == ' ');
+
+    // editing after taking a view puts the gap back at the cursor
+    char comma = ',';
+    buf.insert_at_cursor(comma);
+    QVERIFY(buf.as_string_view() == "hello, world");
+    QVERIFY(buf.cursor_index() == 6);
+
+    // c_str() on a full buffer still has room for the terminator
+    GapBuffer<char> full(kDefaultSize, 'z');
+    QVERIFY(std::string(full.c_str()) == std::string(kDefaultSize, 'z'));
+
+    GapBuffer<char> empty;
+    QVERIFY(empty.as_string_view().empty());
+    QVERIFY(std::string(empty.c_str()).empty());
+}
+
+/*
+ * Once the gap is at the end, further views and cursor movement are free
+ * until the next edit.
+ */
+void TestCases::TEST12B_contiguous_view_cached() {
+    const size_t buffer_size = 1000000;
+    GapBuffer<char> buf(buffer_size, 'a');
+    buf.move_cursor(-static_cast<int>(buffer_size / 2));
+    char b = 'b';
+    buf.insert_at_cursor(b);
+
+    const char* first = buf.data(); // relocates the gap once
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < 1000; ++i) {
+        buf.move_cursor(i % 2 == 0 ? -1000 : 1000);
+        QVERIFY(buf.data() == first);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    QVERIFY2(elapsed.count() < 1000, "repeated views must not relocate the gap again");
+
+    auto view = buf.as_string_view();
+    QVERIFY(view.size() == buffer_size + 1);
+    QVERIFY(view[buffer_size / 2] == 'b');
+    QVERIFY(std::count(view.begin(), view.end(), 'a') == static_cast<long>(buffer_size));
+}
+/*
+ * Random edits with the hash cached must give the same hash as
+ * hashing the final contents from scratch.
+ */
+void TestCases::TEST13A_content_hash_incremental() {
+    std::mt19937 gen(106);
+    GapBuffer<char> buf;
+    (void) buf.content_hash(); // start maintaining the hash
+    std::string model;
+    size_t cursor = 0;
+    for (size_t step = 0; step < 5000; ++step) {
+        int op = gen() % 4;
+        if (op == 0 && cursor > 0) {
+            buf.delete_at_cursor();
+            model.erase(--cursor, 1);
+        } else if (op == 1) {
+            int delta = static_cast<int>(gen() % (model.size() + 1)) - static_cast<int>(cursor);
+            buf.move_cursor(delta);
+            cursor += delta;
+        } else {
+            char ch = 'a' + gen() % 26;
+            buf.insert_at_cursor(ch);
+            model.insert(model.begin() + cursor++, ch);
+        }
+        QVERIFY(buf.content_hash_cached());
+    }
+
+    GapBuffer<char> fresh;
+    for (char ch : model) {
+        fresh.insert_at_cursor(ch);
+    }
+    QVERIFY(buf.content_hash() == fresh.content_hash());
+    QVERIFY(std::hash<GapBuffer<char>>{}(buf) == std::hash<GapBuffer<char>>{}(fresh));
+    QVERIFY(buf == fresh);
+
+    // the hash does not depend on where the gap or cursor is
+    fresh.move_cursor(-static_cast<int>(fresh.size() / 3));
+    char x = 'x';
+    fresh.insert_at_cursor(x);
+    fresh.delete_at_cursor();
+    QVERIFY(buf.content_hash() == fresh.content_hash());
+    fresh.insert_at_cursor(x);
+    QVERIFY(buf.content_hash() != fresh.content_hash());
+}
+
+/*
+ * Writing through a mutable reference must not leave a stale hash.
+ */
+void TestCases::TEST13B_content_hash_mutable_access() {
+    GapBuffer<int> buf{1, 2, 3};
+    GapBuffer<int> same{1, 2, 3};
+    GapBuffer<int> other{1, 5, 3};
+    QVERIFY(buf.content_hash() == same.content_hash());
+    QVERIFY(buf.content_hash() != other.content_hash());
+
+    buf[1] = 5;
+    QVERIFY(!buf.content_hash_cached());
+    QVERIFY(buf.content_hash() == other.content_hash());
+    QVERIFY(buf == other);
+
+    for (int& val : buf) {
+        val = 0;
+    }
+    QVERIFY(buf.content_hash() == GapBuffer<int>({0, 0, 0}).content_hash());
+
+    // copies and moves carry the cached hash along
+    GapBuffer<int> copy = other;
+    QVERIFY(copy.content_hash_cached());
+    QVERIFY(copy.content_hash() == other.content_hash());
+    GapBuffer<int> moved = std::move(copy);
+    QVERIFY(moved.content_hash() == other.content_hash());
+
+    // reading through a const reference keeps the hash
+    const auto& const_ref = other;
+    QVERIFY(const_ref[1] == 5);
+    QVERIFY(other.content_hash_cached());
+
+    // and hashing through one computes the same value without caching it
+    GapBuffer<int> uncached{1, 5, 3};
+    const auto& reader = uncached;
+    QVERIFY(reader.content_hash() == other.content_hash());
+    QVERIFY(!uncached.content_hash_cached());
+}
+
+/*
+ * GapBuffers can be deduplicated in an unordered_set.
+ */
+void TestCases::TEST13C_content_hash_unordered_set() {
+    GapBuffer<char> buf1{'a','v','e','r','y'};
+    GapBuffer<char> buf2{'a','n','n','a'};
+    GapBuffer<char> buf3{'a','l','i'};
+    GapBuffer<char> buf4{'a'};
+    GapBuffer<char> buf5{};
+    GapBuffer<char> buf6{'a','v','e','r','y'};
+
+    std::unordered_set<GapBuffer<char>> bufs {buf1, buf2, buf3, buf4, buf5, buf6};
+    QVERIFY(bufs.size() == 5);
+    QVERIFY(bufs.count(buf6) == 1);
+    QVERIFY(bufs.count(GapBuffer<char>{'a','v','e','r'}) == 0);
+}
+
+/*
+ * Comparing large, equal-sized but different buffers is O(1) once their
+ * hashes are cached, even if they only differ at the very end.
+ */
+void TestCases::TEST13D_content_hash_inequality_time() {
+    const size_t buffer_size = 100000;
+    const size_t num_buffers = 50;
+    vector<GapBuffer<char>> bufs;
+    for (size_t i = 0; i < num_buffers; ++i) {
+        bufs.emplace_back(buffer_size, 'q');
+        char ch = 'a' + i % 26;
+        char digit = '0' + i / 26;
+        bufs.back().insert_at_cursor(ch);
+        bufs.back().insert_at_cursor(digit);
+        (void) bufs.back().content_hash();
+    }
+
+    size_t equal_pairs = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < num_buffers; ++i) {
+        for (size_t j = 0; j < num_buffers; ++j) {
+            if (i != j) {
+                equal_pairs += bufs[i] == bufs[j];
+            }
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    QVERIFY(equal_pairs == 0);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    QVERIFY2(elapsed.count() < 1000, "unequal hashes should short-circuit comparison");
+
+    GapBuffer<char> copy = bufs[7];
+    QVERIFY(copy == bufs[7]);
+}
+/*
+ * Inserts characters with a style id and flags, and checks every column
+ * follows the shared cursor.
+ */
+void TestCases::TEST14A_soa_basic() {
+    GapBufferSoA<char, uint16_t, uint8_t> buf;
+    for (char ch = 'a'; ch <= 'o'; ++ch) {
+        buf.insert_at_cursor(ch, static_cast<uint16_t>(ch * 10), static_cast<uint8_t>(ch % 4));
+    }
+    QVERIFY(buf.size() == 15);
+    buf.move_cursor(-5);
+    buf.delete_at_cursor(); // removes j
+    buf.insert_at_cursor('J', 1000, 7);
+
+    QVERIFY(buf.cursor_index() == 10);
+    QVERIFY(buf.at<0>(9) == 'J');
+    QVERIFY(buf.at<1>(9) == 1000);
+    QVERIFY(buf.at<2>(9) == 7);
+    QVERIFY(buf.at<0>(10) == 'k');
+    QVERIFY(buf.at<1>(10) == 'k' * 10);
+    QVERIFY(buf.row(0) == std::make_tuple('a', static_cast<uint16_t>('a' * 10), static_cast<uint8_t>('a' % 4)));
+
+    buf.at<2>(0) = 42;
+    QVERIFY(buf.at<2>(0) == 42);
+
+    auto copy = buf;
+    auto moved = std::move(buf);
+    QVERIFY(buf.empty());
+    QVERIFY(copy.size() == 15);
+    QVERIFY(moved.at<0>(14) == 'o');
+    QVERIFY(copy.row(9) == moved.row(9));
+}
+
+/*
+ * A single column is available as two dense halves, or as one contiguous
+ * array once the gap is parked at the end.
+ */
+void TestCases::TEST14B_soa_column_scan() {
+    GapBufferSoA<char, uint16_t, uint8_t> buf;
+    std::string text = "the quick brown fox jumps over the lazy dog";
+    for (size_t i = 0; i < text.size(); ++i) {
+        buf.insert_at_cursor(text[i], static_cast<uint16_t>(i), 0);
+    }
+    // inserting away from the end moves the gap there, so both halves are non-empty
+    buf.move_cursor(-20);
+    buf.insert_at_cursor('!', 1000, 0);
+    size_t split = text.size() - 20;
+    text.insert(split, "!");
+
+    auto view = buf.column<0>();
+    QVERIFY(view.first_size == split + 1);
+    QVERIFY(view.second_size == 20);
+    QVERIFY(std::string(view.first, view.first_size) == text.substr(0, split + 1));
+    QVERIFY(std::string(view.second, view.second_size) == text.substr(split + 1));
+
+    const char* chars = buf.column_data<0>();
+    QVERIFY(std::string(chars, buf.size()) == text);
+    QVERIFY(std::count(chars, chars + buf.size(), 'o') == 4);
+    const uint16_t* styles = buf.column_data<1>();
+    for (size_t i = 0; i < buf.size(); ++i) {
+        uint16_t expected = i < split ? i : i == split ? 1000 : i - 1;
+        QVERIFY(styles[i] == expected);
+    }
+    QVERIFY(buf.cursor_index() == split + 1);
+}
+/*
+ * Markers before an insertion stay put, markers after it shift, and a
+ * marker exactly at the insertion point follows its gravity.
+ */
+void TestCases::TEST15A_marker_gravity() {
+    GapBuffer<char> buf{'a', 'b', 'c', 'd'};
+    auto before = buf.add_marker(1);
+    auto left = buf.add_marker(2, MarkerGravity::Left);
+    auto right = buf.add_marker(2, MarkerGravity::Right);
+    auto after = buf.add_marker(4);
+    QVERIFY(buf.marker_count() == 4);
+
+    buf.move_cursor(-2);
+    char x = 'x';
+    buf.insert_at_cursor(x);
+    buf.insert_at_cursor(x);
+    QVERIFY(buf.marker_position(before) == 1);
+    QVERIFY(buf.marker_position(left) == 2);
+    QVERIFY(buf.marker_position(right) == 4);
+    QVERIFY(buf.marker_position(after) == 6);
+
+    buf.remove_marker(right);
+    QVERIFY(buf.marker_count() == 3);
+    bool threw = false;
+    try {
+        buf.marker_position(right);
+    } catch (const std::string&) {
+        threw = true;
+    }
+    QVERIFY(threw);
+    QVERIFY(buf.marker_position(after) == 6);
+}
+
+/*
+ * Deleting text collapses markers inside the deleted range to its start.
+ *
+ * Buffer: [ a b c d e f ] -> [ a b f ]
+ */
+void TestCases::TEST15B_marker_erase() {
+    GapBuffer<char> buf{'a', 'b', 'c', 'd', 'e', 'f'};
+    auto start = buf.add_marker(2);
+    auto inside = buf.add_marker(4, MarkerGravity::Left);
+    auto end = buf.add_marker(5);
+    auto last = buf.add_marker(6);
+
+    buf.move_cursor(-1);
+    for (int i = 0; i < 3; ++i) {
+        buf.delete_at_cursor();
+    }
+    QVERIFY(buf.marker_position(start) == 2);
+    QVERIFY(buf.marker_position(inside) == 2);
+    QVERIFY(buf.marker_position(end) == 2);
+    QVERIFY(buf.marker_position(last) == 3);
+
+    // collapsed markers keep their gravity
+    char y = 'y';
+    buf.insert_at_cursor(y);
+    QVERIFY(buf.marker_position(inside) == 2);
+    QVERIFY(buf.marker_position(end) == 3);
+}
+
+/*
+ * Markers follow a whole batch of edits too.
+ */
+void TestCases::TEST15C_marker_apply_edits() {
+    GapBuffer<char> buf{'a', 'b', 'c', 'd', 'e', 'f', 'g'};
+    auto on_d = buf.add_marker(3);
+    auto on_g = buf.add_marker(6);
+    buf.apply_edits({{0, 0, {'1', '2'}}, {4, 2, {}}, {6, 0, {'!'}}});
+    // [ 1 2 a b c d g ] with ! inserted before g
+    QVERIFY(buf.marker_position(on_d) == 5);
+    QVERIFY(buf[buf.marker_position(on_d)] == 'd');
+    QVERIFY(buf.marker_position(on_g) == 7);
+    QVERIFY(buf[buf.marker_position(on_g)] == 'g');
+
+    GapBuffer<char> copy = buf;
+    QVERIFY(copy.marker_position(on_g) == 7);
+}
+
+/*
+ * Hundreds of thousands of markers must not make edits slow, and they must
+ * agree with a brute-force model. Most of the time goes into moving the
+ * gap between random positions, so the same edits on a buffer without
+ * markers set the bound.
+ */
+void TestCases::TEST15D_marker_many_time() {
+    const size_t buffer_size = 200000;
+    const size_t num_edits = 20000;
+    std::mt19937 gen(31);
+    GapBuffer<char> buf(buffer_size, '.');
+    GapBuffer<char> plain(buffer_size, '.');
+    vector<GapBuffer<char>::marker> ids;
+    vector<size_t> model;
+    vector<bool> right_gravity;
+    for (size_t pos = 0; pos < buffer_size; ++pos) {
+        bool right = gen() % 2;
+        ids.push_back(buf.add_marker(pos, right ? MarkerGravity::Right : MarkerGravity::Left));
+        model.push_back(pos);
+        right_gravity.push_back(right);
+    }
+
+    vector<std::pair<int, bool>> script; // (cursor target, is insert)
+    size_t size = buffer_size;
+    for (size_t i = 0; i < num_edits; ++i) {
+        bool insert = gen() % 2;
+        script.emplace_back(static_cast<int>(gen() % size) + 1, insert);
+        size = insert ? size + 1 : size - 1;
+    }
+    auto run = [&script](GapBuffer<char>& target, vector<std::pair<size_t, bool>>* edits) {
+        for (const auto& step : script) {
+            target.move_cursor(step.first - static_cast<int>(target.cursor_index()));
+            if (step.second) {
+                char z = 'z';
+                if (edits) edits->emplace_back(target.cursor_index(), true);
+                target.insert_at_cursor(z);
+            } else {
+                target.delete_at_cursor();
+                if (edits) edits->emplace_back(target.cursor_index(), false);
+            }
+        }
+    };
+
+    vector<std::pair<size_t, bool>> edits; // (position, is insert)
+    edits.reserve(num_edits);
+    auto start_plain = std::chrono::high_resolution_clock::now();
+    run(plain, nullptr);
+    auto end_plain = std::chrono::high_resolution_clock::now();
+    auto start = std::chrono::high_resolution_clock::now();
+    run(buf, &edits);
+    auto end = std::chrono::high_resolution_clock::now();
+    QVERIFY(buf == plain);
+    auto elapsed_plain = std::chrono::duration_cast<std::chrono::microseconds>(end_plain - start_plain);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    QVERIFY2(elapsed.count() < 2 * elapsed_plain.count() + 200000,
+             "edits with many markers must stay O(log n)");
+
+    // replay the edits on a sample of markers by brute force
+    for (size_t sample = 0; sample < buffer_size; sample += 997) {
+        size_t pos = model[sample];
+        for (const auto& edit : edits) {
+            if (edit.second) {
+                if (pos > edit.first || (pos == edit.first && right_gravity[sample])) ++pos;
+            } else if (pos > edit.first) {
+                --pos;
+            }
+        }
+        QVERIFY(buf.marker_position(ids[sample]) == pos);
+    }
+}
+
+/*
+ * gap_stats() reports the storage and the observed edit pattern.
+ */
+void TestCases::TEST16A_gap_stats() {
+    GapBuffer<char> buf;
+    auto stats = buf.gap_stats();
+    QVERIFY(stats.capacity == buf.capacity());
+    QVERIFY(stats.gap_size == buf.capacity());
+    QVERIFY(stats.reallocations == 0);
+
+    for (char ch : std::string("hello world")) {
+        buf.insert_at_cursor(ch);
+    }
+    stats = buf.gap_stats();
+    QVERIFY(stats.current_burst == 11);
+    QVERIFY(stats.reallocations == 1);
+    QVERIFY(stats.elements_relocated == 10);
+    QVERIFY(stats.gap_size == buf.capacity() - buf.size());
+
+    // backspacing keeps the burst going, jumping elsewhere ends it
+    buf.delete_at_cursor();
+    char d = 'd';
+    buf.insert_at_cursor(d);
+    QVERIFY(buf.gap_stats().current_burst == 12);
+    buf.move_cursor(-6);
+    buf.insert_at_cursor(d);
+    stats = buf.gap_stats();
+    QVERIFY(stats.current_burst == 1);
+    QVERIFY(stats.average_burst == 3);
+    QVERIFY(stats.average_gap_move > 0);
+
+    // typing on where the jump landed counts as local again
+    for (int i = 0; i < 10; ++i) {
+        buf.insert_at_cursor(d);
+    }
+    QVERIFY(buf.gap_stats().average_gap_move == 0);
+}
+
+/*
+ * A streaming appender should get a large gap and reallocate less often
+ * than fixed doubling, without ending up with more slack.
+ */
+void TestCases::TEST16B_adaptive_append_reallocations() {
+    const size_t num_elems = 1000000;
+    GapBuffer<char> adaptive;
+    GapBuffer<char> doubling;
+    doubling.set_gap_policy(GapPolicy::Doubling);
+    for (size_t i = 0; i < num_elems; ++i) {
+        char ch = 'a' + i % 26;
+        adaptive.insert_at_cursor(ch);
+        doubling.insert_at_cursor(ch);
+    }
+    QVERIFY(adaptive.size() == num_elems);
+    QVERIFY(adaptive == doubling);
+    auto adaptive_stats = adaptive.gap_stats();
+    auto doubling_stats = doubling.gap_stats();
+    QVERIFY2(adaptive_stats.reallocations < doubling_stats.reallocations,
+             "an appender should reallocate less often than with doubling");
+    QVERIFY(adaptive_stats.elements_relocated < doubling_stats.elements_relocated);
+    QVERIFY2(adaptive_stats.gap_size <= doubling_stats.gap_size,
+             "an appender should not carry more slack than with doubling");
+
+    // past the fast growth limit, the gap never exceeds the buffer size
+    GapBuffer<char> growing;
+    for (size_t i = 0; i < num_elems; ++i) {
+        growing.insert_at_cursor('t');
+        if (growing.size() > (1 << 17)) {
+            QVERIFY(growing.capacity() <= 2 * growing.size());
+        }
+    }
+}
+
+/*
+ * A large buffer that only gets a few scattered edits should not carry
+ * the slack of a 2x reserve.
+ *
+ * Buffer: 1MB loaded at once, then 100 single inserts all over the place
+ */
+void TestCases::TEST16C_adaptive_rare_edit_slack() {
+    const size_t buffer_size = 1 << 20;
+    std::mt19937 gen(32);
+    GapBuffer<char> adaptive(buffer_size, '.');
+    GapBuffer<char> doubling(buffer_size, '.', GapPolicy::Doubling);
+    QVERIFY(doubling.capacity() == 2 * buffer_size);
+    for (int i = 0; i < 100; ++i) {
+        int target = static_cast<int>(gen() % adaptive.size());
+        char x = 'x';
+        for (auto* buf : {&adaptive, &doubling}) {
+            buf->move_cursor(target - static_cast<int>(buf->cursor_index()));
+            buf->insert_at_cursor(x);
+        }
+    }
+    QVERIFY(adaptive == doubling);
+    size_t adaptive_slack = adaptive.capacity() - adaptive.size();
+    size_t doubling_slack = doubling.capacity() - doubling.size();
+    QVERIFY2(adaptive_slack * 100 < doubling_slack, "rarely edited buffers should keep a small gap");
+}
+
+std::string shared_segment_name(const std::string& test) {
+    return "/gapbuffer-" + test + "-" + std::to_string(getpid());
+}
+
+/*
+ * A reader attached to the segment sees the writer's edits in place,
+ * including across growth of the segment.
+ */
+void TestCases::TEST17A_shared_basic() {
+    SharedGapBuffer<char> writer(shared_segment_name("basic"));
+    SharedGapReader<char> reader(writer.name());
+    QVERIFY(reader.size() == 0);
+    uint64_t generation = reader.generation();
+
+    std::string text = "shared memory gap buffer";
+    for (char ch : text) {
+        writer.insert_at_cursor(ch);
+    }
+    QVERIFY(reader.generation() != generation);
+    QVERIFY(reader.size() == text.size());
+    auto contents = reader.copy();
+    QVERIFY(std::string(contents.begin(), contents.end()) == text);
+
+    writer.move_cursor(-10);
+    for (int i = 0; i < 4; ++i) {
+        writer.delete_at_cursor();
+    }
+    text.erase(text.size() - 14, 4);
+    contents = reader.copy();
+    QVERIFY(std::string(contents.begin(), contents.end()) == text);
+    QVERIFY(reader.at(0) == 's');
+    QVERIFY(reader.at(text.size() - 1) == 'r');
+    QVERIFY(writer.at(3) == 'r');
+
+    // counting in place, without copying
+    size_t spaces = reader.read([](const char* first, size_t first_size,
+                                   const char* second, size_t second_size) {
+        return std::count(first, first + first_size, ' ') + std::count(second, second + second_size, ' ');
+    });
+    QVERIFY(spaces == 2);
+
+    bool threw = false;
+    try {
+        SharedGapReader<int> wrong_type(writer.name());
+    } catch (const std::string&) {
+        threw = true;
+    }
+    QVERIFY(threw);
+}
+
+/*
+ * A reader running concurrently with the writer must only ever see
+ * consistent states, never a half-applied edit or a half-moved gap.
+ *
+ * The writer keeps the buffer equal to a prefix of "abcd...zabcd..." with
+ * its cursor jumping around, so any torn read shows up as a broken pattern.
+ */
+void TestCases::TEST17B_shared_concurrent_reader() {
+    const size_t num_edits = 100000;
+    SharedGapBuffer<char> writer(shared_segment_name("concurrent"));
+    SharedGapReader<char> reader(writer.name());
+    std::atomic<bool> done{false};
+    std::atomic<size_t> reads{0};
+    std::atomic<bool> consistent{true};
+
+    std::thread reader_thread([&]() {
+        while (!done.load()) {
+            bool ok = reader.read([](const char* first, size_t first_size,
+                                     const char* second, size_t second_size) {
+                for (size_t i = 0; i < first_size + second_size; ++i) {
+                    char ch = i < first_size ? first[i] : second[i - first_size];
+                    if (ch != 'a' + static_cast<char>(i % 26)) return false;
+                }
+                return true;
+            });
+            if (!ok) consistent = false;
+            reads++;
+        }
+    });
+
+    std::mt19937 gen(33);
+    for (size_t i = 0; i < num_edits; ++i) {
+        // trim the tail from a random position, then put it back in order
+        size_t keep = gen() % (writer.size() + 1);
+        writer.move_cursor(static_cast<int>(writer.size()) - static_cast<int>(writer.cursor_index()));
+        while (writer.size() > keep) {
+            writer.delete_at_cursor();
+        }
+        size_t target = keep + gen() % 64;
+        while (writer.size() < target) {
+            writer.insert_at_cursor('a' + static_cast<char>(writer.size() % 26));
+        }
+        writer.move_cursor(-static_cast<int>(gen() % (writer.size() + 1)));
+    }
+    done = true;
+    reader_thread.join();
+    QVERIFY2(consistent, "a reader saw a torn state");
+    QVERIFY(reads > 0);
+}
+
+/*
+ * A separate process maps the segment and reads it directly.
+ */
+void TestCases::TEST17C_shared_other_process() {
+    SharedGapBuffer<char> writer(shared_segment_name("process"), 4);
+    std::string text = "written by the parent, read by the child";
+    for (char ch : text) {
+        writer.insert_at_cursor(ch);
+    }
+    writer.move_cursor(-5);
+
+    pid_t child = fork();
+    QVERIFY(child >= 0);
+    if (child == 0) {
+        int status = 1;
+        try {
+            SharedGapReader<char> reader(writer.name());
+            auto contents = reader.copy();
+            status = std::string(contents.begin(), contents.end()) == text ? 0 : 2;
+        } catch (...) {
+            status = 3;
+        }
+        _exit(status);
+    }
+    int status = -1;
+    waitpid(child, &status, 0);
+    QVERIFY(WIFEXITED(status));
+    QVERIFY(WEXITSTATUS(status) == 0);
+}
+
+// A trivially copyable element whose == is not bytewise.
+struct CaseInsensitive {
+    char ch;
+};
+
+bool operator==(const CaseInsensitive& lhs, const CaseInsensitive& rhs) {
+    return std::tolower(static_cast<unsigned char>(lhs.ch)) == std::tolower(static_cast<unsigned char>(rhs.ch));
+}
+
+/*
+ * find and the comparison operators work on the two halves directly, so
+ * they must give the same answers wherever the gap happens to be.
+ */
+void TestCases::TEST18A_char_find_compare() {
+    GapBuffer<char> buf;
+    buf.insert_at_cursor(std::string_view("the quick brown fox"));
+    buf.move_cursor(-9);
+    buf.insert_at_cursor(std::string_view("red "));
+    // the quick red |brown fox
+    QVERIFY(buf.find('q') == 4);
+    QVERIFY(buf.find('b') == 14);
+    QVERIFY(buf.find('o', 17) == 21);
+    QVERIFY(buf.find('x', 23) == GapBuffer<char>::npos);
+    QVERIFY(buf.find('q', 100) == GapBuffer<char>::npos);
+
+    GapBuffer<char> same;
+    same.insert_at_cursor(std::string_view("the quick red brown fox"));
+    QVERIFY(buf == same);
+    same.move_cursor(-20);
+    same.delete_at_cursor();
+    same.insert_at_cursor('e'); // same text, split at a different place
+    QVERIFY(same == buf);
+    same[22] = 'y';
+    QVERIFY(buf != same);
+    QVERIFY(buf < same);
+    QVERIFY(!(same < buf));
+
+    // chars compare as char, not as unsigned bytes
+    GapBuffer<char> negative(3, static_cast<char>(-5));
+    GapBuffer<char> positive(3, 'a');
+    QVERIFY((negative < positive) == (static_cast<char>(-5) < 'a'));
+
+    vector<int> values{3, 1, 4, 1, 5, 9, 2, 6};
+    GapBuffer<int> ints;
+    ints.insert_at_cursor(values.begin(), values.end());
+    ints.move_cursor(-4);
+    QVERIFY(ints.size() == values.size());
+    QVERIFY(ints.find(1) == 1);
+    QVERIFY(ints.find(1, 2) == 3);
+    QVERIFY(ints.find(6) == 7);
+
+    // trivially copyable structs compare with their own operator==
+    GapBuffer<CaseInsensitive> lower{{'a'}, {'b'}};
+    GapBuffer<CaseInsensitive> upper{{'A'}, {'B'}};
+    QVERIFY(lower == upper);
+}
+
+/*
+ * Inserting a whole string is one copy, not one insert per character.
+ */
+void TestCases::TEST18B_string_insert_time() {
+    const size_t num_chars = 1 << 20;
+    const size_t num_pieces = 64;
+    std::string piece(num_chars / num_pieces, 'x');
+
+    GapBuffer<char> per_char;
+    per_char.reserve(2 * num_chars);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < num_pieces; ++i) {
+        for (char ch : piece) {
+            per_char.insert_at_cursor(ch);
+        }
+        per_char.move_cursor(-static_cast<int>(piece.size() / 2));
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto per_char_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+
+    GapBuffer<char> bulk;
+    bulk.reserve(2 * num_chars);
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < num_pieces; ++i) {
+        bulk.insert_at_cursor(std::string_view(piece));
+        bulk.move_cursor(-static_cast<int>(piece.size() / 2));
+    }
+    end = std::chrono::high_resolution_clock::now();
+    auto bulk_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+
+    QVERIFY(bulk == per_char);
+    QVERIFY(bulk.cursor_index() == per_char.cursor_index());
+    QVERIFY2(bulk_time.count() * 5 < per_char_time.count(), "string insert should be much faster than per-char inserts");
+}
+
+std::string write_temp_file(const std::string& test, const std::string& contents) {
+    std::string path = "/tmp/texteditor-" + test + "-" + std::to_string(getpid()) + ".txt";
+    std::ofstream file(path, std::ios::binary);
+    file << contents;
+    return path;
+}
+
+/*
+ * The editor loads the file with the cursor at the start, and both read
+ * modes see the same edits.
+ */
+void TestCases::TEST19A_editor_basic() {
+    std::string path = write_temp_file("basic", "hello");
+    for (ReadMode mode : {ReadMode::Locked, ReadMode::LockFree}) {
+        TextEditor editor(path, mode);
+        QVERIFY(editor.read_mode() == mode);
+        QVERIFY(editor.size() == 5);
+        QVERIFY(editor.cursor_index() == 0);
+        QVERIFY(editor.retrieve_next_character() == 'h');
+
+        editor.press_left(); // no-op at the start
+        for (int i = 0; i < 5; ++i) {
+            editor.press_right();
+        }
+        editor.press_right(); // no-op at the end
+        QVERIFY(editor.cursor_index() == 5);
+        for (char ch : std::string(", world")) {
+            editor.press_key(ch);
+        }
+        editor.press_left();
+        QVERIFY(editor.retrieve_next_character() == 'd');
+        QVERIFY(editor.retrieve_range(0, 100) == "hello, world");
+        QVERIFY(editor.retrieve_range(7, 3) == "wor");
+        QVERIFY(editor.retrieve_character(4) == 'o');
+
+        bool threw = false;
+        try {
+            editor.retrieve_character(12);
+        } catch (const char*) {
+            threw = true;
+        }
+        QVERIFY(threw);
+    }
+    remove(path.c_str());
+
+    bool threw = false;
+    try {
+        TextEditor missing("/tmp/texteditor-does-not-exist.txt");
+    } catch (const std::string&) {
+        threw = true;
+    }
+    QVERIFY(threw);
+}
+
+/*
+ * With readers hammering the editor, lock-free reads must only ever see
+ * characters that were really there, and the writer must keep its
+ * keystroke latency.
+ *
+ * The writer types "abc...zabc...", so position i always holds
+ * 'a' + i % 26 once it exists. (In Locked mode the same readers can keep
+ * the shared_mutex busy and starve the writer outright.)
+ */
+void TestCases::TEST19B_editor_lock_free_readers() {
+    const size_t num_keys = 50000;
+    const size_t num_readers = 16;
+    std::string path = write_temp_file("readers", "");
+    bool reclaimed = true;
+
+    auto run = [&](ReadMode mode, size_t readers, bool& consistent) -> long long {
+        TextEditor editor(path, mode);
+        std::atomic<bool> done{false};
+        std::atomic<bool> ok{true};
+        vector<std::thread> threads;
+        for (size_t r = 0; r < readers; ++r) {
+            threads.emplace_back([&, r]() {
+                std::mt19937 gen(r);
+                while (!done.load()) {
+                    size_t size = editor.size();
+                    if (size == 0) continue;
+                    size_t pos = gen() % size;
+                    if (editor.retrieve_character(pos) != 'a' + static_cast<char>(pos % 26)) ok = false;
+                    std::string range = editor.retrieve_range(pos, 64);
+                    for (size_t i = 0; i < range.size(); ++i) {
+                        if (range[i] != 'a' + static_cast<char>((pos + i) % 26)) ok = false;
+                    }
+                }
+            });
+        }
+        vector<long long> latencies;
+        latencies.reserve(num_keys);
+        for (size_t i = 0; i < num_keys; ++i) {
+            auto start = std::chrono::high_resolution_clock::now();
+            editor.press_key('a' + static_cast<char>(i % 26));
+            auto end = std::chrono::high_resolution_clock::now();
+            latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        }
+        done = true;
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        consistent = consistent && ok && editor.size() == num_keys
+                && editor.retrieve_character(num_keys - 1) == 'a' + static_cast<char>((num_keys - 1) % 26);
+        // with the readers gone, the next writes free the storage they kept alive
+        editor.press_left();
+        editor.press_right();
+        reclaimed = reclaimed && editor.metrics().retired_bytes == 0;
+        std::sort(latencies.begin(), latencies.end());
+        return latencies[latencies.size() * 99 / 100];
+    };
+
+    bool consistent = true;
+    long long alone = run(ReadMode::LockFree, 0, consistent);
+    long long contended = run(ReadMode::LockFree, num_readers, consistent);
+    QVERIFY2(consistent, "a lock-free reader saw a torn state");
+    QVERIFY2(reclaimed, "retired storage should be freed once readers move past it");
+    remove(path.c_str());
+    QVERIFY2(contended < std::max(10 * alone, 50000LL), "readers must not slow down the writer");
+}
+
+/*
+ * The constructor returns before a large file is loaded. The start of the
+ * file is readable at once, reads further in wait for the loader, and
+ * edits made during the load are kept.
+ */
+void TestCases::TEST20A_editor_streaming_load() {
+    const size_t file_size = 32 * 1024 * 1024;
+    std::string contents(file_size, ' ');
+    for (size_t i = 0; i < file_size; ++i) {
+        contents[i] = 'a' + i % 26;
+    }
+    std::string path = write_temp_file("streaming", contents);
+
+    for (ReadMode mode : {ReadMode::Locked, ReadMode::LockFree}) {
+        auto start = std::chrono::high_resolution_clock::now();
+        TextEditor editor(path, mode);
+        char first = editor.retrieve_character(0);
+        auto end = std::chrono::high_resolution_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+        QVERIFY2(elapsed.count() < 50000, "the first screen should not wait for the whole file");
+        QVERIFY(first == 'a');
+        QVERIFY(editor.retrieve_range(0, 80) == contents.substr(0, 80));
+        QVERIFY(editor.load_progress().total_bytes == file_size);
+
+        editor.press_key('!');
+        QVERIFY(editor.retrieve_character(file_size) == contents[file_size - 1]);
+        editor.wait_until_loaded();
+        LoadProgress progress = editor.load_progress();
+        QVERIFY(progress.done);
+        QVERIFY(progress.bytes_loaded == file_size);
+        QVERIFY(editor.size() == file_size + 1);
+        QVERIFY(editor.cursor_index() == 1);
+        QVERIFY(editor.retrieve_range(0, 4) == "!abc");
+        QVERIFY(editor.retrieve_range(file_size - 3, 4) == contents.substr(file_size - 4));
+        QVERIFY(progress.error.empty());
+
+        // the cursor and remote edits can go into the text loaded last
+        uint64_t edit_count = editor.edit_count();
+        QVERIFY(editor.apply_remote({{file_size, 1, "?"}}, edit_count));
+        QVERIFY(editor.retrieve_range(file_size - 1, 2) == contents.substr(file_size - 2, 1) + "?");
+        editor.move_by(static_cast<int>(file_size));
+        QVERIFY(editor.cursor_index() == file_size + 1);
+        editor.press_backspace();
+        editor.press_key('.');
+        QVERIFY(editor.retrieve_range(file_size - 1, 2) == contents.substr(file_size - 2, 1) + ".");
+        QVERIFY(editor.retrieve_range(0, 4) == "!abc");
+        QVERIFY(editor.size() == file_size + 1);
+    }
+
+    // destroying the editor mid-load stops the loader
+    {
+        TextEditor editor(path);
+    }
+    remove(path.c_str());
+}
+
+/*
+ * A batch must leave the editor exactly where the same presses one by one
+ * would, including moves that bump into either end.
+ */
+void TestCases::TEST21A_editor_batch_commands() {
+    std::string path = write_temp_file("batch", "0123456789");
+    std::mt19937 gen(37);
+    for (ReadMode mode : {ReadMode::Locked, ReadMode::LockFree}) {
+        TextEditor batched(path, mode);
+        TextEditor pressed(path, mode);
+        for (int round = 0; round < 50; ++round) {
+            vector<Command> commands;
+            for (int i = 0; i < 40; ++i) {
+                switch (gen() % 4) {
+                case 0: commands.push_back(Command::left()); break;
+                case 1: commands.push_back(Command::right()); break;
+                case 2: commands.push_back(Command::move(static_cast<int>(gen() % 30) - 15)); break;
+                default: commands.push_back(Command::key('a' + gen() % 26)); break;
+                }
+            }
+            batched.apply(commands);
+            for (const Command& command : commands) {
+                if (command.type == Command::Type::Key) {
+                    pressed.press_key(command.ch);
+                } else {
+                    for (int step = 0; step < std::abs(command.delta); ++step) {
+                        command.delta < 0 ? pressed.press_left() : pressed.press_right();
+                    }
+                }
+            }
+            QVERIFY(batched.cursor_index() == pressed.cursor_index());
+            QVERIFY(batched.retrieve_range(0, batched.size()) == pressed.retrieve_range(0, pressed.size()));
+        }
+
+        batched.move_by(-1000000);
+        QVERIFY(batched.cursor_index() == 0);
+        batched.press_keys("start:");
+        QVERIFY(batched.cursor_index() == 6);
+        QVERIFY(batched.retrieve_range(0, 6) == "start:");
+        batched.move_by(1000000);
+        QVERIFY(batched.cursor_index() == batched.size());
+    }
+    remove(path.c_str());
+}
+
+/*
+ * A 1 MB paste is one edit, not a million lock round trips.
+ */
+void TestCases::TEST21B_editor_paste_time() {
+    const size_t paste_size = 1 << 20;
+    std::string paste(paste_size, 'p');
+    std::string path = write_temp_file("paste", "");
+
+    TextEditor per_key(path);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (char ch : paste) {
+        per_key.press_key(ch);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto per_key_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+
+    TextEditor pasted(path);
+    start = std::chrono::high_resolution_clock::now();
+    pasted.press_keys(paste);
+    end = std::chrono::high_resolution_clock::now();
+    auto paste_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+
+    QVERIFY(pasted.size() == paste_size);
+    QVERIFY(pasted.retrieve_range(0, paste_size) == per_key.retrieve_range(0, paste_size));
+    QVERIFY2(paste_time.count() * 10 < per_key_time.count(), "a paste should be one bulk insert");
+
+    // pasting nothing is no edit
+    uint64_t edits = pasted.edit_count();
+    uint64_t version = pasted.version();
+    pasted.press_keys("");
+    QVERIFY(pasted.edit_count() == edits && pasted.version() == version);
+    remove(path.c_str());
+}
+
+/*
+ * A reader hands out the whole document in order, in chunks of the
+ * requested size, and notices edits made while it reads.
+ */
+void TestCases::TEST22A_editor_reader() {
+    std::string contents;
+    for (int i = 0; i < 10000; ++i) {
+        contents += std::to_string(i) + ' ';
+    }
+    std::string path = write_temp_file("reader", contents);
+    for (ReadMode mode : {ReadMode::Locked, ReadMode::LockFree}) {
+        TextEditor editor(path, mode);
+        editor.wait_until_loaded();
+        for (size_t chunk_size : {1, 7, 4096, 1 << 20}) {
+            TextEditor::Reader reader(editor, 0, chunk_size, 3);
+            std::string read;
+            for (auto chunk = reader.next_chunk(); !chunk.empty(); chunk = reader.next_chunk()) {
+                QVERIFY(chunk.size() <= chunk_size);
+                read.append(chunk.data(), chunk.size());
+            }
+            QVERIFY(read == contents);
+            QVERIFY(reader.position() == contents.size());
+            QVERIFY(!reader.modified());
+        }
+
+        TextEditor::Reader reader(editor, 5, 10);
+        QVERIFY(reader.next_chunk() == contents.substr(5, 10));
+        editor.press_right(); // moving the cursor is not a change
+        QVERIFY(!reader.modified());
+        editor.press_key('x');
+        QVERIFY(reader.modified());
+    }
+    remove(path.c_str());
+}
+
+/*
+ * Reading the document through a reader costs about a copy, not a lock
+ * per character.
+ */
+void TestCases::TEST22B_editor_reader_time() {
+    const size_t file_size = 4 * 1024 * 1024;
+    std::string path = write_temp_file("reader-time", std::string(file_size, 'r'));
+    TextEditor editor(path);
+    editor.wait_until_loaded();
+    editor.press_key('!');
+
+    size_t count = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < editor.size(); ++i) {
+        count += editor.retrieve_character(i) == 'r';
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto per_char_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    QVERIFY(count == file_size);
+
+    count = 0;
+    start = std::chrono::high_resolution_clock::now();
+    TextEditor::Reader reader(editor);
+    for (auto chunk = reader.next_chunk(); !chunk.empty(); chunk = reader.next_chunk()) {
+        count += std::count(chunk.begin(), chunk.end(), 'r');
+    }
+    end = std::chrono::high_resolution_clock::now();
+    auto reader_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    QVERIFY(count == file_size);
+    QVERIFY2(reader_time.count() * 10 < per_char_time.count(), "a reader should not lock per character");
+    remove(path.c_str());
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+/*
+ * Saving writes back only what changed: an edit near the end patches the
+ * tail of the file in place, an edit near the start rewrites the file, and
+ * either way the file ends up matching the editor.
+ */
+void TestCases::TEST23A_editor_save() {
+    std::string contents(100000, 'a');
+    std::string path = write_temp_file("save", contents);
+    for (ReadMode mode : {ReadMode::Locked, ReadMode::LockFree}) {
+        {
+            std::ofstream reset(path, std::ios::binary);
+            reset << contents;
+        }
+        TextEditor editor(path, mode);
+        editor.wait_until_loaded();
+        QVERIFY(!editor.dirty());
+        QVERIFY(editor.save());
+        QVERIFY(editor.save_stats().saves == 0);
+
+        editor.move_by(90000);
+        editor.press_keys("xyz");
+        editor.press_backspace();
+        QVERIFY(editor.dirty());
+        QVERIFY(editor.save());
+        QVERIFY(!editor.dirty());
+        SaveStats stats = editor.save_stats();
+        QVERIFY(stats.in_place_saves == 1);
+        QVERIFY(stats.bytes_written == 10002);
+        QVERIFY(read_file(path) == editor.retrieve_range(0, editor.size()));
+
+        editor.apply({Command::backspace(), Command::backspace(), Command::backspace()});
+        QVERIFY(editor.save());
+        QVERIFY(editor.save_stats().bytes_written == 10002 + 10000);
+        QVERIFY(read_file(path) == editor.retrieve_range(0, editor.size()));
+        QVERIFY(editor.size() == 99999);
+
+        editor.move_by(-90000);
+        editor.press_key('!');
+        QVERIFY(editor.save());
+        stats = editor.save_stats();
+        QVERIFY(stats.saves == 3);
+        QVERIFY(stats.full_rewrites == 1);
+        QVERIFY(read_file(path) == editor.retrieve_range(0, editor.size()));
+    }
+    remove(path.c_str());
+}
+
+/*
+ * The autosaver runs alongside typing without holding it up, and once
+ * typing stops the file catches up with the editor.
+ */
+void TestCases::TEST23B_editor_autosave() {
+    std::string path = write_temp_file("autosave", std::string(1 << 20, '.'));
+    for (ReadMode mode : {ReadMode::Locked, ReadMode::LockFree}) {
+        TextEditor editor(path, mode);
+        editor.wait_until_loaded();
+        editor.move_by(1 << 19);
+        editor.start_autosave(std::chrono::milliseconds(1));
+        std::vector<long long> latencies;
+        for (int i = 0; i < 20000; ++i) {
+            auto start = std::chrono::high_resolution_clock::now();
+            if (i % 10 == 9) {
+                editor.press_backspace();
+            } else {
+                editor.press_key('a' + i % 26);
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (editor.dirty() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        editor.stop_autosave();
+        QVERIFY(!editor.dirty());
+        QVERIFY(editor.save_stats().saves > 0);
+        QVERIFY(read_file(path) == editor.retrieve_range(0, editor.size()));
+
+        std::sort(latencies.begin(), latencies.end());
+        long long p99 = latencies[latencies.size() * 99 / 100];
+        QVERIFY2(p99 < 1000000, "typing should not wait for the disk");
+    }
+    remove(path.c_str());
+}
+
+/*
+ * A process that dies right after sync() loses nothing: the document is
+ * rebuilt from the last checkpoint and the log after it, and a record torn
+ * by the crash is ignored.
+ */
+void TestCases::TEST24A_journal_recovery() {
+    std::string path = write_temp_file("journal", "hello world");
+    std::string journal_path = path + ".journal";
+    std::string expected_path = path + ".expected";
+    pid_t child = fork();
+    QVERIFY(child >= 0);
+    if (child == 0) {
+        int status = 1;
+        try {
+            TextEditor editor(path);
+            editor.start_journal(journal_path);
+            editor.move_by(5);
+            editor.press_keys(", big");
+            editor.press_right();
+            editor.checkpoint();
+            editor.apply({Command::move(100), Command::backspace(), Command::key('D'), Command::left()});
+            editor.press_key('!');
+            editor.press_backspace();
+            editor.press_left();
+            status = editor.sync() ? 0 : 2;
+            std::ofstream expected(expected_path, std::ios::binary);
+            expected << editor.cursor_index() << ' ' << editor.retrieve_range(0, editor.size());
+        } catch (...) {
+            status = 3;
+        }
+        _exit(status); // no destructors: the journal is never closed
+    }
+    int status = -1;
+    waitpid(child, &status, 0);
+    QVERIFY(WIFEXITED(status));
+    QVERIFY(WEXITSTATUS(status) == 0);
+    {
+        std::ofstream torn(journal_path + ".log", std::ios::binary | std::ios::app);
+        torn.write("\x20\0\0\0garbage", 11);
+    }
+
+    size_t cursor;
+    std::string text;
+    {
+        std::ifstream expected(expected_path, std::ios::binary);
+        expected >> cursor;
+        expected.get();
+        std::getline(expected, text, '\0');
+    }
+    QVERIFY(text == "hello, big worlD");
+    for (ReadMode mode : {ReadMode::Locked, ReadMode::LockFree}) {
+        TextEditor editor(path, mode);
+        QVERIFY(!editor.restore_journal(path + ".missing"));
+        QVERIFY(editor.restore_journal(journal_path));
+        QVERIFY(editor.retrieve_range(0, editor.size()) == text);
+        QVERIFY(editor.cursor_index() == cursor);
+    }
+    remove(path.c_str());
+    remove(expected_path.c_str());
+    remove((journal_path + ".log").c_str());
+    remove((journal_path + ".checkpoint").c_str());
+}
+
+/*
+ * Records appended without waiting share one fdatasync per batch, threads
+ * committing at the same time share syncs too, and everything committed
+ * is there on recovery.
+ */
+void TestCases::TEST24B_journal_group_commit() {
+    std::string path = "/tmp/journal-group-" + std::to_string(getpid());
+    JournalOptions options;
+    options.max_delay = std::chrono::seconds(1);
+    {
+        Journal journal(path, options);
+        journal.write_checkpoint("", 0, 0);
+        uint64_t lsn = 0;
+        for (int i = 0; i < 10000; ++i) {
+            Command key = Command::key('a' + i % 26);
+            lsn = journal.append(&key, 1);
+        }
+        QVERIFY(journal.wait_durable(lsn));
+        JournalStats stats = journal.stats();
+        QVERIFY(stats.records == 10000);
+        QVERIFY2(stats.syncs * 100 < stats.records, "appends should be batched into few syncs");
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; ++t) {
+            threads.emplace_back([&journal] {
+                for (int i = 0; i < 100; ++i) {
+                    Command move = Command::move(1);
+                    journal.commit(&move, 1);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        QVERIFY(journal.durable_lsn() == 10800);
+        QVERIFY(journal.stats().syncs <= journal.stats().records);
+    }
+    JournalRecovery recovery = Journal::recover(path);
+    QVERIFY(recovery.found);
+    QVERIFY(recovery.records == 10800);
+    QVERIFY(recovery.lsn == 10800);
+    QVERIFY(recovery.commands.size() == 10800);
+    QVERIFY(recovery.commands[25].ch == 'z');
+    QVERIFY(recovery.commands.back().type == Command::Type::Move);
+    remove((path + ".log").c_str());
+    remove((path + ".checkpoint").c_str());
+}
+
+/*
+ * A checkpoint copies the document a chunk at a time, so a key pressed
+ * meanwhile never waits for a whole copy. One that raced with typing is
+ * refused; one taken in a quiet moment recovers the document exactly.
+ */
+void TestCases::TEST24C_journal_checkpoint_while_typing() {
+    const size_t file_size = 32 * 1024 * 1024;
+    std::string path = write_temp_file("checkpoint", std::string(file_size, 'c'));
+    std::string journal_path = path + ".journal";
+    TextEditor editor(path);
+    editor.start_journal(journal_path);
+    auto start = std::chrono::high_resolution_clock::now();
+    QVERIFY(editor.retrieve_range(0, file_size).size() == file_size);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto whole_copy = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+
+    editor.enable_metrics(true);
+    std::atomic<bool> typing(true);
+    std::thread typist([&] {
+        while (typing) {
+            editor.press_key('k');
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    });
+    for (int i = 0; i < 4; ++i) {
+        editor.checkpoint();
+    }
+    typing = false;
+    typist.join();
+    uint64_t worst_key = editor.metrics().press_key.max;
+    editor.move_by(-3);
+    QVERIFY(editor.checkpoint());
+    editor.stop_journal();
+
+    TextEditor restored(path);
+    QVERIFY(restored.restore_journal(journal_path));
+    QVERIFY(restored.size() == editor.size());
+    QVERIFY(restored.cursor_index() == editor.cursor_index());
+    QVERIFY(restored.retrieve_range(0, restored.size()) == editor.retrieve_range(0, editor.size()));
+    remove(path.c_str());
+    remove((journal_path + ".log").c_str());
+    remove((journal_path + ".checkpoint").c_str());
+    QVERIFY2(worst_key * 2 < static_cast<uint64_t>(whole_copy.count()),
+             "a checkpoint must not hold typing up for a whole copy");
+}
+
+/*
+ * Buckets are exact below 16ns and within 1/16 above, and percentiles
+ * land in the right bucket.
+ */
+void TestCases::TEST25A_latency_histogram() {
+    for (uint64_t value : {0ULL, 1ULL, 15ULL, 16ULL, 17ULL, 1000ULL, 123456789ULL, ~0ULL}) {
+        size_t bucket = LatencyHistogram::bucket_of(value);
+        QVERIFY(bucket < LatencyHistogram::kBuckets);
+        uint64_t upper = LatencyHistogram::bucket_upper_bound(bucket);
+        QVERIFY(upper >= value);
+        QVERIFY(upper - value <= value / 16);
+        if (bucket > 0) {
+            QVERIFY(LatencyHistogram::bucket_upper_bound(bucket - 1) < value);
+        }
+    }
+
+    LatencyHistogram histogram;
+    QVERIFY(histogram.snapshot().count == 0);
+    QVERIFY(histogram.percentile(0.5) == 0);
+    for (uint64_t i = 1; i <= 10000; ++i) {
+        histogram.record(i);
+    }
+    LatencySnapshot snapshot = histogram.snapshot();
+    QVERIFY(snapshot.count == 10000);
+    QVERIFY(snapshot.max == 10000);
+    QVERIFY(snapshot.mean == 5000);
+    QVERIFY(snapshot.p50 >= 5000 && snapshot.p50 <= 5000 + 5000 / 16);
+    QVERIFY(snapshot.p99 >= 9900 && snapshot.p99 <= 9900 + 9900 / 16);
+    QVERIFY(snapshot.p999 >= 9990 && snapshot.p999 <= 9990 + 9990 / 16);
+    QVERIFY(histogram.to_json() == "{\"count\":10000,\"p50\":" + std::to_string(snapshot.p50) +
+                                   ",\"p99\":" + std::to_string(snapshot.p99) +
+                                   ",\"p999\":" + std::to_string(snapshot.p999) +
+                                   ",\"max\":10000,\"mean\":5000}");
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&histogram] {
+            for (int i = 0; i < 10000; ++i) {
+                histogram.record(7);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    QVERIFY(histogram.snapshot().count == 50000);
+    histogram.reset();
+    QVERIFY(histogram.snapshot().count == 0);
+}
+
+/*
+ * The editor times each instrumented operation once metrics are enabled,
+ * and counts every lock it takes either way.
+ */
+void TestCases::TEST25B_editor_metrics() {
+    std::string path = write_temp_file("metrics", "hello");
+    TextEditor editor(path);
+    editor.wait_until_loaded();
+    editor.press_key('x');
+    QVERIFY(editor.metrics().press_key.count == 0);
+    QVERIFY(editor.metrics().writer_locks > 0);
+
+    editor.reset_metrics();
+    editor.enable_metrics(true);
+    for (int i = 0; i < 100; ++i) {
+        editor.press_key('a');
+        editor.press_left();
+        editor.press_right();
+        editor.retrieve_character(0);
+    }
+    for (int i = 0; i < 50; ++i) {
+        editor.press_backspace();
+    }
+    EditorMetrics metrics = editor.metrics();
+    QVERIFY(metrics.press_key.count == 100);
+    QVERIFY(metrics.press_move.count == 200);
+    QVERIFY(metrics.press_backspace.count == 50);
+    QVERIFY(metrics.retrieve_character.count == 100);
+    QVERIFY(metrics.writer_locks == 350);
+    QVERIFY(metrics.reader_locks >= 100);
+    QVERIFY(metrics.writer_lock_wait.count == metrics.writer_locks);
+    QVERIFY(metrics.writer_contended <= metrics.writer_locks);
+    QVERIFY(metrics.press_key.p50 <= metrics.press_key.p99);
+    QVERIFY(metrics.press_key.p99 <= metrics.press_key.p999);
+
+    std::string json = editor.metrics_json();
+    QVERIFY(json.front() == '{' && json.back() == '}');
+    for (const char* key : {"\"press_key\":{\"count\":100,", "\"press_move\":{\"count\":200,",
+                            "\"press_backspace\":{\"count\":50,", "\"retrieve_character\":",
+                            "\"writer_lock_wait\":", "\"reader_lock_wait\":", "\"locks\":{\"writer\":350,"}) {
+        QVERIFY(json.find(key) != std::string::npos);
+    }
+    remove(path.c_str());
+}
+
+/*
+ * Batches for one document run in the order they were submitted, even
+ * with many documents sharing the workers.
+ */
+void TestCases::TEST26A_document_manager_order() {
+    const int documents = 20;
+    const int batches = 50;
+    std::vector<std::string> paths;
+    for (int d = 0; d < documents; ++d) {
+        paths.push_back(write_temp_file("manager-order-" + std::to_string(d), ""));
+    }
+    {
+        DocumentManager manager(4);
+        std::vector<std::future<void>> futures;
+        for (int b = 0; b < batches; ++b) {
+            for (const std::string& path : paths) {
+                char ch = 'A' + b % 26;
+                futures.push_back(manager.apply(path, {Command::key(ch), Command::key(ch)}));
+            }
+        }
+        futures.push_back(manager.submit(paths[0], [](TextEditor&) { throw std::string("failed"); }));
+        manager.wait_idle();
+        for (size_t i = 0; i + 1 < futures.size(); ++i) {
+            futures[i].get();
+        }
+        bool threw = false;
+        try {
+            futures.back().get();
+        } catch (const std::string&) {
+            threw = true;
+        }
+        QVERIFY(threw);
+
+        std::string expected;
+        for (int b = 0; b < batches; ++b) {
+            expected += std::string(2, 'A' + b % 26);
+        }
+        for (const std::string& path : paths) {
+            std::string text;
+            manager.submit(path, [&text](TextEditor& editor) {
+                text = editor.retrieve_range(0, editor.size());
+            }).get();
+            QVERIFY(text == expected);
+        }
+        manager.wait_idle();
+        DocumentStats stats = manager.stats();
+        QVERIFY(stats.documents == documents);
+        QVERIFY(stats.loads == documents);
+        QVERIFY(stats.tasks == documents * (batches + 1) + 1);
+    }
+    for (const std::string& path : paths) {
+        remove(path.c_str());
+    }
+}
+
+/*
+ * Over the memory budget, idle documents are saved and dropped, and come
+ * back with their edits the next time they are used.
+ */
+void TestCases::TEST26B_document_manager_eviction() {
+    const int documents = 10;
+    std::vector<std::string> paths;
+    for (int d = 0; d < documents; ++d) {
+        paths.push_back(write_temp_file("manager-evict-" + std::to_string(d), std::string(1000, '.')));
+    }
+    DocumentManager manager(1, 3500); // one worker, so documents are used in order
+    for (const std::string& path : paths) {
+        manager.apply(path, {Command::key('x')});
+    }
+    manager.wait_idle();
+    DocumentStats stats = manager.stats();
+    QVERIFY(stats.resident_bytes <= 3500);
+    QVERIFY(stats.resident == 3);
+    QVERIFY(stats.evictions == documents - 3);
+    QVERIFY(!manager.resident(paths[0]));
+    QVERIFY(manager.resident(paths[documents - 1]));
+
+    std::ifstream saved(paths[0], std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(saved)), std::istreambuf_iterator<char>());
+    QVERIFY(contents == "x" + std::string(1000, '.'));
+
+    manager.apply(paths[0], {Command::right(), Command::key('y')}).get();
+    std::string text;
+    manager.submit(paths[0], [&text](TextEditor& editor) {
+        text = editor.retrieve_range(0, 4);
+    }).get();
+    QVERIFY(text == "x.y.");
+    manager.wait_idle();
+    QVERIFY(manager.stats().loads == documents + 1);
+    QVERIFY(manager.stats().resident_bytes <= 3500);
+    for (const std::string& path : paths) {
+        remove(path.c_str());
+    }
+}
+
+/*
+ * With two workers documents finish in any order, so which ones stay in
+ * memory is not fixed. Whatever the order, the budget holds once the
+ * manager is idle and every document, evicted or not, keeps its edit.
+ */
+void TestCases::TEST26C_document_manager_parallel_eviction() {
+    const int documents = 10;
+    std::vector<std::string> paths;
+    for (int d = 0; d < documents; ++d) {
+        paths.push_back(write_temp_file("manager-parallel-" + std::to_string(d), std::string(1000, '.')));
+    }
+    DocumentManager manager(2, 3500);
+    for (int round = 0; round < 3; ++round) {
+        for (const std::string& path : paths) {
+            manager.apply(path, {Command::key('x')});
+        }
+        manager.wait_idle();
+        DocumentStats stats = manager.stats();
+        QVERIFY(stats.resident_bytes <= 3500);
+        QVERIFY(stats.resident <= 3);
+        QVERIFY(stats.loads - stats.evictions == stats.resident);
+    }
+    std::string expected = "xxx" + std::string(1000, '.');
+    for (const std::string& path : paths) {
+        if (manager.resident(path)) continue;
+        std::ifstream saved(path, std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(saved)), std::istreambuf_iterator<char>());
+        QVERIFY(contents == expected);
+    }
+    for (const std::string& path : paths) {
+        std::string text;
+        manager.submit(path, [&text](TextEditor& editor) {
+            text = editor.retrieve_range(0, editor.size());
+        }).get();
+        QVERIFY(text == expected);
+    }
+    manager.wait_idle();
+    QVERIFY(manager.stats().resident_bytes <= 3500);
+    for (const std::string& path : paths) {
+        remove(path.c_str());
+    }
+}
+
+// The rows of a viewport, one string per row.
+std::vector<std::string> rendered_rows(Viewport& viewport) {
+    std::vector<std::string> rows;
+    for (const ViewRow& row : viewport.render()) {
+        rows.emplace_back(row.text);
+    }
+    return rows;
+}
+
+// The unwrapped lines of text from the one holding first, at most count.
+std::vector<std::string> expected_rows(const std::string& text, size_t first, size_t count) {
+    std::vector<std::string> lines;
+    std::istringstream in(text);
+    std::string line;
+    for (size_t i = 0; std::getline(in, line); ++i) {
+        if (i >= first && lines.size() < count) lines.push_back(line);
+    }
+    if ((text.empty() || text.back() == '\n') && lines.size() < count) {
+        lines.push_back("");
+    }
+    return lines;
+}
+
+/*
+ * A viewport shows the lines from its top, wraps long ones at spaces, and
+ * follows edits and scrolling.
+ */
+void TestCases::TEST27A_viewport_render() {
+    std::string contents;
+    for (int i = 0; i < 100; ++i) {
+        contents += "line " + std::to_string(i) + "\n";
+    }
+    std::string path = write_temp_file("viewport", contents);
+    TextEditor editor(path);
+    editor.wait_until_loaded();
+    Viewport viewport(editor, 80, 10);
+    QVERIFY(rendered_rows(viewport) == expected_rows(contents, 0, 10));
+    QVERIFY(viewport.render().front().position == 0);
+    QVERIFY(viewport.render()[1].position == 7);
+
+    viewport.scroll_by(95);
+    QVERIFY(rendered_rows(viewport) == expected_rows(contents, 95, 10));
+    QVERIFY(viewport.render().size() == 6); // five lines and the empty last one
+    viewport.scroll_by(1000);
+    QVERIFY(viewport.top() == contents.size());
+    viewport.scroll_by(-1000);
+    QVERIFY(viewport.top() == 0);
+    viewport.scroll_to(contents.find("line 50"));
+    QVERIFY(rendered_rows(viewport) == expected_rows(contents, 50, 10));
+    viewport.scroll_by(-3);
+    QVERIFY(rendered_rows(viewport) == expected_rows(contents, 47, 10));
+
+    // split line 48 in two, then join it back
+    editor.move_by(static_cast<int>(contents.find("line 48") + 4));
+    editor.press_key('\n');
+    std::string text = editor.retrieve_range(0, editor.size());
+    QVERIFY(rendered_rows(viewport) == expected_rows(text, 47, 10));
+    editor.press_backspace();
+    QVERIFY(rendered_rows(viewport) == expected_rows(contents, 47, 10));
+
+    // deleting the newline above the top merges the top line upwards
+    editor.move_by(static_cast<int>(contents.find("line 47") - editor.cursor_index()));
+    editor.press_backspace();
+    text = editor.retrieve_range(0, editor.size());
+    QVERIFY(rendered_rows(viewport) == expected_rows(text, 46, 10));
+    QVERIFY(viewport.top() == text.find("line 46"));
+
+    viewport.resize(6, 4);
+    viewport.scroll_to(0);
+    editor.move_by(-static_cast<int>(editor.cursor_index()));
+    editor.press_keys("a bc defghijkl ");
+    std::vector<std::string> wrapped = {"a bc ", "defghi", "jkl ", "line 0"};
+    QVERIFY(rendered_rows(viewport) == wrapped);
+    QVERIFY(!viewport.render()[2].line_end);
+    remove(path.c_str());
+}
+
+/*
+ * Typing re-reads only the line being edited, scrolling reads only the
+ * line scrolled into view, and edits the viewport cannot catch up with
+ * any more drop the whole cache.
+ */
+void TestCases::TEST27B_viewport_incremental() {
+    std::string contents;
+    for (int i = 0; i < 1000; ++i) {
+        contents += std::string(60, 'a' + i % 26) + "\n";
+    }
+    std::string path = write_temp_file("viewport-incremental", contents);
+    TextEditor editor(path);
+    editor.wait_until_loaded();
+    Viewport viewport(editor, 500, 50); // wide enough that no line wraps
+    viewport.render();
+    QVERIFY(viewport.stats().lines_laid_out == 50);
+
+    editor.move_by(61 * 20 + 30);
+    for (int i = 0; i < 100; ++i) {
+        ViewportStats before = viewport.stats();
+        editor.press_key('x');
+        viewport.render();
+        QVERIFY(viewport.stats().lines_laid_out - before.lines_laid_out == 1);
+        QVERIFY(viewport.stats().lines_reused - before.lines_reused == 49);
+    }
+
+    ViewportStats before = viewport.stats();
+    viewport.scroll_by(1);
+    viewport.render();
+    QVERIFY(viewport.stats().lines_laid_out - before.lines_laid_out == 1);
+
+    before = viewport.stats();
+    for (int i = 0; i < 300; ++i) {
+        editor.press_key('y');
+    }
+    viewport.render();
+    QVERIFY(viewport.stats().full_invalidations == before.full_invalidations + 1);
+    std::string text = editor.retrieve_range(0, editor.size());
+    QVERIFY(rendered_rows(viewport) == expected_rows(text, 1, 50));
+    remove(path.c_str());
+}
+
+// Every position where query occurs in text, in order.
+std::vector<size_t> all_matches(const std::string& text, const std::string& query) {
+    std::vector<size_t> matches;
+    for (size_t found = text.find(query); found != std::string::npos; found = text.find(query, found + 1)) {
+        matches.push_back(found);
+    }
+    return matches;
+}
+
+// Searches the rest of the document and returns every match from the focus.
+std::vector<size_t> search_all(SearchSession& search) {
+    while (!search.step()) {}
+    std::vector<size_t> results;
+    search.results(results, search.count());
+    return results;
+}
+
+/*
+ * A search session finds every match, keeps them right as the query grows
+ * and the document is edited, and starts over when the query changes.
+ * Growing the query costs nothing until step() rechecks the matches, and
+ * dense matches ("a" here) are found again rather than kept.
+ */
+void TestCases::TEST28A_search_matches() {
+    std::string contents;
+    for (int i = 0; i < 2000; ++i) {
+        contents += "abc aaaa " + std::string(20, 'b') + " abd " + std::to_string(i) + "\n";
+    }
+    std::string path = write_temp_file("search", contents);
+    TextEditor editor(path);
+    editor.wait_until_loaded();
+    SearchSession search(editor);
+    search.set_query("a");
+    QVERIFY(search_all(search) == all_matches(contents, "a"));
+    QVERIFY(search.count() == all_matches(contents, "a").size());
+
+    uint64_t scanned = search.stats().characters_scanned;
+    search.set_query("ab");
+    QVERIFY(search_all(search) == all_matches(contents, "ab"));
+    QVERIFY(search.stats().characters_scanned > scanned);
+
+    scanned = search.stats().characters_scanned;
+    uint64_t verified = search.stats().matches_verified;
+    search.set_query("abd");
+    QVERIFY(search.stats().matches_verified == verified);
+    QVERIFY(search.count() == 0);
+    QVERIFY(!search.complete());
+    QVERIFY(search_all(search) == all_matches(contents, "abd"));
+    QVERIFY(search.stats().matches_verified == verified + all_matches(contents, "ab").size());
+    QVERIFY(search.stats().characters_scanned == scanned);
+    QVERIFY(search.stats().restarts == 0);
+
+    std::mt19937 random(7);
+    for (int i = 0; i < 300; ++i) {
+        int target = random() % (editor.size() + 1);
+        editor.move_by(target - static_cast<int>(editor.cursor_index()));
+        if (random() % 3 == 0) {
+            editor.press_backspace();
+        } else {
+            editor.press_keys(random() % 2 ? "ab" : "d");
+        }
+        if (i % 25 == 0) {
+            std::string text = editor.retrieve_range(0, editor.size());
+            QVERIFY(search_all(search) == all_matches(text, "abd"));
+        }
+    }
+    std::string text = editor.retrieve_range(0, editor.size());
+    QVERIFY(search_all(search) == all_matches(text, "abd"));
+    QVERIFY(search.count() == all_matches(text, "abd").size());
+
+    search.set_query("ab");
+    QVERIFY(search.stats().restarts == 1);
+    QVERIFY(search_all(search) == all_matches(text, "ab"));
+
+    // an edit inside a dense block has the whole block searched again
+    search.set_query("b");
+    QVERIFY(search_all(search) == all_matches(text, "b"));
+    editor.move_by(-40);
+    editor.press_keys("bb");
+    text = editor.retrieve_range(0, editor.size());
+    QVERIFY(search_all(search) == all_matches(text, "b"));
+    QVERIFY(search.count() == all_matches(text, "b").size());
+    remove(path.c_str());
+}
+
+/*
+ * Searching starts at the focus and goes in bounded steps, and an edit
+ * only searches again around itself.
+ */
+void TestCases::TEST28B_search_incremental() {
+    std::string contents(4 * 1024 * 1024, '.');
+    for (size_t i = 100; i + 6 < contents.size(); i += 4096) {
+        contents.replace(i, 6, "needle");
+    }
+    std::vector<size_t> expected = all_matches(contents, "needle");
+    std::string path = write_temp_file("search-incremental", contents);
+    TextEditor editor(path);
+    editor.wait_until_loaded();
+    SearchSession search(editor);
+    size_t focus = 2 * 1024 * 1024;
+    search.focus(focus);
+    search.set_query("need");
+    search.set_query("needle");
+
+    QVERIFY(!search.step(64 * 1024));
+    QVERIFY(search.stats().characters_scanned < 65 * 1024);
+    std::vector<size_t> results;
+    QVERIFY(search.results(results, 10) == 10);
+    QVERIFY(results.front() >= focus && results.back() < focus + 64 * 1024);
+
+    results = search_all(search);
+    QVERIFY(results.size() == expected.size());
+    size_t wrap = std::lower_bound(expected.begin(), expected.end(), focus) - expected.begin();
+    QVERIFY(std::equal(expected.begin() + wrap, expected.end(), results.begin()));
+    QVERIFY(std::equal(expected.begin(), expected.begin() + wrap, results.end() - wrap));
+
+    SearchStats before = search.stats();
+    editor.move_by(1024 * 1024);
+    for (char ch : std::string("needle")) {
+        editor.press_key(ch);
+    }
+    QVERIFY(search.step());
+    QVERIFY(search.stats().characters_scanned - before.characters_scanned < 6 * 16);
+    QVERIFY(search.count() == expected.size() + 1);
+
+    editor.move_by(-3);
+    editor.press_backspace();
+    QVERIFY(search.step());
+    QVERIFY(search.count() == expected.size());
+    QVERIFY(search.stats().restarts == 0);
+    remove(path.c_str());
+}
+
+/*
+ * A mapped editor behaves like an in-memory one through the whole API,
+ * and saves what it shows.
+ */
+void TestCases::TEST29A_mapped_editing() {
+    std::string contents;
+    for (int i = 0; i < 5000; ++i) {
+        contents += "row " + std::to_string(i) + "\n";
+    }
+    std::string memory_path = write_temp_file("mapped-memory", contents);
+    std::string mapped_path = write_temp_file("mapped", contents);
+    TextEditor memory(memory_path);
+    TextEditor mapped(mapped_path, ReadMode::Locked, Storage::Mapped);
+    memory.wait_until_loaded();
+    QVERIFY(mapped.storage() == Storage::Mapped);
+    QVERIFY(mapped.load_progress().done);
+    QVERIFY(mapped.size() == contents.size());
+    QVERIFY(mapped.retrieve_range(0, mapped.size()) == contents);
+
+    std::mt19937 random(11);
+    for (int i = 0; i < 2000; ++i) {
+        std::vector<Command> commands;
+        switch (random() % 4) {
+        case 0: commands.push_back(Command::move(static_cast<int>(random() % 2001) - 1000)); break;
+        case 1: commands.push_back(Command::key('a' + random() % 26)); break;
+        case 2: commands.push_back(Command::backspace()); break;
+        default: commands = {Command::key('<'), Command::left(), Command::key('>'), Command::right()}; break;
+        }
+        memory.apply(commands);
+        mapped.apply(commands);
+        QVERIFY(mapped.cursor_index() == memory.cursor_index());
+        size_t position = random() % memory.size();
+        QVERIFY(mapped.retrieve_character(position) == memory.retrieve_character(position));
+    }
+    mapped.press_keys("typed");
+    memory.press_keys("typed");
+    mapped.press_backspace();
+    memory.press_backspace();
+    std::string expected = memory.retrieve_range(0, memory.size());
+    QVERIFY(mapped.retrieve_range(0, mapped.size()) == expected);
+    TextEditor::Reader reader(mapped, 0, 1000);
+    std::string streamed;
+    for (auto chunk = reader.next_chunk(); !chunk.empty(); chunk = reader.next_chunk()) {
+        streamed += chunk;
+    }
+    QVERIFY(streamed == expected);
+
+    QVERIFY(mapped.save());
+    QVERIFY(!mapped.dirty());
+    QVERIFY(read_file(mapped_path) == expected);
+    QVERIFY(mapped.retrieve_range(0, mapped.size()) == expected);
+    QVERIFY(mapped.cursor_index() == memory.cursor_index());
+    mapped.press_key('!');
+    memory.press_key('!');
+    QVERIFY(mapped.retrieve_range(0, mapped.size()) == memory.retrieve_range(0, memory.size()));
+
+    bool threw = false;
+    try {
+        TextEditor lock_free(mapped_path, ReadMode::LockFree, Storage::Mapped);
+    } catch (const std::string&) {
+        threw = true;
+    }
+    QVERIFY(threw);
+    remove(memory_path.c_str());
+    remove(mapped_path.c_str());
+}
+
+/*
+ * Opening a mapped file reads none of it, and editing it keeps only the
+ * edits in memory.
+ */
+void TestCases::TEST29B_mapped_large_file() {
+    std::string path = write_temp_file("mapped-large", "");
+    const size_t size = size_t(1) << 30;
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.seekp(size - 4);
+        file.write("end\n", 4);
+    }
+    auto start = std::chrono::steady_clock::now();
+    TextEditor editor(path, ReadMode::Locked, Storage::Mapped);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    QVERIFY(elapsed < std::chrono::milliseconds(100));
+    QVERIFY(editor.size() == size);
+    QVERIFY(editor.retrieve_range(size - 4, 4) == "end\n");
+    QVERIFY(editor.retrieve_character(size / 2) == '\0');
+
+    editor.press_keys("head ");
+    editor.apply({Command::move(1 << 30), Command::backspace(), Command::key('!')});
+    editor.move_by(-(1 << 29));
+    editor.press_key('|');
+    QVERIFY(editor.size() == size + 6);
+    QVERIFY(editor.retrieve_range(0, 6) == std::string("head \0", 6));
+    QVERIFY(editor.retrieve_range(size + 2, 4) == "end!");
+    QVERIFY(editor.retrieve_range(size + 5 - (size_t(1) << 29) - 1, 3) == std::string("\0|\0", 3));
+    remove(path.c_str());
+}
+
+/*
+ * Edits scattered all over a mapped document leave it in many pieces. An
+ * edit must not get slower in proportion to how many there are.
+ */
+void TestCases::TEST29C_mapped_scattered_edits() {
+    std::string model(1 << 20, '.');
+    std::string path = write_temp_file("mapped-scattered", model);
+    TextEditor editor(path, ReadMode::Locked, Storage::Mapped);
+    std::mt19937 random(29);
+    auto edit = [&](int edits) {
+        std::chrono::steady_clock::duration spent{};
+        for (int i = 0; i < edits; ++i) {
+            size_t target = random() % (model.size() + 1);
+            int delta = static_cast<int>(target) - static_cast<int>(editor.cursor_index());
+            char ch = 'a' + random() % 26;
+            bool erase = random() % 4 == 0 && target > 0;
+            std::vector<Command> commands = {Command::move(delta),
+                                             erase ? Command::backspace() : Command::key(ch)};
+            auto start = std::chrono::steady_clock::now();
+            editor.apply(commands);
+            spent += std::chrono::steady_clock::now() - start;
+            if (erase) {
+                model.erase(target - 1, 1);
+            } else {
+                model.insert(target, 1, ch);
+            }
+        }
+        return spent;
+    };
+    auto few_pieces = edit(2000);
+    edit(60000);
+    auto many_pieces = edit(2000);
+    QVERIFY(editor.retrieve_range(0, editor.size()) == model);
+    remove(path.c_str());
+    QVERIFY2(many_pieces < 10 * few_pieces, "an edit should cost O(log pieces)");
+}
+
+// text with edits applied, as apply_remote documents them.
+std::string apply_edits_to(std::string text, const std::vector<RemoteEdit>& edits) {
+    for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+        text.replace(edit->position, edit->erase, edit->insert);
+    }
+    return text;
+}
+
+/*
+ * apply_remote applies a batch in one go in every storage and read mode,
+ * keeps the cursor by the same character, and refuses a batch made
+ * against an older state.
+ */
+void TestCases::TEST30A_remote_edit_batches() {
+    std::string contents;
+    for (int i = 0; i < 100; ++i) {
+        contents += "0123456789";
+    }
+    std::string path = write_temp_file("remote", contents);
+    std::vector<std::pair<ReadMode, Storage>> setups = {{ReadMode::Locked, Storage::InMemory},
+                                                        {ReadMode::LockFree, Storage::InMemory},
+                                                        {ReadMode::Locked, Storage::Mapped}};
+    for (auto [mode, storage] : setups) {
+        TextEditor editor(path, mode, storage);
+        editor.wait_until_loaded();
+        editor.move_by(500);
+        uint64_t count = editor.edit_count();
+        // spread over the document, so Locked mode sweeps the whole buffer
+        std::vector<RemoteEdit> spread = {{0, 2, "ab"}, {100, 0, "xyz"}, {495, 10, ""}, {990, 10, "end"}};
+        QVERIFY(editor.apply_remote(spread, count));
+        std::string expected = apply_edits_to(contents, spread);
+        QVERIFY(editor.retrieve_range(0, editor.size()) == expected);
+        QVERIFY(count == editor.edit_count());
+        QVERIFY(editor.cursor_index() == 498); // erased under it: now after the replacement
+        std::vector<TextEdit> history;
+        QVERIFY(editor.edits_since(count - spread.size(), history) && history.size() == spread.size());
+
+        // close to the cursor, so applied edit by edit
+        std::vector<RemoteEdit> close = {{490, 1, "<"}, {498, 0, "|"}, {498, 1, ">"}};
+        QVERIFY(editor.apply_remote(close, count));
+        expected = apply_edits_to(expected, close);
+        QVERIFY(editor.retrieve_range(0, editor.size()) == expected);
+        QVERIFY(editor.cursor_index() == 500); // replaced from under it: after the '>'
+        QVERIFY(editor.retrieve_character(editor.cursor_index() - 1) == '>');
+
+        editor.press_key('!');
+        uint64_t stale = count;
+        QVERIFY(!editor.apply_remote(close, stale));
+        QVERIFY(stale == count);
+        QVERIFY(editor.size() == expected.size() + 1);
+
+        count = editor.edit_count();
+        bool threw = false;
+        try {
+            editor.apply_remote({{10, 5, ""}, {12, 0, "x"}}, count);
+        } catch (const std::string&) {
+            threw = true;
+        }
+        QVERIFY(threw);
+        QVERIFY(editor.size() == expected.size() + 1);
+    }
+    remove(path.c_str());
+}
+
+/*
+ * Two editors typing at once and trading batches over a delayed channel
+ * end up with the same text, and each keeps its cursor where its user
+ * left it.
+ */
+void TestCases::TEST30B_collab_converges() {
+    std::string contents;
+    for (int i = 0; i < 200; ++i) {
+        contents += "line " + std::to_string(i) + "\n";
+    }
+    std::string left_path = write_temp_file("collab-left", contents);
+    std::string right_path = write_temp_file("collab-right", contents);
+    TextEditor left(left_path);
+    TextEditor right(right_path);
+    left.wait_until_loaded();
+    right.wait_until_loaded();
+    CollabSession left_session(left, true);
+    CollabSession right_session(right, false);
+    std::deque<CollabMessage> to_left, to_right;
+
+    std::mt19937 random(5);
+    auto type_somewhere = [&random](TextEditor& editor) {
+        int target = random() % (editor.size() + 1);
+        editor.move_by(target - static_cast<int>(editor.cursor_index()));
+        switch (random() % 4) {
+        case 0: editor.press_backspace(); break;
+        case 1: editor.press_keys("word "); break;
+        case 2: editor.apply({Command::backspace(), Command::backspace(), Command::key('#')}); break;
+        default: editor.press_key('a' + random() % 26); break;
+        }
+    };
+    auto exchange = [&] {
+        to_right.push_back(left_session.outgoing());
+        to_left.push_back(right_session.outgoing());
+    };
+    auto deliver = [](std::deque<CollabMessage>& queue, CollabSession& session) {
+        session.receive(queue.front());
+        queue.pop_front();
+    };
+    for (int round = 0; round < 2000; ++round) {
+        switch (random() % 8) {
+        case 0: case 1: type_somewhere(left); break;
+        case 2: case 3: type_somewhere(right); break;
+        case 4: exchange(); break;
+        default:
+            if (!to_left.empty() && random() % 2) deliver(to_left, left_session);
+            if (!to_right.empty() && random() % 2) deliver(to_right, right_session);
+            break;
+        }
+    }
+    left.move_by(-static_cast<int>(left.cursor_index()));
+    left.press_keys("<>");
+    left.press_left();
+    right.move_by(-static_cast<int>(right.cursor_index()));
+    right.press_keys("remote ");
+    for (int i = 0; i < 3; ++i) {
+        exchange();
+        while (!to_left.empty()) deliver(to_left, left_session);
+        while (!to_right.empty()) deliver(to_right, right_session);
+    }
+    std::string text = left.retrieve_range(0, left.size());
+    QVERIFY(text == right.retrieve_range(0, right.size()));
+    QVERIFY(left.retrieve_range(left.cursor_index() - 1, 2) == "<>");
+    QVERIFY(right.retrieve_range(right.cursor_index() - 7, 7) == "remote ");
+    QVERIFY(text.find("<>") == 0 && text.find("remote ") == 2);
+    QVERIFY(left_session.stats().batches_sent == right_session.stats().batches_received);
+    QVERIFY(right_session.stats().batches_sent == left_session.stats().batches_received);
+    QVERIFY(left_session.stats().batches_received > 50);
+    remove(left_path.c_str());
+    remove(right_path.c_str());
+}
+
+/*
+ * Far more edits than the editor's own history holds are typed on both
+ * sides between exchanges; the sessions still converge.
+ */
+void TestCases::TEST30C_collab_long_offline_typing() {
+    std::string contents(400, '.');
+    std::string left_path = write_temp_file("collab-offline-left", contents);
+    std::string right_path = write_temp_file("collab-offline-right", contents);
+    TextEditor left(left_path);
+    TextEditor right(right_path);
+    left.wait_until_loaded();
+    right.wait_until_loaded();
+    std::vector<TextEdit> history;
+    {
+        CollabSession left_session(left, true);
+        CollabSession right_session(right, false);
+        std::mt19937 random(30);
+        auto type_a_lot = [&random](TextEditor& editor, int edits) {
+            for (int i = 0; i < edits; ++i) {
+                int target = random() % (editor.size() + 1);
+                editor.move_by(target - static_cast<int>(editor.cursor_index()));
+                if (random() % 3 == 0 && target > 0) {
+                    editor.press_backspace();
+                } else {
+                    editor.press_key('a' + random() % 26);
+                }
+            }
+        };
+        for (int round = 0; round < 3; ++round) {
+            uint64_t since = left.edit_count();
+            type_a_lot(left, 1000);
+            type_a_lot(right, 300);
+            QVERIFY(left.edits_since(since, history) && history.size() == left.edit_count() - since);
+            QVERIFY(history.size() == 1000);
+            history.clear();
+            CollabMessage to_right = left_session.outgoing();
+            CollabMessage to_left = right_session.outgoing();
+            type_a_lot(left, 400);
+            right_session.receive(to_right);
+            left_session.receive(to_left);
+            type_a_lot(right, 400);
+            to_right = left_session.outgoing();
+            to_left = right_session.outgoing();
+            right_session.receive(to_right);
+            left_session.receive(to_left);
+            to_right = left_session.outgoing();
+            to_left = right_session.outgoing();
+            right_session.receive(to_right);
+            left_session.receive(to_left);
+            QVERIFY(left.retrieve_range(0, left.size()) == right.retrieve_range(0, right.size()));
+        }
+    }
+    // with the sessions gone the editor forgets old edits again
+    uint64_t since = left.edit_count();
+    for (int i = 0; i < 300; ++i) {
+        left.press_key('x');
+    }
+    QVERIFY(!left.edits_since(since, history));
+    remove(left_path.c_str());
+    remove(right_path.c_str());
+}
+
+/*
+ * apply_remote journals the cursor jumps between its edits as moves. On a
+ * document past 2 GiB a jump does not fit one move, so it is split into
+ * moves the journal can hold that still add up to it.
+ */
+void TestCases::TEST30D_remote_edit_long_cursor_jumps() {
+    const long long longest = std::numeric_limits<int32_t>::max();
+    for (long long delta : {0LL, 5LL, -5LL, longest, -longest, longest + 1, -longest - 1,
+                            5000000000LL, -5000000000LL, 3 * longest}) {
+        std::vector<Command> commands;
+        Command::append_move(commands, delta);
+        long long total = 0;
+        for (const Command& command : commands) {
+            QVERIFY(command.type == Command::Type::Move);
+            QVERIFY(command.delta >= -longest && command.delta <= longest);
+            total += command.delta;
+        }
+        QVERIFY(total == delta);
+        QVERIFY(static_cast<long long>(commands.size()) == std::max(1LL, (std::abs(delta) + longest - 1) / longest));
+    }
+
+    // a batch journalled with its jumps replays to the same text
+    std::string contents;
+    for (int i = 0; i < 100; ++i) {
+        contents += "line " + std::to_string(i) + "\n";
+    }
+    std::string path = write_temp_file("remote-journal", contents);
+    std::string journal_path = path + ".journal";
+    size_t cursor = 0;
+    {
+        TextEditor editor(path);
+        editor.wait_until_loaded();
+        editor.move_by(300);
+        editor.start_journal(journal_path);
+        uint64_t edit_count = editor.edit_count();
+        QVERIFY(editor.apply_remote({{0, 4, "LINE"}, {400, 0, "+"}, {600, 1, ""}}, edit_count));
+        editor.press_key('!');
+        QVERIFY(editor.sync());
+        contents = editor.retrieve_range(0, editor.size());
+        cursor = editor.cursor_index();
+        editor.stop_journal();
+    }
+    TextEditor restored(path);
+    QVERIFY(restored.restore_journal(journal_path));
+    QVERIFY(restored.retrieve_range(0, restored.size()) == contents);
+    QVERIFY(restored.cursor_index() == cursor);
+    remove(path.c_str());
+    remove((journal_path + ".log").c_str());
+    remove((journal_path + ".checkpoint").c_str());
+}
 
 QTEST_APPLESS_MAIN(TestCases)
 
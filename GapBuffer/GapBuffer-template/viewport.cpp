@@ -0,0 +1,191 @@
+#include "viewport.h"
+#include <algorithm>
+
+// Lines are read from the editor this many characters at a time.
+const size_t kLineChunkSize = 256;
+
+Viewport::Viewport(TextEditor& editor, size_t width, size_t height) :
+    _editor(editor),
+    _width(std::max<size_t>(width, 1)),
+    _height(height),
+    _top(0),
+    _edits_seen(editor.edit_count()),
+    _stats{0, 0, 0} {}
+
+/*
+ * The visible rows, top to bottom: fewer than height only if the document
+ * ends first. Only lines that are not cached are read from the editor.
+ */
+const std::vector<ViewRow>& Viewport::render() {
+    catch_up();
+    _rows.clear();
+    size_t position = _top;
+    while (_rows.size() < _height) {
+        const Line& line = line_at(position);
+        std::string_view text(line.text);
+        for (size_t r = 0; r < line.rows.size() && _rows.size() < _height; ++r) {
+            size_t begin = line.rows[r];
+            size_t end = r + 1 < line.rows.size() ? line.rows[r + 1] : text.size();
+            _rows.push_back({position + begin, text.substr(begin, end - begin), r + 1 == line.rows.size()});
+        }
+        if (!line.newline) break;
+        position += line.text.size() + 1;
+    }
+    trim_cache();
+    return _rows;
+}
+
+// A new width changes every wrap point, so it empties the cache.
+void Viewport::resize(size_t width, size_t height) {
+    width = std::max<size_t>(width, 1);
+    if (width != _width) {
+        _lines.clear();
+    }
+    _width = width;
+    _height = height;
+    _rows.clear();
+}
+
+// Puts the line holding position at the top.
+void Viewport::scroll_to(size_t position) {
+    catch_up();
+    _top = line_start(std::min(position, _editor.size()));
+}
+
+// Moves the top by whole lines, down for positive, stopping at either end.
+void Viewport::scroll_by(int lines) {
+    catch_up();
+    for (; lines > 0; --lines) {
+        const Line& line = line_at(_top);
+        if (!line.newline) break;
+        _top += line.text.size() + 1;
+    }
+    for (; lines < 0 && _top > 0; ++lines) {
+        _top = line_start(_top - 1);
+    }
+}
+
+size_t Viewport::top() const {
+    return _top;
+}
+
+ViewportStats Viewport::stats() const {
+    return _stats;
+}
+
+// Brings the cache and the top line up to date with the editor's edits.
+void Viewport::catch_up() {
+    std::vector<TextEdit> edits;
+    if (!_editor.edits_since(_edits_seen, edits)) {
+        _edits_seen = _editor.edit_count();
+        _lines.clear();
+        _stats.full_invalidations++;
+        _top = line_start(std::min(_top, _editor.size()));
+        return;
+    }
+    _edits_seen += edits.size();
+    bool realign_top = false;
+    for (const TextEdit& edit : edits) {
+        invalidate(edit, realign_top);
+    }
+    if (realign_top) {
+        _top = line_start(_top);
+    }
+}
+
+/*
+ * Applies one edit to the cache. A line survives untouched if it ends
+ * (newline included) before the edit, and moves by the size change if it
+ * starts after the removed range; every other line overlapped the edit
+ * and is dropped. If the edit swallowed the start of the top line, the
+ * top moves to the edit and is realigned to a line start afterwards.
+ */
+void Viewport::invalidate(const TextEdit& edit, bool& realign_top) {
+    size_t removed_end = edit.position + edit.removed;
+    auto it = _lines.begin();
+    while (it != _lines.end() && it->first + it->second.text.size() < edit.position) {
+        ++it;
+    }
+    while (it != _lines.end() && it->first <= removed_end) {
+        it = _lines.erase(it);
+    }
+    if (edit.inserted != edit.removed) {
+        std::vector<decltype(_lines)::node_type> moved;
+        while (it != _lines.end()) {
+            auto next = std::next(it);
+            moved.push_back(_lines.extract(it));
+            it = next;
+        }
+        for (auto& node : moved) {
+            node.key() = node.key() - edit.removed + edit.inserted;
+            _lines.insert(std::move(node));
+        }
+    }
+
+    if (_top > removed_end) {
+        _top = _top - edit.removed + edit.inserted;
+    } else if (_top > edit.position) {
+        _top = edit.position;
+        realign_top = true;
+    }
+}
+
+// The line starting at start, from the cache or read and wrapped now.
+const Viewport::Line& Viewport::line_at(size_t start) {
+    auto found = _lines.find(start);
+    if (found != _lines.end()) {
+        _stats.lines_reused++;
+        return found->second;
+    }
+    Line line;
+    line.newline = false;
+    size_t position = start;
+    while (true) {
+        std::string chunk = _editor.retrieve_range(position, kLineChunkSize);
+        size_t newline = chunk.find('\n');
+        if (newline != std::string::npos) {
+            line.text.append(chunk, 0, newline);
+            line.newline = true;
+            break;
+        }
+        line.text += chunk;
+        position += chunk.size();
+        if (chunk.size() < kLineChunkSize) break;
+    }
+
+    line.rows.push_back(0);
+    size_t row = 0;
+    while (line.text.size() - row > _width) {
+        size_t limit = row + _width;
+        size_t space = line.text.rfind(' ', limit - 1);
+        size_t next = space != std::string::npos && space >= row ? space + 1 : limit;
+        line.rows.push_back(next);
+        row = next;
+    }
+    _stats.lines_laid_out++;
+    return _lines.emplace(start, std::move(line)).first->second;
+}
+
+// Where the line holding position starts.
+size_t Viewport::line_start(size_t position) {
+    while (position > 0) {
+        size_t begin = position > kLineChunkSize ? position - kLineChunkSize : 0;
+        std::string chunk = _editor.retrieve_range(begin, position - begin);
+        size_t newline = chunk.rfind('\n');
+        if (newline != std::string::npos) {
+            return begin + newline + 1;
+        }
+        position = begin;
+    }
+    return 0;
+}
+
+// Keeps the cache to a few screens: past that, lines outside the current
+// view are dropped.
+void Viewport::trim_cache() {
+    if (_lines.size() <= 4 * _height + 16 || _rows.empty()) return;
+    size_t last = _rows.back().position;
+    for (auto it = _lines.begin(); it != _lines.end();) {
+        it = it->first < _top || it->first > last ? _lines.erase(it) : std::next(it);
+    }
+}
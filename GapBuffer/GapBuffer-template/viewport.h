@@ -0,0 +1,74 @@
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include "texteditor.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One screen row: a whole line, or one wrapped piece of a long one.
+// position is where the row starts in the document; text stays valid
+// until the next render() or resize().
+struct ViewRow {
+    size_t position;
+    std::string_view text;
+    bool line_end; // last row of its line
+};
+
+struct ViewportStats {
+    uint64_t lines_laid_out;    // read from the editor and wrapped
+    uint64_t lines_reused;      // served from the cache
+    uint64_t full_invalidations; // edits too old to replay, so everything went
+};
+
+/*
+ * A window of height rows onto a TextEditor, wrapping lines longer than
+ * width at the last space that fits (or at width if there is none).
+ *
+ * Laid-out lines are cached by their position. Before each render the
+ * viewport asks the editor for the edits made since the last one: lines
+ * an edit touched are dropped, lines after it just move by the size
+ * change, and the rest stay as they are. So a keystroke re-reads one line
+ * and scrolling by one row reads at most one new line, instead of one
+ * retrieve_character per visible cell.
+ *
+ * Render on the thread that edits, or while nothing edits concurrently:
+ * a line read while an edit races with it could be cached stale.
+ */
+class Viewport {
+public:
+    Viewport(TextEditor& editor, size_t width, size_t height);
+
+    const std::vector<ViewRow>& render();
+    void resize(size_t width, size_t height);
+    void scroll_to(size_t position);
+    void scroll_by(int lines);
+    size_t top() const;
+    ViewportStats stats() const;
+
+private:
+    struct Line {
+        std::string text;          // without the newline
+        bool newline;              // false for the last line of the document
+        std::vector<size_t> rows;  // where each wrapped row starts in text
+    };
+
+    TextEditor& _editor;
+    size_t _width;
+    size_t _height;
+    size_t _top; // start of the first visible line
+    uint64_t _edits_seen;
+    std::map<size_t, Line> _lines; // by start position
+    std::vector<ViewRow> _rows;
+    ViewportStats _stats;
+
+    void catch_up();
+    void invalidate(const TextEdit& edit, bool& realign_top);
+    const Line& line_at(size_t start);
+    size_t line_start(size_t position);
+    void trim_cache();
+};
+
+#endif // VIEWPORT_H
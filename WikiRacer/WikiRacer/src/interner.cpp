@@ -0,0 +1,87 @@
+#include <cstring>
+#include "interner.h"
+
+using std::string;
+
+
+namespace {
+
+const uint32_t kEmpty = UINT32_MAX;
+
+// 32-bit FNV-1a
+uint32_t hashTitle(const char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+}
+
+
+TitleInterner::TitleInterner() : offsets(1, 0), slots(1024, kEmpty) {}
+
+TitleInterner& TitleInterner::global() {
+    static TitleInterner interner;
+    return interner;
+}
+
+/*
+ * Returns the id of the title made of length bytes at data, giving it the
+ * next id if it has not been seen before.
+ */
+uint32_t TitleInterner::intern(const char* data, size_t length) {
+    uint32_t hash = hashTitle(data, length);
+    size_t mask = slots.size() - 1;
+    for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+        uint32_t id = slots[slot];
+        if (id == kEmpty) {
+            id = static_cast<uint32_t>(hashes.size());
+            arena.append(data, length);
+            offsets.push_back(arena.size());
+            hashes.push_back(hash);
+            slots[slot] = id;
+            if (2 * hashes.size() > slots.size()) {
+                grow();
+            }
+            return id;
+        }
+        if (hashes[id] == hash && matches(id, data, length)) {
+            return id;
+        }
+    }
+}
+
+uint32_t TitleInterner::intern(const string& title) {
+    return intern(title.data(), title.size());
+}
+
+string TitleInterner::title(uint32_t id) const {
+    return arena.substr(offsets[id], offsets[id + 1] - offsets[id]);
+}
+
+// The number of titles interned, one more than the largest id.
+size_t TitleInterner::size() const {
+    return hashes.size();
+}
+
+bool TitleInterner::matches(uint32_t id, const char* data, size_t length) const {
+    return offsets[id + 1] - offsets[id] == length &&
+           std::memcmp(arena.data() + offsets[id], data, length) == 0;
+}
+
+// Doubles the table, keeping it at most half full.
+void TitleInterner::grow() {
+    std::vector<uint32_t> grown(2 * slots.size(), kEmpty);
+    size_t mask = grown.size() - 1;
+    for (uint32_t id = 0; id < hashes.size(); ++id) {
+        size_t slot = hashes[id] & mask;
+        while (grown[slot] != kEmpty) {
+            slot = (slot + 1) & mask;
+        }
+        grown[slot] = id;
+    }
+    slots.swap(grown);
+}
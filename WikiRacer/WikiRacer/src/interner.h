@@ -0,0 +1,41 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Maps page titles to dense ids 0, 1, 2, ... in the order they are first
+ * seen. The bytes of every title are kept back to back in one arena and
+ * the hash table holds only ids, so a title is stored once however many
+ * caches, link sets and ladders refer to it, and everything past interning
+ * hashes and compares 32-bit ids instead of strings.
+ */
+class TitleInterner {
+public:
+    TitleInterner();
+
+    /*
+     * The interner shared by the WikiScraper and the search, so their ids
+     * agree.
+     */
+    static TitleInterner& global();
+
+    uint32_t intern(const char* data, size_t length);
+    uint32_t intern(const std::string& title);
+    std::string title(uint32_t id) const;
+    size_t size() const;
+
+private:
+    std::string arena;
+    std::vector<size_t> offsets;  // title id is arena[offsets[id], offsets[id + 1])
+    std::vector<uint32_t> hashes; // by id, so growing never rehashes the bytes
+    std::vector<uint32_t> slots;  // open addressing; each an id or kEmpty
+
+    bool matches(uint32_t id, const char* data, size_t length) const;
+    void grow();
+};
+
+#endif // INTERNER_H
@@ -1,16 +1,55 @@
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
-#include <unordered_set>
 #include <vector>
 #include <queue>
-#include <unordered_map>
 #include "wikiscraper.h"
+#include "interner.h"
 
 
 using std::cout;            using std::endl;
 using std::string;          using std::vector;
-using std::priority_queue;  using std::unordered_map;
-using std::unordered_set;
+using std::priority_queue;
+
+
+/*
+ * A page reached by the search. Nodes form a tree through their parent
+ * indices, so a ladder is the path from a node back to the start page and
+ * is only built once the end page is found.
+ */
+struct LadderNode {
+    uint32_t page; // title id
+    uint32_t parent;
+    uint32_t depth;
+    int score;
+};
+
+/*
+ * A partial ladder in the search queue: the score of its last page against
+ * the end page, and that page's index in the node table.
+ */
+struct LadderEntry {
+    int score;
+    uint32_t node;
+};
+
+
+/*
+ * Follows parent indices from node back to the start page, then appends
+ * end_page, looking up each page's title.
+ */
+vector<string> buildLadder(const vector<LadderNode>& nodes, uint32_t node,
+                           const string& end_page) {
+    const TitleInterner& titles = TitleInterner::global();
+    vector<string> ladder(nodes[node].depth + 2);
+    ladder.back() = end_page;
+    for (uint32_t index = node; ; index = nodes[index].parent) {
+        ladder[nodes[index].depth] = titles.title(nodes[index].page);
+        if (nodes[index].depth == 0) break;
+    }
+    return ladder;
+}
 
 
 /*
@@ -23,67 +62,76 @@ using std::unordered_set;
 vector<string> findWikiLadder(const string& start_page, const string& end_page) {
     // creates WikiScraper object
     WikiScraper scraper;
+    TitleInterner& titles = TitleInterner::global();
+    const uint32_t start_id = titles.intern(start_page);
+    const uint32_t end_id = titles.intern(end_page);
 
-    //creates visited pages set
-    unordered_set<string> visitedPages{};
-    visitedPages.insert(start_page);
-
-    //Create a ladder containing {start_page}
-    vector<string> ladder{start_page};
+    //creates visited pages set, indexed by title id
+    vector<bool> visitedPages(titles.size());
+    visitedPages[start_id] = true;
 
     // gets the set of links on page specified by end_page
-    // variable and stores in target_set variable
-    auto target_set = scraper.getLinkSet(end_page);
+    // variable and marks them in target_set, indexed by title id
+    const vector<uint32_t>& end_links = scraper.getLinkSet(end_id);
+    vector<bool> target_set(titles.size());
+    for (uint32_t link : end_links) {
+        target_set[link] = true;
+    }
+
+    // A page's score is the number of its links also on end_page. Every
+    // page gets one node, since visited pages are never added again, so
+    // each score is computed once and kept in the node; the heap only ever
+    // compares integers. Ids past target_set are titles first seen after
+    // it was filled, so none of them are in it.
+    auto scoreOf = [&scraper, &target_set](uint32_t page) -> int {
+        int score = 0;
+        for (uint32_t link : scraper.getLinkSet(page)) {
+            if (link < target_set.size() && target_set[link]) {
+                score++;
+            }
+        }
+        return score;
+    };
 
     // Comparison function for priority_queue
-     auto cmpFn = [&scraper,&target_set](const vector<string>& a, const vector<string>& b) -> bool {
-         string page1 = a.back();
-         string page2 = b.back();
-         int num1,num2;
-         auto link_set1 = scraper.getLinkSet(page1);
-         auto link_set2 = scraper.getLinkSet(page2);
-         for(auto &page : target_set) {
-             if (link_set1.count(page)) {
-                 num1++;
-             }
-             if (link_set2.count(page)) {
-                 num2++;
-             }
-         }
-         return num1 < num2;
+     auto cmpFn = [](const LadderEntry& a, const LadderEntry& b) -> bool {
+         return a.score < b.score;
      };
 
      // creates a priority_queue names ladderQueue
-     std::priority_queue<vector<string>, vector<vector<string>>,
+     std::priority_queue<LadderEntry, vector<LadderEntry>,
       decltype(cmpFn)> ladderQueue(cmpFn);
 
-     //add a ladder to the queue.
-     ladderQueue.push(ladder);
+     //add the start page to the node table and the queue.
+     vector<LadderNode> nodes;
+     nodes.push_back(LadderNode{start_id, 0, 0, scoreOf(start_id)});
+     ladderQueue.push(LadderEntry{nodes[0].score, 0});
 
      while (!ladderQueue.empty()) {
          //Dequeue the highest priority partial-ladder from the front of the queue.
-         vector<string> currentLadder = ladderQueue.top();
+         uint32_t current = ladderQueue.top().node;
          ladderQueue.pop();
 
          //Get the set of links of the current page
-         auto current_set = scraper.getLinkSet(currentLadder.back());
+         const vector<uint32_t>& current_set = scraper.getLinkSet(nodes[current].page);
 
-         if (current_set.count(end_page)) {
-             //Add end_page to the ladder you just dequeued and return it.
-             currentLadder.push_back(end_page);
-             return currentLadder;
+         if (std::binary_search(current_set.begin(), current_set.end(), end_id)) {
+             //Build the ladder ending in end_page and return it.
+             return buildLadder(nodes, current, end_page);
          }
 
-         for(auto& neighbour_page : current_set) {
+         // the links just fetched may have interned new titles
+         visitedPages.resize(titles.size());
+         for(uint32_t neighbour_page : current_set) {
              //If this neighbour page hasn’t already been visited
-             if (!visitedPages.count(neighbour_page)) {
-                 visitedPages.insert(neighbour_page);
-                 //Create a copy of the current partial-ladder.
-                 vector<string> newLadder{currentLadder};
-                 //Put the neighbor page string on top of the copied ladder.
-                 newLadder.push_back(neighbour_page);
-                 //Add the copied ladder to the queue.
-                 ladderQueue.push(newLadder);
+             if (!visitedPages[neighbour_page]) {
+                 visitedPages[neighbour_page] = true;
+                 //Add a node for the neighbour page, one rung below the current one.
+                 uint32_t node = static_cast<uint32_t>(nodes.size());
+                 nodes.push_back(LadderNode{neighbour_page, current,
+                                            nodes[current].depth + 1, scoreOf(neighbour_page)});
+                 //Add it to the queue, scored by the neighbour page.
+                 ladderQueue.push(LadderEntry{nodes[node].score, node});
              }
          }
      }
@@ -1,13 +1,14 @@
 #include <iostream>
 #include <algorithm>
-#include <unordered_set>
 #include <unordered_map>
+#include <vector>
 #include "wikiscraper.h"
+#include "interner.h"
 #include "error.h"
 
 using std::cout;            using std::endl;
 using std::cerr;            using std::string;
-using std::unordered_map;   using std::unordered_set;
+using std::unordered_map;   using std::vector;
 
 
 
@@ -18,27 +19,27 @@ using std::unordered_map;   using std::unordered_set;
  *
  * If you used any helper functions, just put them above this function.
  */
-unordered_set<string> findWikiLinks(const string& inp) {
-    unordered_set<string> link_set;
+vector<uint32_t> findWikiLinks(const string& inp) {
+    vector<uint32_t> link_set;
+    TitleInterner& titles = TitleInterner::global();
     string start_token = "<a href=\"/wiki/";
     char end_token = '"';
     auto start = inp.begin();
     auto end = inp.end();
     while (start != end) {
-        string valid_string = "";
         auto link_start = std::search(start, end, start_token.begin(), start_token.end());
         if(link_start == end) break;
         link_start += start_token.length();
         auto link_end = std::find(link_start, end, end_token);
-        while(link_start != link_end) {
-            valid_string += *link_start;
-            link_start++;
+        if (std::all_of(link_start, link_end, [](char ch) { return ch != '#' && ch != ':'; })) {
+            // interned straight from the page source, without a copy
+            link_set.push_back(titles.intern(inp.data() + (link_start - inp.begin()),
+                                      link_end - link_start));
         }
-        if (std::all_of(valid_string.begin(), valid_string.end(), [](char ch) { return ch != '#' && ch != ':'; })) {
-            link_set.insert(valid_string);
-        }
-        start = link_start;
+        start = link_end;
     }
+    std::sort(link_set.begin(), link_set.end());
+    link_set.erase(std::unique(link_set.begin(), link_set.end()), link_set.end());
     return link_set;
 }
 
@@ -48,17 +49,17 @@ unordered_set<string> findWikiLinks(const string& inp) {
  * |                           DON"T EDIT ANYTHING BELOW HERE                       |
  * ==================================================================================
  */
-unordered_set<string> WikiScraper::getLinkSet(const string& page_name) {
-    if(linkset_cache.find(page_name) == linkset_cache.end()) {
-        auto links = findWikiLinks(getPageSource(page_name));
-        linkset_cache[page_name] = links;
+const vector<uint32_t>& WikiScraper::getLinkSet(uint32_t page) {
+    auto found = linkset_cache.find(page);
+    if(found == linkset_cache.end()) {
+        found = linkset_cache.emplace(page, findWikiLinks(getPageSource(page))).first;
     }
-    return linkset_cache[page_name];
+    return found->second;
 }
 
 
 WikiScraper::WikiScraper() {
-    (void)getPageSource("Main_Page");
+    (void)getPageSource(TitleInterner::global().intern("Main_Page"));
 #ifdef _WIN32
     // define something for Windows
     system("cls");
@@ -90,9 +91,10 @@ void notFoundError(const string& msg, const string& page_name, const string& url
     errorPrint();
 }
 
-string WikiScraper::getPageSource(const string &page_name) {
+string WikiScraper::getPageSource(uint32_t page) {
     const static string not_found = "Wikipedia does not have an article with this exact name.";
-    if(page_cache.find(page_name) == page_cache.end()) {
+    if(page_cache.find(page) == page_cache.end()) {
+        const string page_name = TitleInterner::global().title(page);
         QUrl url(createPageUrl(page_name).c_str()); // need c string to convert to QString
 
         QNetworkRequest request(url);
@@ -112,9 +114,9 @@ string WikiScraper::getPageSource(const string &page_name) {
         if(indx != string::npos) {
             return ret.substr(0, indx);
         }
-        page_cache[page_name] = ret;
+        page_cache[page] = ret;
     }
-    return page_cache[page_name];
+    return page_cache[page];
 }
 
 
@@ -2,9 +2,10 @@
 #define WIKISCRAPER_H
 
 #include <QtNetwork>
+#include <cstdint>
 #include <string>
 #include <unordered_map>
-#include <unordered_set>
+#include <vector>
 
 class WikiScraper {
 
@@ -12,17 +13,19 @@ public:
     WikiScraper();
 
     /*
-     * This method takes the page name of a Wikipedia page and
-     * returns an unordered_set containing all the links on this page.
+     * This method takes the id of a Wikipedia page's title, as given
+     * by TitleInterner::global(), and returns the ids of all the links
+     * on this page, sorted and without duplicates. The reference stays
+     * valid as long as the scraper does.
      */
-    std::unordered_set<std::string> getLinkSet(const std::string& page_name);
+    const std::vector<uint32_t>& getLinkSet(uint32_t page);
 
 
 private:
     QNetworkAccessManager manager;
-    std::string getPageSource(const std::string& page_name);
-    std::unordered_map<std::string, std::string> page_cache;
-    std::unordered_map<std::string, std::unordered_set<std::string>> linkset_cache;
+    std::string getPageSource(uint32_t page);
+    std::unordered_map<uint32_t, std::string> page_cache;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> linkset_cache;
 };
 
 